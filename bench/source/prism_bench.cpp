@@ -0,0 +1,378 @@
+/**
+ * @file prism_bench.cpp
+ * @author Kyle Pelham (bonezone2001@gmail.com)
+ * @brief Performance benchmarks for the Prism application framework.
+ *
+ * Measures renderer startup, window creation up to the first presented frame, steady state frame
+ * times with 1, 4 and 16 windows, swapchain rebuilds and input throughput through the GLFW callbacks.
+ * The results are written as JSON, one entry per measurement with stable names, so runs of two
+ * revisions can be diffed directly. Runs headless by default, so neither a display server nor vsync
+ * gets in the way.
+ *
+ * Usage: prism_bench [--frames N] [--iterations N] [--input-events N] [--output FILE|-] [--windowed]
+ *
+ * @copyright Copyright (c) 2024
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fmt/core.h>
+#include "prism/prism.h"
+#include "prism/frame_profiler.h"
+
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#include "imgui.h"
+
+using Clock = std::chrono::steady_clock;
+
+// Every frame gets the same delta time, so runs don't depend on how fast the previous frame was
+static constexpr float FixedDeltaTime = 1.f / 60.f;
+
+// Frames rendered before measuring, so pipelines, pools and arenas have settled
+static constexpr uint32_t WarmupFrames = 30;
+
+// The window counts the steady state frame times are measured for
+static constexpr uint32_t WindowCounts[] = { 1, 4, 16 };
+
+/**
+ * @struct BenchOptions
+ * The command line options of the benchmark.
+*/
+struct BenchOptions
+{
+    uint32_t frames = 240;                      ///< Frames measured per steady state run.
+    uint32_t iterations = 10;                   ///< Repetitions of the startup and swapchain rebuild measurements.
+    uint32_t inputEventsPerFrame = 512;         ///< Input events dispatched per frame, below the input queue capacity.
+    std::string output = "prism_bench.json";    ///< Where the JSON goes, "-" for stdout.
+    bool headless = true;                       ///< Render offscreen, see Prism::RendererSettings::headless.
+};
+
+/**
+ * @struct BenchResult
+ * The samples of one measurement.
+*/
+struct BenchResult
+{
+    std::string name;                           ///< The stable name of the measurement.
+    std::string unit;                           ///< The unit of the samples.
+    std::vector<double> samples;                ///< The samples, in the order measured.
+};
+
+/**
+ * @class BenchWindow
+ * A window drawing a typical tool panel: text, a few widgets and a table.
+*/
+class BenchWindow : public Prism::Window
+{
+private:
+    float value = 0.5f;                         ///< Backs the slider.
+    bool toggle = false;                        ///< Backs the checkbox.
+    char text[64] = "prism";                    ///< Backs the text input.
+
+public:
+    explicit BenchWindow(Prism::WindowSettings settings) : Window(std::move(settings)) {}
+
+protected:
+    void onRender(float deltaTime) override
+    {
+        ImGui::SetNextWindowPos(ImVec2(0.f, 0.f));
+        ImGui::SetNextWindowSize(ImGui::GetIO().DisplaySize);
+        ImGui::Begin("Bench", nullptr, ImGuiWindowFlags_NoDecoration);
+        ImGui::Text("Frame %d, %.3f ms", ImGui::GetFrameCount(), deltaTime * 1000.f);
+        ImGui::SliderFloat("Value", &value, 0.f, 1.f);
+        ImGui::Checkbox("Toggle", &toggle);
+        ImGui::InputText("Text", text, sizeof(text));
+        if (ImGui::BeginTable("Rows", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY)) {
+            for (int row = 0; row < 200; row++) {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::Text("%d", row);
+                ImGui::TableNextColumn();
+                ImGui::Text("Row %d", row);
+                ImGui::TableNextColumn();
+                ImGui::ProgressBar((float)((row + ImGui::GetFrameCount()) % 100) / 100.f);
+            }
+            ImGui::EndTable();
+        }
+        ImGui::End();
+    }
+};
+
+static double MillisecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static BenchResult& AddResult(std::deque<BenchResult>& results, std::string name, std::string unit)
+{
+    results.push_back({ std::move(name), std::move(unit), {} });
+    return results.back();
+}
+
+static Prism::RendererSettings BenchRendererSettings(const BenchOptions& options)
+{
+    Prism::RendererSettings settings;
+    settings.headless = options.headless;
+    return settings;
+}
+
+static Prism::WindowSettings BenchWindowSettings(size_t index)
+{
+    Prism::WindowSettings settings;
+    settings.width = 640;
+    settings.height = 360;
+    settings.title = fmt::format("prism_bench {}", index);
+    settings.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR; // Falls back to FIFO where unsupported
+    return settings;
+}
+
+/**
+ * Measures constructing an Application, which initializes GLFW, the renderer and the ImGui allocator.
+*/
+static void BenchStartup(const BenchOptions& options, std::deque<BenchResult>& results)
+{
+    BenchResult& startup = AddResult(results, "startup.application", "ms");
+    for (uint32_t i = 0; i < options.iterations; i++) {
+        const Clock::time_point start = Clock::now();
+        auto app = std::make_unique<Prism::Application>("prism_bench", BenchRendererSettings(options));
+        startup.samples.push_back(MillisecondsSince(start));
+    }
+}
+
+/**
+ * Adds windows until there are count of them, timing construction and the first frame of each.
+*/
+static void AddWindows(Prism::Application& app, std::vector<std::shared_ptr<BenchWindow>>& windows, size_t count,
+                       BenchResult& construct, BenchResult& firstFrame)
+{
+    while (windows.size() < count) {
+        Clock::time_point start = Clock::now();
+        auto window = app.addWindow<BenchWindow>(BenchWindowSettings(windows.size()));
+        construct.samples.push_back(MillisecondsSince(start));
+
+        // Up to the GPU finishing the first frame, not just its submission
+        start = Clock::now();
+        window->step(FixedDeltaTime);
+        app.getRenderer()->waitIdle();
+        firstFrame.samples.push_back(MillisecondsSince(start));
+
+        windows.push_back(std::move(window));
+    }
+}
+
+/**
+ * Measures steady state frames across every window, wall time per main loop iteration plus each window's CPU and GPU time.
+*/
+static void BenchFrames(const BenchOptions& options, Prism::Application& app,
+                        const std::vector<std::shared_ptr<BenchWindow>>& windows, std::deque<BenchResult>& results)
+{
+    const std::string prefix = fmt::format("frame.windows_{}", windows.size());
+    BenchResult& wall = AddResult(results, prefix + ".wall", "ms");
+    BenchResult& cpu = AddResult(results, prefix + ".cpu", "ms");
+    BenchResult& gpu = AddResult(results, prefix + ".gpu", "ms");
+
+    app.step(WarmupFrames, FixedDeltaTime);
+    std::vector<uint64_t> firstFrames;
+    for (const auto& window : windows)
+        firstFrames.push_back(window->getProfiler().getLatest().frameNumber);
+
+    for (uint32_t frame = 0; frame < options.frames; frame++) {
+        const Clock::time_point start = Clock::now();
+        app.step(1, FixedDeltaTime);
+        wall.samples.push_back(MillisecondsSince(start));
+    }
+    app.getRenderer()->waitIdle();
+
+    // The profiler only keeps its last frames, a longer run samples the most recent of them
+    for (size_t i = 0; i < windows.size(); i++) {
+        for (const Prism::FrameTimings& timings : windows[i]->getProfiler().getHistory()) {
+            if (timings.frameNumber <= firstFrames[i])
+                continue;
+
+            // Waiting on the GPU isn't CPU work
+            double cpuTime = 0.0;
+            for (size_t scope = 0; scope < (size_t)Prism::ProfileScope::Count; scope++)
+                if (scope != (size_t)Prism::ProfileScope::FenceWait)
+                    cpuTime += timings.cpu[scope];
+            cpu.samples.push_back(cpuTime);
+            if (timings.gpuTime >= 0.0)
+                gpu.samples.push_back(timings.gpuTime);
+        }
+    }
+}
+
+/**
+ * Measures frames that rebuild the swapchain, forced by setting the image count the window already has.
+*/
+static void BenchSwapchainRebuild(const BenchOptions& options, Prism::Application& app, BenchWindow& window,
+                                  std::deque<BenchResult>& results)
+{
+    BenchResult& rebuild = AddResult(results, "swapchain.rebuild_frame", "ms");
+    for (uint32_t i = 0; i < options.iterations; i++) {
+        window.setSwapchainImageCount(window.getSettings().swapchainImageCount);
+        const Clock::time_point start = Clock::now();
+        window.step(FixedDeltaTime);
+        app.getRenderer()->waitIdle();
+        rebuild.samples.push_back(MillisecondsSince(start));
+    }
+}
+
+/**
+ * Measures input dispatched through the window's GLFW callbacks, and the frames draining it into ImGui.
+*/
+static void BenchInput(const BenchOptions& options, BenchWindow& window, std::deque<BenchResult>& results)
+{
+    BenchResult& dispatch = AddResult(results, "input.dispatch", "ns/event");
+    BenchResult& drain = AddResult(results, "input.frame", "ms");
+
+    // Setting a callback hands back the previous one, put straight back so nothing changes
+    GLFWwindow* handle = window.getHandle();
+    const GLFWcursorposfun cursorPos = glfwSetCursorPosCallback(handle, nullptr);
+    glfwSetCursorPosCallback(handle, cursorPos);
+    const GLFWmousebuttonfun mouseButton = glfwSetMouseButtonCallback(handle, nullptr);
+    glfwSetMouseButtonCallback(handle, mouseButton);
+    const GLFWkeyfun key = glfwSetKeyCallback(handle, nullptr);
+    glfwSetKeyCallback(handle, key);
+    const GLFWcharfun character = glfwSetCharCallback(handle, nullptr);
+    glfwSetCharCallback(handle, character);
+    if (!cursorPos || !mouseButton || !key || !character)
+        return;
+
+    const uint32_t frames = std::min(options.frames, 60u);
+    const uint32_t events = std::max(options.inputEventsPerFrame / 4, 1u) * 4;
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        Clock::time_point start = Clock::now();
+        for (uint32_t i = 0; i < events; i += 4) {
+            cursorPos(handle, (double)(i % 640), (double)(i % 360));
+            mouseButton(handle, GLFW_MOUSE_BUTTON_LEFT, (i & 4) ? GLFW_RELEASE : GLFW_PRESS, 0);
+            key(handle, GLFW_KEY_A, 0, (i & 4) ? GLFW_RELEASE : GLFW_PRESS, 0);
+            character(handle, 'a' + (i / 4) % 26);
+        }
+        dispatch.samples.push_back(MillisecondsSince(start) * 1e6 / (double)events);
+
+        start = Clock::now();
+        window.step(FixedDeltaTime);
+        drain.samples.push_back(MillisecondsSince(start));
+    }
+}
+
+static std::string JsonEscape(const std::string& str)
+{
+    std::string escaped;
+    for (char c : str) {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        if ((unsigned char)c >= 0x20)
+            escaped += c;
+    }
+    return escaped;
+}
+
+static std::string ResultsToJson(const BenchOptions& options, const std::string& gpuName, uint32_t droppedInputEvents,
+                                 std::deque<BenchResult>& results)
+{
+    std::string json = "{\n";
+    json += "  \"schema\": 1,\n";
+    json += fmt::format("  \"headless\": {},\n", options.headless);
+    json += fmt::format("  \"gpu\": \"{}\",\n", JsonEscape(gpuName));
+    json += fmt::format("  \"frames\": {},\n", options.frames);
+    json += fmt::format("  \"iterations\": {},\n", options.iterations);
+    json += fmt::format("  \"input_events_dropped\": {},\n", droppedInputEvents);
+    json += "  \"results\": {";
+    for (size_t i = 0; i < results.size(); i++) {
+        BenchResult& result = results[i];
+        json += i ? ",\n" : "\n";
+        json += fmt::format("    \"{}\": {{ \"unit\": \"{}\", \"samples\": {}", result.name, result.unit, result.samples.size());
+        if (!result.samples.empty()) {
+            std::vector<double> sorted = result.samples;
+            std::sort(sorted.begin(), sorted.end());
+            double sum = 0.0;
+            for (double sample : sorted)
+                sum += sample;
+            const auto percentile = [&](double p) { return sorted[(size_t)(p * (double)(sorted.size() - 1) + 0.5)]; };
+            json += fmt::format(", \"mean\": {:.4f}, \"median\": {:.4f}, \"p95\": {:.4f}, \"min\": {:.4f}, \"max\": {:.4f}",
+                                sum / (double)sorted.size(), percentile(0.5), percentile(0.95), sorted.front(), sorted.back());
+        }
+        json += " }";
+    }
+    json += "\n  }\n}\n";
+    return json;
+}
+
+static bool ParseOptions(int argc, char** argv, BenchOptions& options)
+{
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+        if (!std::strcmp(argv[i], "--frames") && hasValue)
+            options.frames = std::max((uint32_t)std::strtoul(argv[++i], nullptr, 10), 1u);
+        else if (!std::strcmp(argv[i], "--iterations") && hasValue)
+            options.iterations = std::max((uint32_t)std::strtoul(argv[++i], nullptr, 10), 1u);
+        else if (!std::strcmp(argv[i], "--input-events") && hasValue)
+            options.inputEventsPerFrame = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--output") && hasValue)
+            options.output = argv[++i];
+        else if (!std::strcmp(argv[i], "--windowed"))
+            options.headless = false;
+        else
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+    if (!ParseOptions(argc, argv, options)) {
+        std::cerr << "Usage: prism_bench [--frames N] [--iterations N] [--input-events N] [--output FILE|-] [--windowed]\n";
+        return 1;
+    }
+
+    // A deque, so the results still collecting samples keep their address as more are added
+    std::deque<BenchResult> results;
+    BenchStartup(options, results);
+
+    // One application for everything else, windows accumulate from 1 up to the largest count
+    auto app = std::make_unique<Prism::Application>("prism_bench", BenchRendererSettings(options));
+    const std::string gpuName = app->getRenderer()->getPhysicalDeviceProperties().deviceName;
+    BenchResult& construct = AddResult(results, "window.construct", "ms");
+    BenchResult& firstFrame = AddResult(results, "window.first_frame", "ms");
+
+    std::vector<std::shared_ptr<BenchWindow>> windows;
+    for (uint32_t count : WindowCounts) {
+        AddWindows(*app, windows, count, construct, firstFrame);
+        BenchFrames(options, *app, windows, results);
+        if (count == 1) {
+            BenchSwapchainRebuild(options, *app, *windows.front(), results);
+            BenchInput(options, *windows.front(), results);
+        }
+    }
+    const uint32_t droppedInputEvents = windows.front()->getDroppedInputEvents();
+
+    windows.clear();
+    app.reset();
+
+    const std::string json = ResultsToJson(options, gpuName, droppedInputEvents, results);
+    if (options.output == "-") {
+        std::cout << json;
+        return 0;
+    }
+
+    std::ofstream file(options.output, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cerr << fmt::format("prism_bench: Couldn't write {}\n", options.output);
+        return 1;
+    }
+    file << json;
+    fmt::print("prism_bench: Results written to {}\n", options.output);
+    return 0;
+}
@@ -1,5 +1,10 @@
 include(cmake/folders.cmake)
 
+option(BUILD_BENCHMARKS "Build the prism_bench benchmark target" OFF)
+if(BUILD_BENCHMARKS)
+  add_subdirectory(bench)
+endif()
+
 option(BUILD_MCSS_DOCS "Build documentation using Doxygen and m.css" OFF)
 if(BUILD_MCSS_DOCS)
   include(cmake/docs.cmake)
@@ -0,0 +1,228 @@
+/**
+ * @file data_table.h
+ * @author Kyle Pelham (bonezone2001@gmail.com)
+ * @brief Virtualized table widget for large datasets.
+ *
+ * This file contains the TableDataSource interface, which exposes a dataset column by column,
+ * and the DataTable widget drawing one. Only the visible rows are formatted and drawn, and
+ * sorting and filtering run on a background thread, so tables with millions of rows scroll
+ * at frame rate while the data keeps changing.
+ *
+ * @copyright Copyright (c) 2024
+*/
+
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "prism/prism_export.hpp"
+
+namespace Prism {
+
+/**
+ * @enum TableColumnType
+ * How a column's cells are read, sorted and filtered.
+*/
+enum class TableColumnType
+{
+    Number,     ///< Cells are read with TableDataSource::getNumber().
+    Text        ///< Cells are read with TableDataSource::getText().
+};
+
+/**
+ * @class TableDataSource
+ * A dataset drawn by DataTable, exposed column by column.
+ *
+ * The table reads cells as they become visible, and the background thread reads the sorted
+ * column and, when filtering, every column. Sources changing while shown must allow reads from
+ * another thread, e.g. by only appending or guarding in place changes with a shared mutex.
+ *
+ * Appending rows only grows getRowCount(). Rows edited in place may bump getChangeCounter() and be
+ * listed by getChangedRows() instead, the table then re-sorts and re-filters only them. Any other
+ * change (rows removed or reordered, or edits not listed) must bump getVersion(), which makes the
+ * table rebuild its sort and filter from scratch.
+*/
+class PRISM_EXPORT TableDataSource
+{
+public:
+    virtual ~TableDataSource() = default;
+
+    /**
+     * Formats a cell for display and filtering.
+     * By default Text cells are copied and Number cells printed in their shortest form.
+     * @param row The row.
+     * @param column The column.
+     * @param text Receives the text, its capacity is reused between cells.
+    */
+    virtual void formatCell(size_t row, size_t column, std::string& text) const;
+
+    virtual size_t getRowCount() const = 0;                                                         ///< @return The number of rows.
+    virtual size_t getColumnCount() const = 0;                                                      ///< @return The number of columns.
+    virtual std::string getColumnName(size_t column) const = 0;                                     ///< @return The header of a column.
+    virtual TableColumnType getColumnType(size_t column) const = 0;                                 ///< @return How a column's cells are read.
+    virtual double getNumber(size_t row, size_t column) const { return 0.0; }                       ///< @return The value of a Number cell.
+    virtual std::string_view getText(size_t row, size_t column) const { return {}; }                ///< @return The value of a Text cell, valid until the row changes.
+    virtual uint64_t getVersion() const = 0;                                                        ///< @return A counter bumped on any change besides appending rows.
+    virtual uint64_t getRowVersion(size_t row) const { return getVersion(); }                       ///< @return A counter bumped whenever the row changes, invalidating its cached text.
+    virtual uint64_t getChangeCounter() const { return 0; }                                         ///< @return A counter bumped whenever rows are edited in place, see getChangedRows().
+
+    /**
+     * Lists the rows edited in place since the change counter had a value.
+     * @param since A value getChangeCounter() returned before.
+     * @param rows Receives the edited rows, in any order and possibly repeated.
+     * @return true if listed; otherwise, false if the edits since aren't known anymore and the table rebuilds from scratch.
+    */
+    virtual bool getChangedRows(uint64_t since, std::vector<size_t>& rows) const { return false; }
+};
+
+/**
+ * @class DataTable
+ * Draws a TableDataSource as a sortable, filterable ImGui table.
+ *
+ * Each frame only the rows inside the scroll region are drawn, and their formatted text is cached
+ * until TableDataSource::getRowVersion() changes. Drawn cells request their glyphs from the font
+ * atlas, so dynamic fonts cover them, see FontAtlas::requestGlyphs(). Sorting by a column header or typing into the
+ * filter hands the work to the table's index thread, which builds the new row order without
+ * blocking the frame. Until it's done the previous order stays on screen, then the new one is swapped
+ * in whole. Rows appended to an unchanged source, and rows it reports edited in place, are filtered
+ * and merged into the existing order rather than sorting everything again.
+ *
+ * @note Draw from a window's onRender(), one thread at a time. Each table owns an index thread.
+*/
+class PRISM_EXPORT DataTable
+{
+private:
+    /**
+     * @struct IndexSpec
+     * What the rows are sorted and filtered by.
+    */
+    struct IndexSpec
+    {
+        int sortColumn = -1;                                ///< The column sorted by, -1 for source order.
+        bool ascending = true;                              ///< Is the sort ascending?
+        std::string filter;                                 ///< Lowercase text every shown row contains in some cell, empty for all rows.
+
+        bool operator==(const IndexSpec&) const = default;
+        bool isIdentity() const { return sortColumn < 0 && filter.empty(); }
+    };
+
+    /**
+     * @struct RowIndex
+     * A sorted and filtered row order, immutable once published.
+    */
+    struct RowIndex
+    {
+        IndexSpec spec;                                     ///< What the rows were sorted and filtered by.
+        uint64_t version = 0;                               ///< The source version the index was built from.
+        uint64_t changeCounter = 0;                         ///< The source change counter the index was built from.
+        size_t rowCount = 0;                                ///< Source rows the index covers, later rows are appended since.
+        std::vector<uint32_t> rows;                         ///< Source rows in display order.
+    };
+
+    /**
+     * @struct CachedRow
+     * The formatted text of a row.
+    */
+    struct CachedRow
+    {
+        uint64_t version = 0;                               ///< The row version the text was formatted from.
+        uint64_t lastDrawn = 0;                             ///< The draw() the row was last visible in.
+        std::vector<std::string> cells;                     ///< The text of every cell.
+    };
+
+    std::shared_ptr<TableDataSource> source;                ///< The rows drawn.
+    IndexSpec spec;                                         ///< The current sort and filter.
+    std::string filterText;                                 ///< The filter as typed.
+    bool filterVisible = true;                              ///< Is the filter box drawn above the table?
+    std::shared_ptr<const RowIndex> index;                  ///< The row order being drawn.
+    std::unordered_map<uint32_t, CachedRow> textCache;      ///< Formatted rows, recently visible ones only.
+    uint64_t drawCount = 0;                                 ///< Number of draw() calls, ages the cache.
+
+    std::thread indexThread;                                ///< Builds row orders in the background.
+    std::mutex indexMutex;                                  ///< Guards everything below.
+    std::condition_variable indexCondition;                 ///< Wakes the index thread.
+    std::shared_ptr<const RowIndex> publishedIndex;         ///< The newest row order built.
+    IndexSpec requestedSpec;                                ///< The sort and filter to build next.
+    bool indexRequested = false;                            ///< Is a build requested?
+    bool indexBuilding = false;                             ///< Is a build running?
+    bool stopping = false;                                  ///< Should the index thread exit?
+
+public:
+    /**
+     * Construct a new DataTable object and start its index thread.
+     * @param source The rows to draw.
+    */
+    explicit DataTable(std::shared_ptr<TableDataSource> source);
+
+    /**
+     * Destroy the DataTable object, waiting for a running build.
+    */
+    virtual ~DataTable();
+
+    DataTable(const DataTable&) = delete;
+    DataTable& operator=(const DataTable&) = delete;
+
+    /**
+     * Draws the table into the current ImGui window.
+     * @param id The ImGui id of the table.
+     * @param width The width of the table, 0 to fill the window.
+     * @param height The height of the table, 0 to fill the window.
+    */
+    void draw(const char* id, float width = 0.f, float height = 0.f);
+
+    /**
+     * Sets the filter, shown rows contain it in any cell, ignoring case.
+     * @param filter The filter, empty for all rows.
+    */
+    void setFilter(std::string_view filter);
+
+    /**
+     * Drops the cached text of every row, for changes getRowVersion() doesn't reflect like a new number format.
+    */
+    void invalidate() { textCache.clear(); }
+
+    // Getters & setters
+    // -------------------------------------------------------------------------
+    void setFilterVisible(bool visible) { filterVisible = visible; }          ///< @param visible Should the filter box be drawn above the table?
+    bool isFilterVisible() const { return filterVisible; }                   ///< @return true if the filter box is drawn.
+    const std::string& getFilter() const { return filterText; }              ///< @return The filter as typed.
+    TableDataSource& getSource() const { return *source; }                   ///< @return The rows drawn.
+    size_t getShownRowCount() const;                                         ///< @return Rows passing the filter, as of the current row order.
+    bool isIndexing();                                                       ///< @return true while a new row order is requested or being built.
+
+private:
+    /**
+     * Takes the newest row order and requests a new one if it's out of date.
+    */
+    void updateIndex();
+
+    /**
+     * Returns the formatted text of a row, formatting it if it changed.
+     * @param row The source row.
+     * @return The cached row.
+    */
+    const CachedRow& getCachedRow(uint32_t row);
+
+    /**
+     * The loop of the index thread, building every requested row order.
+    */
+    void indexThreadLoop();
+
+    /**
+     * Builds a row order, updating the previous one when rows were only appended or reported edited.
+     * @param source The rows.
+     * @param spec The sort and filter.
+     * @param previous The last row order built, may be nullptr.
+     * @return The row order, previous itself if it's still current.
+    */
+    static std::shared_ptr<const RowIndex> BuildIndex(const TableDataSource& source, const IndexSpec& spec,
+                                                      const std::shared_ptr<const RowIndex>& previous);
+};
+
+} // namespace Prism
@@ -0,0 +1,149 @@
+/**
+ * @file deletion_queue.h
+ * @author Kyle Pelham (bonezone2001@gmail.com)
+ * @brief Deferred destruction of Vulkan resources for Prism.
+ *
+ * This file contains the DeletionQueue class, which holds on to Vulkan handles until every
+ * frame that could still reference them has finished on the GPU. Handles are stored by type
+ * in preallocated buckets, so deferring a destruction never allocates.
+ *
+ * @copyright Copyright (c) 2024
+*/
+
+#pragma once
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "prism/prism_export.hpp"
+#include "prism/memory_allocator.h"
+
+namespace Prism {
+
+/**
+ * @class DeletionQueue
+ * Destroys Vulkan resources once the GPU is done with them.
+ *
+ * Every frame a window records is tagged with a serial from Renderer::beginFrameSerial().
+ * Deferred handles are keyed on the newest serial handed out at the time, and destroyed once
+ * every frame up to that serial has completed. Frames are tracked by serial rather than by
+ * swapchain image, so the queue works across windows and with any number of images.
+ *
+ * All methods are thread safe.
+*/
+class PRISM_EXPORT DeletionQueue
+{
+public:
+    static constexpr size_t BucketCount = 8;                ///< Number of buckets in the ring.
+    static constexpr size_t BucketCapacity = 256;           ///< Entries preallocated per bucket.
+
+private:
+    /**
+     * @enum EntryType
+     * The type of handle held by an entry.
+    */
+    enum class EntryType : uint8_t
+    {
+        Buffer,
+        Image,
+        ImageView,
+        Sampler,
+        DescriptorSet,
+        Framebuffer,
+        RenderPass,
+        Semaphore,
+        Memory
+    };
+
+    /**
+     * @struct Entry
+     * A handle waiting to be destroyed.
+    */
+    struct Entry
+    {
+        EntryType type;                                     ///< Which member holds the handle.
+        union
+        {
+            VkBuffer buffer;
+            VkImage image;
+            VkImageView imageView;
+            VkSampler sampler;
+            VkDescriptorSet descriptorSet;
+            VkFramebuffer framebuffer;
+            VkRenderPass renderPass;
+            VkSemaphore semaphore;
+        };
+        MemoryAllocation allocation;                        ///< The memory to free, for EntryType::Memory.
+    };
+
+    /**
+     * @struct Bucket
+     * Entries sharing a retire serial.
+    */
+    struct Bucket
+    {
+        uint64_t serial = 0;                                ///< Frame serial the entries wait for.
+        std::vector<Entry> entries;                         ///< The entries, capacity is kept between uses.
+    };
+
+    class Renderer* renderer = nullptr;                     ///< The renderer owning the device.
+    std::array<Bucket, BucketCount> buckets;                ///< Ring of buckets.
+    size_t headBucket = 0;                                  ///< The bucket new entries go into.
+    std::mutex mutex;                                       ///< Guards the buckets.
+
+public:
+    /**
+     * Construct a new DeletionQueue object.
+     * @param renderer The renderer whose frame serials to follow.
+    */
+    DeletionQueue(class Renderer* renderer);
+
+    /// Destroy the DeletionQueue object, destroying everything still queued.
+    virtual ~DeletionQueue();
+
+    DeletionQueue(const DeletionQueue&) = delete;
+    DeletionQueue& operator=(const DeletionQueue&) = delete;
+
+    void destroyBuffer(VkBuffer buffer);                    ///< @param buffer The buffer to destroy once unused.
+    void destroyImage(VkImage image);                       ///< @param image The image to destroy once unused.
+    void destroyImageView(VkImageView imageView);           ///< @param imageView The image view to destroy once unused.
+    void destroySampler(VkSampler sampler);                 ///< @param sampler The sampler to destroy once unused.
+    void freeDescriptorSet(VkDescriptorSet descriptorSet);  ///< @param descriptorSet The texture descriptor set to free once unused.
+    void destroyFramebuffer(VkFramebuffer framebuffer);     ///< @param framebuffer The framebuffer to destroy once unused.
+    void destroyRenderPass(VkRenderPass renderPass);        ///< @param renderPass The render pass to destroy once unused.
+    void destroySemaphore(VkSemaphore semaphore);           ///< @param semaphore The semaphore to destroy once unused.
+
+    /**
+     * Frees memory once unused and resets the allocation.
+     * @param allocation The allocation to free.
+    */
+    void freeMemory(MemoryAllocation& allocation);
+
+    /**
+     * Destroys everything whose frames have completed.
+     * Called by the application once per main loop iteration.
+    */
+    void collect();
+
+    /**
+     * Destroys everything, regardless of frames in flight.
+     * @note The device must be idle.
+    */
+    void flush();
+
+private:
+    /**
+     * Queues an entry under the newest frame serial.
+     * @param entry The entry to queue.
+    */
+    void push(const Entry& entry);
+
+    /**
+     * Destroys the handle held by an entry.
+     * @param entry The entry to destroy.
+    */
+    void destroy(Entry& entry);
+};
+
+} // namespace Prism
@@ -0,0 +1,129 @@
+/**
+ * @file descriptor_allocator.h
+ * @author Kyle Pelham (bonezone2001@gmail.com)
+ * @brief Growable descriptor set allocation for Prism.
+ *
+ * This file contains the DescriptorAllocator class, which hands out descriptor sets from a chain
+ * of pools. Pools start small and each new one doubles in size, so memory follows actual usage
+ * and running out of descriptors just adds another pool.
+ *
+ * @copyright Copyright (c) 2024
+*/
+
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "prism/prism_export.hpp"
+
+namespace Prism {
+
+/**
+ * @struct DescriptorPoolRatio
+ * How many descriptors of a type a pool holds per set.
+*/
+struct PRISM_EXPORT DescriptorPoolRatio
+{
+    VkDescriptorType type;                                  ///< The descriptor type.
+    float ratio;                                            ///< Descriptors of the type per set, may be fractional.
+};
+
+/**
+ * @class DescriptorAllocator
+ * Allocates descriptor sets from a chain of growing pools.
+ *
+ * An allocator is either persistent, with sets freed one by one (like texture descriptors), or
+ * transient, with all sets released at once by reset() (like the descriptors of a frame). A transient
+ * allocator that needed more than one pool replaces them with a single pool on reset(), sized for
+ * everything the last round used, so it settles on one pool that fits a typical frame.
+ *
+ * All methods are thread safe.
+*/
+class PRISM_EXPORT DescriptorAllocator
+{
+private:
+    /**
+     * @struct Pool
+     * A descriptor pool in the chain.
+    */
+    struct Pool
+    {
+        VkDescriptorPool pool = VK_NULL_HANDLE;             ///< The pool.
+        uint32_t maxSets = 0;                               ///< The sets the pool was sized for.
+        uint32_t usedSets = 0;                              ///< Sets allocated from the pool and not yet freed.
+        bool full = false;                                  ///< Set once an allocation failed, cleared when a set is freed or on reset.
+    };
+
+    class Renderer* renderer;                               ///< The renderer owning the device.
+    std::vector<DescriptorPoolRatio> ratios;                ///< Descriptors per set, by type.
+    bool freeable;                                          ///< Are sets freed individually, rather than by reset()?
+    uint32_t nextPoolSets;                                  ///< The sets the next pool is created for.
+    uint32_t maxPoolSets;                                   ///< The largest pool created.
+    std::vector<Pool> pools;                                ///< The pools, newest last.
+    size_t currentPool = 0;                                 ///< The pool allocated from first.
+    std::unordered_map<VkDescriptorSet, uint32_t> owners;   ///< The pool of every live set, only tracked when freeable.
+    std::mutex mutex;                                       ///< Guards everything above.
+
+public:
+    /**
+     * Construct a new DescriptorAllocator object.
+     * No pool is created until the first allocation.
+     * @param renderer The renderer owning the device.
+     * @param ratios Descriptors per set by type, every pool is sized from them.
+     * @param freeable Are sets freed individually with free()? Otherwise only reset() releases them.
+     * @param initialSets The sets the first pool holds.
+     * @param maxPoolSets The sets no single pool grows beyond, further pools just stay this size.
+    */
+    DescriptorAllocator(class Renderer* renderer, std::vector<DescriptorPoolRatio> ratios, bool freeable,
+                        uint32_t initialSets = 64, uint32_t maxPoolSets = 4096);
+
+    /**
+     * Destroy the DescriptorAllocator object, and every set allocated from it.
+    */
+    virtual ~DescriptorAllocator();
+
+    DescriptorAllocator(const DescriptorAllocator&) = delete;
+    DescriptorAllocator& operator=(const DescriptorAllocator&) = delete;
+
+    /**
+     * Allocates a descriptor set, chaining on a new pool if every pool is exhausted.
+     * @param layout The layout of the set, its bindings must only use the types of the ratios.
+     * @return The descriptor set.
+    */
+    VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+
+    /**
+     * Frees a descriptor set, only for freeable allocators.
+     * @param descriptorSet The descriptor set from allocate().
+    */
+    void free(VkDescriptorSet descriptorSet);
+
+    /**
+     * Releases every set at once, resetting the pools.
+     * Transient allocators that needed more than one pool get a single pool fitting what was used.
+     * @note Nothing may still use the sets, reset a frame's allocator only once its fence signaled.
+    */
+    void reset();
+
+    // Getters
+    // -------------------------------------------------------------------------
+    uint32_t getPoolCount();                                ///< @return The number of pools.
+    uint32_t getSetsInUse();                                ///< @return The sets allocated and not yet freed or reset.
+    uint32_t getSetCapacity();                              ///< @return The sets all pools were sized for.
+
+private:
+    /**
+     * Creates a pool and makes it current.
+     * @param maxSets The sets the pool holds.
+    */
+    void createPool(uint32_t maxSets);
+
+    /**
+     * Destroys every pool.
+    */
+    void destroyPools();
+};
+
+} // namespace Prism
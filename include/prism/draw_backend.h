@@ -0,0 +1,151 @@
+/**
+ * @file draw_backend.h
+ * @author Kyle Pelham (bonezone2001@gmail.com)
+ * @brief Batched ImGui draw data rendering for Prism.
+ *
+ * This file contains the DrawBackend class, which records ImGui draw data with far fewer
+ * draw calls than the ImGui Vulkan backend. Vertices and indices go into persistently
+ * mapped buffers owned by each frame in flight, textures are sampled from the renderer's
+ * TextureTable, and consecutive commands sharing a clip rect become a single draw.
+ *
+ * @copyright Copyright (c) 2024
+*/
+
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "prism/prism_export.hpp"
+#include "prism/memory_allocator.h"
+
+#include "imgui.h"
+
+namespace Prism {
+
+/**
+ * @class DrawBackend
+ * Records a window's ImGui draw data through the bindless texture table.
+ *
+ * Every vertex carries the table slot of the texture its command samples, so textures change
+ * without rebinding anything and draws only split where the scissor changes. Indices are
+ * rebased to 32 bits onto one shared vertex buffer, merging draws across draw lists too.
+ *
+ * Each frame in flight owns one host visible buffer holding both vertices and indices. It's
+ * mapped for its whole lifetime and only reallocated when a frame outgrows it, doubling in size.
+ * The frame's fence guards it, so writing it never waits on the GPU.
+ *
+ * Frames the table can't draw are left to the ImGui Vulkan backend, see render().
+*/
+class PRISM_EXPORT DrawBackend
+{
+public:
+    static constexpr VkDeviceSize InitialBufferSize = 256 * 1024;  ///< Size of a frame's buffer when first allocated.
+
+private:
+    /**
+     * @struct DrawVertex
+     * An ImDrawVert plus the texture table slot it samples.
+    */
+    struct DrawVertex
+    {
+        ImVec2 pos;                                         ///< Position in ImGui display coordinates.
+        ImVec2 uv;                                          ///< Texture coordinates.
+        ImU32 col;                                          ///< Packed RGBA color.
+        uint32_t texture;                                   ///< Slot in the texture table.
+    };
+
+    /**
+     * @struct FrameBuffer
+     * The vertices followed by the indices of one frame in flight.
+    */
+    struct FrameBuffer
+    {
+        VkBuffer buffer = VK_NULL_HANDLE;                   ///< The buffer, bound as vertex and index buffer.
+        MemoryAllocation allocation;                        ///< Its memory, persistently mapped.
+        VkDeviceSize size = 0;                              ///< The size of the buffer.
+    };
+
+    /**
+     * @struct MergedDraw
+     * Consecutive commands drawn with one vkCmdDrawIndexed().
+    */
+    struct MergedDraw
+    {
+        VkRect2D scissor;                                   ///< The clip rect the commands share, in framebuffer pixels.
+        uint32_t firstIndex;                                ///< The first index in the frame's buffer.
+        uint32_t indexCount;                                ///< The number of indices.
+    };
+
+    class Renderer* renderer = nullptr;                     ///< The renderer owning the device.
+    class TextureTable* textureTable = nullptr;             ///< The table textures are sampled from.
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;       ///< The texture table plus the display transform as push constants.
+    VkPipeline pipeline = VK_NULL_HANDLE;                   ///< The pipeline, compiled against the window's render pass.
+    std::vector<FrameBuffer> frames;                        ///< Buffers indexed by frame in flight.
+    std::vector<uint32_t> commandSlots;                     ///< Texture slot of every command of the frame being recorded.
+    std::vector<uint32_t> vertexSlots;                      ///< Texture slot of every vertex of the draw list being written.
+    std::vector<MergedDraw> draws;                          ///< Draws of the frame being recorded.
+    uint32_t drawCallCount = 0;                             ///< Draws recorded by the last render().
+    uint32_t commandCount = 0;                              ///< ImGui commands drawn by the last render().
+
+public:
+    /**
+     * Construct a new DrawBackend object.
+     * @note Only construct if IsSupported() returns true.
+     * @param renderer The renderer to draw with.
+     * @param renderPass The render pass draws are recorded in.
+     * @param frameCount The most frames in flight the window uses.
+    */
+    DrawBackend(class Renderer* renderer, VkRenderPass renderPass, uint32_t frameCount);
+
+    /// Destroy the DrawBackend object, buffers are destroyed once unused.
+    virtual ~DrawBackend();
+
+    DrawBackend(const DrawBackend&) = delete;
+    DrawBackend& operator=(const DrawBackend&) = delete;
+
+    /**
+     * Checks the renderer can draw through the backend.
+     * @param renderer The renderer.
+     * @return true if it has a texture table and Prism was built with the backend's shaders.
+    */
+    static bool IsSupported(const class Renderer& renderer);
+
+    /**
+     * Records draw data into a command buffer, inside the render pass.
+     * Nothing is recorded if a command has a user callback or a texture id the texture table doesn't
+     * know, like sets from ImGui_ImplVulkan_AddTexture(). Render those with ImGui_ImplVulkan_RenderDrawData().
+     * @param drawData The draw data.
+     * @param commandBuffer The command buffer.
+     * @param frameIndex The frame in flight being recorded, its previous commands must have completed.
+     * @return true if the draw data was recorded; otherwise, false if the ImGui backend must draw it.
+    */
+    bool render(ImDrawData* drawData, VkCommandBuffer commandBuffer, uint32_t frameIndex);
+
+    // Getters & setters
+    // -------------------------------------------------------------------------
+    uint32_t getDrawCallCount() const { return drawCallCount; }            ///< @return Draws recorded by the last render().
+    uint32_t getCommandCount() const { return commandCount; }              ///< @return ImGui commands those draws covered.
+
+private:
+    /**
+     * Creates the pipeline layout and the pipeline.
+     * @param renderPass The render pass draws are recorded in.
+    */
+    void createPipeline(VkRenderPass renderPass);
+
+    /**
+     * Makes sure a frame's buffer holds at least the given size, replacing it if not.
+     * @param frame The frame's buffer.
+     * @param size The bytes needed.
+    */
+    void reserve(FrameBuffer& frame, VkDeviceSize size);
+
+    /**
+     * Resolves the texture slot of every command into commandSlots.
+     * @param drawData The draw data.
+     * @return false if a command can't be drawn through the texture table.
+    */
+    bool resolveTextures(const ImDrawData* drawData);
+};
+
+} // namespace Prism
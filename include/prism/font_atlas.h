@@ -0,0 +1,266 @@
+/**
+ * @file font_atlas.h
+ * @author Kyle Pelham (bonezone2001@gmail.com)
+ * @brief The shared font atlas for Prism windows.
+ *
+ * This file contains the FontAtlas class, which owns a single ImFontAtlas and its GPU texture.
+ * Every window's ImGui context is created on top of it, so fonts are only rasterized and
+ * uploaded once no matter how many windows are open.
+ *
+ * @copyright Copyright (c) 2024
+*/
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "prism/prism_export.hpp"
+#include "prism/memory_allocator.h"
+
+#include "imgui.h"
+
+namespace Prism {
+
+/**
+ * @class FontAtlas
+ * A font atlas shared between all window ImGui contexts.
+ *
+ * The atlas is owned by the renderer and reference counted by the windows using it.
+ * Fonts can be added at any time outside of a frame, the atlas is (re)built and uploaded
+ * lazily the next time a window renders.
+ *
+ * Finished atlases are serialized into the renderer's cache directory, keyed on the ImGui
+ * version and everything that affects rasterization. Later launches load the pixels and
+ * glyph metrics straight from the cache and skip FreeType entirely. Atlases holding requested
+ * glyphs change too often to be worth caching, and stale cache files are removed.
+ *
+ * Dynamic fonts (see addDynamicFont()) only rasterize the default Latin ranges plus the glyphs
+ * requested with requestGlyphs(), so large scripts like CJK cost memory for the text actually shown.
+ * Requesting a glyph also marks it used. Text typed into a window, DataTable cells and viewport titles
+ * are requested as they're drawn, other text has to be requested by whoever draws it. Requested glyphs
+ * are kept under a budget: past it, the least recently used are dropped, but only those unused for
+ * UnusedBuildsBeforeEviction builds, so text still on screen never turns into the fallback glyph.
+ *
+ * @note ImGui binds every font to one texture and a glyph table fixed at build time, so new glyphs
+ *       take a rebuild of the atlas rather than a page of their own. Requests are batched up and
+ *       rebuild at most once every DynamicRebuildInterval. While the size stays the same the texture
+ *       is kept and only the rows the rebuild changed are uploaded, through the renderer's UploadQueue.
+*/
+class PRISM_EXPORT FontAtlas
+{
+public:
+    static constexpr size_t MinGlyphBudget = 256;           ///< The glyph budget memory pressure never shrinks below.
+    static constexpr std::chrono::milliseconds DynamicRebuildInterval{ 250 }; ///< The least time between rebuilds for requested glyphs.
+    static constexpr uint64_t UnusedBuildsBeforeEviction = 4; ///< Builds a requested glyph has to go unused for before the budget may drop it.
+
+private:
+    class Renderer* renderer = nullptr;                     ///< The renderer owning the GPU resources.
+    ImFontAtlas* atlas = nullptr;                           ///< The ImGui font atlas shared by the window contexts.
+    std::unordered_map<std::string, ImFont*> fonts;         ///< Map of named fonts inside the atlas.
+    bool dirty = true;                                      ///< Does the atlas need to be rebuilt and uploaded?
+    bool glyphsPending = false;                             ///< Were glyphs requested that the atlas doesn't hold yet?
+    std::chrono::steady_clock::time_point lastBuild;        ///< When the atlas was last built, rate limits rebuilds for requested glyphs.
+
+    std::vector<int> dynamicConfigs;                        ///< Indices into ImFontAtlas::ConfigData of the dynamic fonts.
+    std::vector<ImWchar> dynamicRanges;                     ///< Glyph ranges the dynamic fonts are built with, zero terminated pairs.
+    std::unordered_map<ImWchar, uint64_t> requestedGlyphs;  ///< Glyphs requested for the dynamic fonts, with the build they were last used in.
+    size_t glyphBudget = 4096;                              ///< The most glyphs requested at once, beyond the default ranges.
+    uint64_t buildCount = 0;                                ///< Number of builds so far, ages the requested glyphs.
+    std::shared_ptr<std::atomic<bool>> trimRequested = std::make_shared<std::atomic<bool>>(false); ///< Has memory pressure asked the next build to shrink the atlas? Set from any thread, shared so a late callback outliving the atlas stays safe.
+    uint32_t pressureCallbackId = 0;                        ///< The id of the renderer's memory pressure callback.
+
+    VkImage image = VK_NULL_HANDLE;                         ///< The atlas texture.
+    uint32_t imageWidth = 0;                                ///< The width of the atlas texture.
+    uint32_t imageHeight = 0;                               ///< The height of the atlas texture.
+    std::vector<uint64_t> rowHashes;                        ///< Hash of every texture row as uploaded, finds the rows a rebuild changed.
+    MemoryAllocation imageAllocation;                       ///< The memory backing the atlas texture.
+    VkImageView imageView = VK_NULL_HANDLE;                 ///< The view of the atlas texture.
+    VkSampler sampler = VK_NULL_HANDLE;                     ///< The sampler used for the atlas texture.
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;         ///< The descriptor set used as the ImGui texture id.
+    uint64_t uploadSerial = 0;                              ///< Serial of the upload filling the atlas texture, see UploadQueue.
+
+public:
+    /**
+     * Construct a new FontAtlas object.
+     * This only registers the default fonts, nothing is rasterized until build() is called.
+     * @param renderer The renderer to create the GPU resources with.
+    */
+    FontAtlas(class Renderer* renderer);
+
+    /// Destroy the FontAtlas object
+    virtual ~FontAtlas();
+
+    FontAtlas(const FontAtlas&) = delete;
+    FontAtlas& operator=(const FontAtlas&) = delete;
+
+    /**
+     * Adds a TTF font from memory to the atlas.
+     *
+     * The data must outlive the atlas, it isn't copied.
+     * @note Must not be called while any window is inside a frame.
+     * @param name The name to register the font under.
+     * @param data The TTF data.
+     * @param dataSize The size of the TTF data in bytes.
+     * @param sizePixels The font size in pixels.
+     * @param config Optional font config, FontDataOwnedByAtlas is always forced off.
+     * @param glyphRanges Optional glyph ranges to rasterize.
+     * @return The added font.
+    */
+    ImFont* addFont(const std::string& name, const void* data, int dataSize, float sizePixels, const ImFontConfig* config = nullptr, const ImWchar* glyphRanges = nullptr);
+
+    /**
+     * Adds a TTF font from memory whose glyphs are rasterized on request.
+     *
+     * Only the default Latin ranges are rasterized up front, anything else once requested with requestGlyphs().
+     * Use this for fonts covering large scripts or extra sizes, which would otherwise inflate the atlas.
+     * The data must outlive the atlas, it isn't copied.
+     * @note Must not be called while any window is inside a frame.
+     * @param name The name to register the font under.
+     * @param data The TTF data.
+     * @param dataSize The size of the TTF data in bytes.
+     * @param sizePixels The font size in pixels.
+     * @param config Optional font config, FontDataOwnedByAtlas is always forced off. May merge into another font.
+     * @return The added font.
+    */
+    ImFont* addDynamicFont(const std::string& name, const void* data, int dataSize, float sizePixels, const ImFontConfig* config = nullptr);
+
+    /**
+     * Requests the glyphs of a text for the dynamic fonts, marking them used.
+     * Glyphs not yet in the atlas show once the next rebuild ran. Call this for text drawn besides what the
+     * framework requests itself, every frame it's shown so its glyphs are never evicted.
+     * Requesting glyphs already in the atlas is cheap.
+     * @note Main thread only, like addFont().
+     * @param text The UTF-8 text.
+    */
+    void requestGlyphs(std::string_view text);
+
+    /**
+     * Requests a single glyph for the dynamic fonts.
+     * @param codepoint The codepoint.
+    */
+    void requestGlyph(unsigned int codepoint);
+
+    /**
+     * Sets the maximum number of requested glyphs kept in the atlas.
+     * Once exceeded, the next build drops the least recently used glyphs down to the budget, keeping those still in use.
+     * @param budget The glyph budget.
+    */
+    void setGlyphBudget(size_t budget) { glyphBudget = budget; }
+
+    /**
+     * Shrinks the atlas, done by the next build after memory pressure on a device local heap.
+     * Drops oversampling to 1 and halves the glyph budget of the dynamic fonts, never below MinGlyphBudget.
+     * @note Must not be called while any window is inside a frame.
+    */
+    void trim();
+
+    /**
+     * Rasterizes the atlas and starts uploading it to the GPU, if anything changed since the last build.
+     * Requested glyphs wait until DynamicRebuildInterval passed since the last build.
+     * @note Must not be called while any window is inside a frame.
+    */
+    void build();
+
+    /**
+     * Waits for the atlas texture's upload, call it before submitting work that samples the atlas.
+     * Uploads on the graphics queue are ordered before later submissions anyway, so this only waits on a dedicated transfer queue.
+    */
+    void waitForUpload();
+
+    /**
+     * Gets how long until a rebuild for requested glyphs is due, so the main loop wakes up for it.
+     * @return The seconds until the rebuild, 0 if one is due now, or DBL_MAX if none is pending.
+    */
+    double getTimeUntilRebuild() const;
+
+    /**
+     * Gets a font by name.
+     * @param name The name the font was registered under.
+     * @return The font, or nullptr if there is no font with that name.
+    */
+    ImFont* getFont(const std::string& name) const;
+
+    // Getters
+    // -------------------------------------------------------------------------
+    ImFontAtlas* getAtlas() const { return atlas; }                                         ///< @return The ImGui font atlas.
+    const std::unordered_map<std::string, ImFont*>& getFonts() const { return fonts; }      ///< @return Map of named fonts inside the atlas.
+    bool isDirty() const { return dirty || glyphsPending || *trimRequested; }                ///< @return true if the atlas needs to be rebuilt.
+    size_t getRequestedGlyphCount() const { return requestedGlyphs.size(); }                ///< @return Glyphs requested for the dynamic fonts.
+    size_t getGlyphBudget() const { return glyphBudget; }                                   ///< @return The most glyphs requested at once.
+
+private:
+    // Internal Methods
+    // -------------------------------------------------------------------------
+    /**
+     * Registers the default fonts. Roboto regular, bold and italic merged with Font Awesome.
+    */
+    void addDefaultFonts();
+
+    /**
+     * Rebuilds the glyph ranges of the dynamic fonts from the requested glyphs, evicting past the budget.
+    */
+    void updateDynamicRanges();
+
+    /**
+     * Computes the key identifying the current atlas contents in the cache.
+     * @return A hash over the ImGui version, atlas settings, font configs, font data and glyph ranges.
+    */
+    uint64_t computeCacheKey() const;
+
+    /**
+     * Gets the path the current atlas contents are cached at.
+     * @return The cache file path, or an empty path if disk caching is disabled or glyphs were requested.
+    */
+    std::filesystem::path getCachePath() const;
+
+    /**
+     * Restores the atlas from a serialized cache file instead of building it.
+     * @param path The cache file to load.
+     * @param pixels Receives the alpha8 atlas pixels.
+     * @param width Receives the width of the atlas in pixels.
+     * @param height Receives the height of the atlas in pixels.
+     * @return true if the cache was valid and the atlas restored; otherwise, false and the atlas is left untouched.
+    */
+    bool loadCache(const std::filesystem::path& path, std::vector<unsigned char>& pixels, int& width, int& height);
+
+    /**
+     * Serializes the built atlas to a cache file.
+     * @param path The cache file to write.
+     * @param pixels The alpha8 atlas pixels.
+     * @param width The width of the atlas in pixels.
+     * @param height The height of the atlas in pixels.
+    */
+    void saveCache(const std::filesystem::path& path, const unsigned char* pixels, int width, int height) const;
+
+    /**
+     * Removes the cached atlases other than the current one, they're left over from older builds or font setups.
+     * @param keep The cache file to keep.
+    */
+    static void PruneCache(const std::filesystem::path& keep);
+
+    /**
+     * Starts uploading the atlas pixels, into the current texture where only rows changed or else a new one.
+     * @param pixels The alpha8 atlas pixels, copied before this returns.
+     * @param width The width of the atlas in pixels.
+     * @param height The height of the atlas in pixels.
+    */
+    void uploadTexture(const unsigned char* pixels, int width, int height);
+
+    /**
+     * Destroys the atlas image, its view and descriptor set once frames in flight are done with them.
+    */
+    void destroyImage();
+
+    /**
+     * Destroys the GPU texture, its sampler included, once frames in flight are done with it.
+    */
+    void destroyTexture();
+};
+
+} // namespace Prism
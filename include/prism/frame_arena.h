@@ -0,0 +1,115 @@
+/**
+ * @file frame_arena.h
+ * @author Kyle Pelham (bonezone2001@gmail.com)
+ * @brief Linear per-frame scratch memory.
+ *
+ * This file contains the FrameArena class, a bump allocator windows reset at the start of every
+ * frame. UI code can build its short-lived strings and arrays in it without touching the heap.
+ *
+ * @copyright Copyright (c) 2024
+*/
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include <fmt/core.h>
+#include "prism/prism_export.hpp"
+
+namespace Prism {
+
+/**
+ * @class FrameArena
+ * A linear allocator that frees everything at once.
+ *
+ * Allocations bump an offset into a block. When a frame needs more than the block holds, further
+ * blocks are chained on, and the next reset() replaces them with a single block large enough for
+ * the whole frame. Once warmed up, a frame never allocates from the heap.
+ *
+ * @note Nothing is destructed on reset(), so only trivially destructible types can be allocated.
+*/
+class PRISM_EXPORT FrameArena
+{
+private:
+    /**
+     * @struct Block
+     * A chunk of memory allocations are carved from.
+    */
+    struct Block
+    {
+        std::unique_ptr<std::byte[]> data;                  ///< The memory of the block.
+        size_t size = 0;                                    ///< The size of the block in bytes.
+    };
+
+    std::vector<Block> blocks;                              ///< The blocks in use, the last one is allocated from.
+    size_t offset = 0;                                      ///< Bytes used of the last block.
+    size_t used = 0;                                        ///< Bytes allocated since the last reset, padding included.
+    size_t defaultBlockSize;                                ///< The size of the first block.
+
+public:
+    /**
+     * Construct a new FrameArena object.
+     * No memory is reserved until the first allocation.
+     * @param blockSize The size of the first block in bytes.
+    */
+    FrameArena(size_t blockSize = 64 * 1024);
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    /**
+     * Allocates uninitialized memory, valid until the next reset().
+     * @param size The size in bytes.
+     * @param alignment The alignment, a power of two.
+     * @return The memory.
+    */
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    /**
+     * Frees every allocation at once, merging the blocks of a frame that outgrew the first one.
+    */
+    void reset();
+
+    /**
+     * Allocates and default constructs an array, valid until the next reset().
+     * @tparam T The element type, trivially destructible.
+     * @param count The number of elements.
+     * @return The first element.
+    */
+    template<typename T>
+    T* alloc(size_t count = 1)
+    {
+        static_assert(std::is_trivially_destructible_v<T>, "FrameArena never runs destructors!");
+        T* ptr = (T*)allocate(sizeof(T) * count, alignof(T));
+        std::uninitialized_default_construct_n(ptr, count);
+        return ptr;
+    }
+
+    /**
+     * Formats a string into the arena, valid until the next reset().
+     * @param formatString The fmt format string.
+     * @param args The arguments to format.
+     * @return The string. It's null terminated, so data() can be handed to ImGui directly.
+    */
+    template<typename... Args>
+    std::string_view format(fmt::format_string<Args...> formatString, Args&&... args)
+    {
+        // The format string was checked at compile time by the caller, it's reused twice here
+        const fmt::string_view view = formatString;
+        const size_t size = fmt::formatted_size(fmt::runtime(view), args...);
+        char* str = alloc<char>(size + 1);
+        fmt::format_to(str, fmt::runtime(view), std::forward<Args>(args)...);
+        str[size] = '\0';
+        return std::string_view(str, size);
+    }
+
+    // Getters
+    // -------------------------------------------------------------------------
+    size_t getUsed() const { return used; }                 ///< @return Bytes allocated since the last reset.
+    size_t getCapacity() const;                             ///< @return Bytes reserved across all blocks.
+};
+
+} // namespace Prism
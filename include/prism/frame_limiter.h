@@ -0,0 +1,76 @@
+/**
+ * @file frame_limiter.h
+ * @author Kyle Pelham (bonezone2001@gmail.com)
+ * @brief Precise software frame rate limiting for Prism windows.
+ *
+ * This file contains the FrameLimiter class, which paces a window to a target frame rate
+ * using deadlines rather than fixed sleeps. Deadlines let the main loop keep drawing other
+ * windows while a capped one waits for its next frame.
+ *
+ * @copyright Copyright (c) 2024
+*/
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "prism/prism_export.hpp"
+
+namespace Prism {
+
+/**
+ * @class FrameLimiter
+ * Deadline based frame pacing.
+ *
+ * Each frame advances the deadline by the target interval, so short stalls are caught up
+ * on instead of accumulating drift. Longer stalls resynchronize to the current time.
+*/
+class PRISM_EXPORT FrameLimiter
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+private:
+    std::atomic<int64_t> intervalNs = 0;                ///< Target frame interval in nanoseconds, 0 when uncapped.
+    Clock::time_point nextDeadline = Clock::now();      ///< When the next frame may start.
+
+public:
+    /**
+     * Sets the target frame rate.
+     * Safe to call from another thread than the one pacing frames.
+     * @param fps The maximum frames per second. 0 or less disables the limiter.
+    */
+    void setFrameRate(float fps);
+
+    /**
+     * Checks if the next frame may start.
+     * @return true if uncapped or the deadline passed; otherwise, false.
+    */
+    bool isDue() const;
+
+    /**
+     * Marks the start of a frame, advancing the deadline by one interval.
+    */
+    void markFrame();
+
+    /**
+     * Sleeps until the next frame may start, then marks the frame.
+    */
+    void wait();
+
+    /**
+     * Sleeps until the given time.
+     *
+     * Uses a high resolution waitable timer on Windows and a coarse sleep elsewhere,
+     * then yields through the last fraction of a millisecond to hit the deadline precisely.
+     * @param deadline The time to sleep until.
+    */
+    static void SleepUntil(Clock::time_point deadline);
+
+    // Getters
+    // -------------------------------------------------------------------------
+    bool isEnabled() const { return intervalNs > 0; }                   ///< @return true if a frame rate cap is set.
+    Clock::time_point getDeadline() const { return nextDeadline; }      ///< @return When the next frame may start.
+};
+
+} // namespace Prism
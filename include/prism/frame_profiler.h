@@ -0,0 +1,200 @@
+/**
+ * @file frame_profiler.h
+ * @author Kyle Pelham (bonezone2001@gmail.com)
+ * @brief Per-window frame timing and GPU timestamp profiler.
+ *
+ * This file contains the FrameProfiler class, which records CPU time spent in each stage of
+ * a window's frame alongside the GPU time of its render pass. Timings are kept in a ring
+ * buffer, so the last few seconds can be inspected programmatically or through an overlay.
+ *
+ * @copyright Copyright (c) 2024
+*/
+
+#pragma once
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "prism/prism_export.hpp"
+
+namespace Prism {
+
+/**
+ * @enum ProfileScope
+ * The instrumented stages of a frame.
+*/
+enum class ProfileScope
+{
+    Events,         ///< Event pumping in the main loop, including any blocking wait for events.
+    Update,         ///< Window::onUpdate.
+    Render,         ///< Window::onRender.
+    ImGuiRender,    ///< ImGui::Render.
+    Acquire,        ///< vkAcquireNextImageKHR.
+    FenceWait,      ///< Waiting for the GPU to release the frame's resources.
+    Record,         ///< Recording the command buffer.
+    Submit,         ///< vkQueueSubmit.
+    Present,        ///< vkQueuePresentKHR, includes any vsync wait inside the driver.
+    Count
+};
+
+/**
+ * @struct FrameTimings
+ * Timings of a single frame. All times are in milliseconds.
+*/
+struct PRISM_EXPORT FrameTimings
+{
+    uint64_t frameNumber = 0;                               ///< The frame these timings belong to.
+    double frameTime = 0.0;                                 ///< Time between the start of this frame and the previous one.
+    double gpuTime = -1.0;                                  ///< GPU time of the render pass, negative if not (yet) available.
+    std::array<double, (size_t)ProfileScope::Count> cpu{}; ///< CPU time per scope.
+
+    /**
+     * Gets the CPU time of a scope.
+     * @param scope The scope to get.
+     * @return The CPU time in milliseconds.
+    */
+    double get(ProfileScope scope) const { return cpu[(size_t)scope]; }
+};
+
+/**
+ * @class FrameProfiler
+ * Records per-frame CPU scopes and GPU render pass timestamps for a window.
+ *
+ * Scopes may be recorded from the window's render thread as well as the main thread.
+ * Stages that complete on the render thread are attributed to the frame being built
+ * on the main thread at the time they finish.
+*/
+class PRISM_EXPORT FrameProfiler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    static constexpr size_t HistorySize = 240;              ///< Number of frames kept in the ring buffer.
+
+    /**
+     * @class Scope
+     * RAII helper timing a block of code.
+    */
+    class PRISM_EXPORT Scope
+    {
+    private:
+        FrameProfiler* profiler;                            ///< The profiler to record into, nullptr if disabled.
+        ProfileScope scope;                                 ///< The scope being timed.
+        Clock::time_point start;                            ///< When the scope started.
+
+    public:
+        Scope(FrameProfiler* profiler, ProfileScope scope);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+private:
+    bool enabled = true;                                    ///< Is profiling enabled?
+    bool overlayVisible = false;                            ///< Is the overlay drawn?
+    mutable std::mutex mutex;                               ///< Guards the timings, scopes can come from the render thread.
+    std::array<FrameTimings, HistorySize> history;          ///< Ring buffer of completed frames.
+    size_t historyHead = 0;                                 ///< Next slot to write in the ring buffer.
+    size_t historyCount = 0;                                ///< Number of valid frames in the ring buffer.
+    FrameTimings current;                                   ///< The frame currently in progress.
+    Clock::time_point frameStart;                           ///< When the current frame started.
+
+    VkDevice device = VK_NULL_HANDLE;                       ///< The device owning the query pool.
+    const VkAllocationCallbacks* allocator = nullptr;       ///< The allocator used for the query pool.
+    VkQueryPool queryPool = VK_NULL_HANDLE;                 ///< Two timestamps per frame in flight.
+    std::vector<uint64_t> queryFrameNumbers;                ///< Frame recorded into each frame in flight's queries, 0 if none pending.
+    double timestampPeriod = 0.0;                           ///< Nanoseconds per timestamp tick.
+    uint64_t timestampMask = 0;                             ///< Mask of the valid timestamp bits.
+
+public:
+    /// Destroy the FrameProfiler object
+    virtual ~FrameProfiler();
+
+    /**
+     * Creates the timestamp query pool.
+     * Does nothing if the queue family doesn't support timestamps.
+     * @param renderer The renderer to create the pool with.
+     * @param frameCount The number of frames in flight, each slot gets its own pair of queries.
+    */
+    void createQueryPool(class Renderer* renderer, uint32_t frameCount);
+
+    /**
+     * Destroys the timestamp query pool.
+     * @note The GPU must be done with all frames using it.
+    */
+    void destroyQueryPool();
+
+    /**
+     * Ends the previous frame, pushing it into the history, and starts a new one.
+    */
+    void beginFrame();
+
+    /**
+     * Adds CPU time to a scope of the current frame.
+     * @param scope The scope to add to.
+     * @param milliseconds The time to add.
+    */
+    void addCpuTime(ProfileScope scope, double milliseconds);
+
+    /**
+     * Writes the render pass start timestamp, must be recorded outside the render pass.
+     * @param commandBuffer The frame's command buffer.
+     * @param frameIndex The frame in flight slot the frame is recorded into.
+    */
+    void writeGpuBegin(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+
+    /**
+     * Writes the render pass end timestamp, must be recorded outside the render pass.
+     * @param commandBuffer The frame's command buffer.
+     * @param frameIndex The frame in flight slot the frame is recorded into.
+    */
+    void writeGpuEnd(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+
+    /**
+     * Reads back the GPU timings of the last frame recorded into a frame in flight slot.
+     * @note Must be called after the slot's fence was waited on.
+     * @param frameIndex The frame in flight slot whose queries to read.
+    */
+    void collectGpuTimings(uint32_t frameIndex);
+
+    /**
+     * Draws the profiler overlay into the current ImGui frame, if it's visible.
+    */
+    void drawOverlay();
+
+    /**
+     * Gets the completed frames in the ring buffer.
+     * @return The frames, oldest first.
+    */
+    std::vector<FrameTimings> getHistory() const;
+
+    /**
+     * Gets the most recently completed frame.
+     * @return The frame's timings, default constructed if no frame completed yet.
+    */
+    FrameTimings getLatest() const;
+
+    /**
+     * Gets the average timings over the ring buffer.
+     * GPU time is averaged over the frames it's available for.
+     * @return The averaged timings.
+    */
+    FrameTimings getAverage() const;
+
+    /**
+     * Gets the display name of a scope.
+     * @param scope The scope.
+     * @return The scope's name.
+    */
+    static const char* GetScopeName(ProfileScope scope);
+
+    // Getters & Setters
+    // -------------------------------------------------------------------------
+    void setEnabled(bool enable) { enabled = enable; }                  ///< @param enable Should profiling be enabled?
+    void setOverlayVisible(bool visible) { overlayVisible = visible; }  ///< @param visible Should the overlay be drawn?
+    bool isEnabled() const { return enabled; }                          ///< @return true if profiling is enabled.
+    bool isOverlayVisible() const { return overlayVisible; }            ///< @return true if the overlay is drawn.
+    bool hasGpuTimings() const { return queryPool != VK_NULL_HANDLE; }  ///< @return true if GPU timestamps are supported.
+};
+
+} // namespace Prism
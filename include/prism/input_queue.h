@@ -0,0 +1,103 @@
+/**
+ * @file input_queue.h
+ * @author Kyle Pelham (bonezone2001@gmail.com)
+ * @brief Lock-free queue of raw window input events.
+ *
+ * This file contains the InputQueue class, a single producer single consumer ring the GLFW
+ * callbacks push raw events into. The window drains it into ImGui once per frame, so the
+ * callbacks do no ImGui work and no GLFW state queries of their own.
+ *
+ * @copyright Copyright (c) 2024
+*/
+
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include "prism/prism_export.hpp"
+
+namespace Prism {
+
+/**
+ * @enum InputEventType
+ * The kinds of raw input events a window receives.
+*/
+enum class InputEventType : uint8_t
+{
+    Focus,          ///< The window gained or lost focus.
+    CursorEnter,    ///< The cursor entered or left the window.
+    CursorPos,      ///< The cursor moved.
+    MouseButton,    ///< A mouse button was pressed or released.
+    Scroll,         ///< The mouse wheel or touchpad scrolled.
+    Key,            ///< A key was pressed or released.
+    Char            ///< A character was typed.
+};
+
+/**
+ * @struct InputEvent
+ * A raw input event, as GLFW reported it.
+*/
+struct PRISM_EXPORT InputEvent
+{
+    InputEventType type;                                    ///< The kind of event, selects the union member.
+    union
+    {
+        bool focused;                                       ///< Focus: true if the window gained focus.
+        bool entered;                                       ///< CursorEnter: true if the cursor entered.
+        struct { double x, y; } position;                   ///< CursorPos: the cursor position in window coordinates.
+        struct { int button, action, mods; } mouseButton;   ///< MouseButton: the GLFW button, action and modifier bits.
+        struct { double x, y; } scroll;                     ///< Scroll: the scroll offsets.
+        struct { int keycode, translatedKey, scancode, action, mods; } key; ///< Key: the GLFW key, the key translated to the layout, scancode, action and modifier bits.
+        unsigned int codepoint;                             ///< Char: the Unicode code point.
+    };
+};
+
+/**
+ * @class InputQueue
+ * A fixed size single producer single consumer ring of input events.
+ *
+ * Pushing and draining never lock or allocate, so events can be produced on a different
+ * thread than the one draining them. Draining only takes the events pushed before it started,
+ * anything arriving meanwhile waits for the next frame.
+ *
+ * @note Exactly one thread may push and one thread may drain at a time.
+*/
+class PRISM_EXPORT InputQueue
+{
+public:
+    static constexpr uint32_t Capacity = 1024;              ///< Events held before pushing fails, a power of two.
+
+private:
+    std::array<InputEvent, Capacity> events;                ///< The ring of events.
+    alignas(64) std::atomic<uint32_t> head = 0;             ///< Count of events pushed, written by the producer only.
+    alignas(64) std::atomic<uint32_t> tail = 0;             ///< Count of events drained, written by the consumer only.
+    std::atomic<uint32_t> dropped = 0;                      ///< Events dropped because the ring was full.
+
+public:
+    /**
+     * Pushes an event, from the producing thread.
+     * @param event The event.
+     * @return true if queued; otherwise, false and the event was dropped because the ring is full.
+    */
+    bool push(const InputEvent& event);
+
+    /**
+     * Hands every event pushed so far to a callback, in order, from the draining thread.
+     * @param callback Called with each event as const InputEvent&.
+    */
+    template<typename F>
+    void drain(F&& callback)
+    {
+        uint32_t read = tail.load(std::memory_order_relaxed);
+        const uint32_t write = head.load(std::memory_order_acquire);
+        for (; read != write; read++)
+            callback(events[read & (Capacity - 1)]);
+        tail.store(read, std::memory_order_release);
+    }
+
+    // Getters
+    // -------------------------------------------------------------------------
+    uint32_t getDropped() const { return dropped.load(std::memory_order_relaxed); } ///< @return Events dropped because the ring was full.
+};
+
+} // namespace Prism
@@ -0,0 +1,333 @@
+/**
+ * @file memory_allocator.h
+ * @author Kyle Pelham (bonezone2001@gmail.com)
+ * @brief Pooled device memory sub-allocation for Prism.
+ *
+ * This file contains the MemoryAllocator class, which carves buffers and images out of large
+ * VkDeviceMemory blocks instead of giving every resource an allocation of its own. That keeps
+ * the number of driver allocations small and VRAM unfragmented when showing lots of textures.
+ *
+ * @copyright Copyright (c) 2024
+*/
+
+#pragma once
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "prism/prism_export.hpp"
+
+namespace Prism {
+
+/**
+ * @enum MemoryCategory
+ * What Prism uses memory for, allocations are accounted per category.
+*/
+enum class MemoryCategory : uint8_t
+{
+    Texture,        ///< Texture images.
+    RenderTarget,   ///< Render target images.
+    FontAtlas,      ///< The font atlas texture.
+    Staging,        ///< Upload staging and readback buffers.
+    Swapchain,      ///< Swapchain images. Presentable ones are allocated by the driver, their size is estimated.
+    Other,          ///< Everything else, like the draw backend's buffers.
+    Count
+};
+
+/**
+ * @struct MemoryHeapBudget
+ * How much of a memory heap is in use and how much may be.
+*/
+struct PRISM_EXPORT MemoryHeapBudget
+{
+    VkDeviceSize size = 0;                          ///< The size of the heap.
+    VkDeviceSize usage = 0;                         ///< Bytes of the heap used by the process. Without VK_EXT_memory_budget only Prism's own allocations.
+    VkDeviceSize budget = 0;                        ///< Bytes the process can use before allocations may fail. Without VK_EXT_memory_budget 80% of the heap.
+    bool deviceLocal = false;                       ///< Is the heap device local, i.e. VRAM on discrete GPUs?
+};
+
+/**
+ * @struct MemoryPressure
+ * Passed to memory pressure callbacks, see Renderer::addMemoryPressureCallback().
+*/
+struct PRISM_EXPORT MemoryPressure
+{
+    uint32_t heapIndex = 0;                         ///< The heap running low.
+    VkDeviceSize requestedBytes = 0;                ///< The driver allocation that ran into the budget, 0 if found by Renderer::updateMemoryBudget().
+    MemoryHeapBudget heap;                          ///< The heap's usage and budget.
+    bool allocationFailed = false;                  ///< Did the driver refuse the allocation? It's retried once the callbacks return.
+};
+
+using MemoryPressureCallback = std::function<void(const MemoryPressure&)>;
+
+/**
+ * @struct MemoryAllocation
+ * A range of device memory handed out by the MemoryAllocator.
+*/
+struct PRISM_EXPORT MemoryAllocation
+{
+    VkDeviceMemory memory = VK_NULL_HANDLE;         ///< The memory the range lives in, shared with other allocations unless dedicated.
+    VkDeviceSize offset = 0;                        ///< Offset of the range inside memory.
+    VkDeviceSize size = 0;                          ///< Size of the range.
+    void* mapped = nullptr;                         ///< Host pointer to the range, if the memory is host visible.
+    uint32_t memoryType = UINT32_MAX;               ///< The memory type index.
+    MemoryCategory category = MemoryCategory::Other;///< What the memory is used for.
+    struct MemoryBlock* block = nullptr;            ///< The block the range was carved from, nullptr for dedicated allocations.
+
+    explicit operator bool() const { return memory != VK_NULL_HANDLE; } ///< @return true if this holds an allocation.
+    bool isDedicated() const { return memory != VK_NULL_HANDLE && block == nullptr; } ///< @return true if the allocation owns its memory.
+};
+
+/**
+ * @struct MemoryStats
+ * Usage statistics of the MemoryAllocator.
+*/
+struct PRISM_EXPORT MemoryStats
+{
+    uint32_t blockCount = 0;                        ///< Number of pooled blocks.
+    uint32_t allocationCount = 0;                   ///< Number of ranges allocated from pooled blocks.
+    uint32_t dedicatedCount = 0;                    ///< Number of dedicated allocations.
+    VkDeviceSize blockBytes = 0;                    ///< Bytes allocated from the driver for pooled blocks.
+    VkDeviceSize usedBytes = 0;                     ///< Bytes of pooled blocks in use.
+    VkDeviceSize dedicatedBytes = 0;                ///< Bytes of dedicated allocations.
+
+    /// @return Total bytes allocated from the driver.
+    VkDeviceSize getTotalBytes() const { return blockBytes + dedicatedBytes; }
+};
+
+/**
+ * @struct MemoryBlock
+ * A VkDeviceMemory block sub-allocated by the MemoryAllocator.
+*/
+struct MemoryBlock
+{
+    VkDeviceMemory memory = VK_NULL_HANDLE;                 ///< The block's memory.
+    VkDeviceSize size = 0;                                  ///< The size of the block.
+    VkDeviceSize usedBytes = 0;                             ///< Bytes handed out from the block.
+    uint32_t allocationCount = 0;                           ///< Number of live ranges in the block.
+    uint8_t* mapped = nullptr;                              ///< Persistent mapping of the block, if host visible.
+    std::map<VkDeviceSize, VkDeviceSize> freeRanges;        ///< Free ranges, offset to size, coalesced.
+};
+
+/**
+ * @class MemoryAllocator
+ * Sub-allocates device memory from per memory type block pools.
+ *
+ * Buffers and images are kept in separate pools, so they never share a block and the
+ * device's bufferImageGranularity never comes into play. Resources at least half a block
+ * in size get a dedicated allocation. Host visible blocks are mapped once for their whole
+ * lifetime, since a VkDeviceMemory can't be mapped twice.
+ *
+ * All methods are thread safe.
+*/
+class PRISM_EXPORT MemoryAllocator
+{
+public:
+    static constexpr VkDeviceSize DefaultBlockSize = 64ull * 1024 * 1024;  ///< Size of pooled blocks on large heaps.
+    static constexpr double PressureThreshold = 0.9;                       ///< Fraction of a heap's budget past which new driver allocations report memory pressure.
+
+    /**
+     * @enum ResourceKind
+     * The kind of resource an allocation is for, each has its own pools.
+    */
+    enum class ResourceKind
+    {
+        Buffer,     ///< Buffers and linear images.
+        Image       ///< Optimally tiled images.
+    };
+
+private:
+    /**
+     * @struct Pool
+     * The blocks of one memory type and resource kind.
+    */
+    struct Pool
+    {
+        std::vector<std::unique_ptr<MemoryBlock>> blocks;   ///< The pool's blocks.
+        VkDeviceSize blockSize = 0;                         ///< Size new blocks are created with.
+    };
+
+    class Renderer* renderer = nullptr;                     ///< The renderer owning the device.
+    VkPhysicalDeviceMemoryProperties memoryProperties = {}; ///< The device's memory types and heaps.
+    std::vector<Pool> pools;                                ///< Pools indexed by memory type * 2 + resource kind.
+    uint32_t dedicatedCount = 0;                            ///< Number of live dedicated allocations.
+    VkDeviceSize dedicatedBytes = 0;                        ///< Bytes of live dedicated allocations.
+    std::vector<VkDeviceSize> dedicatedBytesPerType;        ///< Bytes of live dedicated allocations per memory type.
+    std::array<VkDeviceSize, (size_t)MemoryCategory::Count> categoryBytes = {}; ///< Bytes in use per category, external ones included.
+    mutable std::mutex mutex;                               ///< Guards the pools and statistics.
+
+public:
+    /**
+     * Construct a new MemoryAllocator object.
+     * @param renderer The renderer to allocate with.
+     * @param blockSize Size of pooled blocks, smaller heaps use an eighth of the heap instead.
+    */
+    MemoryAllocator(class Renderer* renderer, VkDeviceSize blockSize = DefaultBlockSize);
+
+    /// Destroy the MemoryAllocator object, freeing every block.
+    virtual ~MemoryAllocator();
+
+    MemoryAllocator(const MemoryAllocator&) = delete;
+    MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+
+    /**
+     * Allocates memory satisfying the given requirements.
+     * @param requirements The memory requirements of the resource.
+     * @param properties The memory properties required.
+     * @param kind The kind of resource the memory is for.
+     * @param category What the memory is used for.
+     * @param dedicated Force a dedicated allocation.
+     * @return The allocation. If the driver runs out of memory, the memory pressure callbacks get to free some before
+     *         retrying. Device local memory then falls back to system memory, and only if that fails too it aborts.
+    */
+    MemoryAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, ResourceKind kind,
+                              MemoryCategory category = MemoryCategory::Other, bool dedicated = false);
+
+    /**
+     * Allocates and binds memory for a buffer.
+     * @param buffer The buffer to allocate for.
+     * @param properties The memory properties required.
+     * @param category What the memory is used for.
+     * @return The allocation, mapped if the memory is host visible.
+    */
+    MemoryAllocation allocateBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties, MemoryCategory category = MemoryCategory::Other);
+
+    /**
+     * Allocates and binds memory for an optimally tiled image.
+     * @param image The image to allocate for.
+     * @param properties The memory properties required.
+     * @param category What the memory is used for.
+     * @return The allocation.
+    */
+    MemoryAllocation allocateImage(VkImage image, VkMemoryPropertyFlags properties, MemoryCategory category = MemoryCategory::Other);
+
+    /**
+     * Frees an allocation and resets it.
+     * @note The resource bound to it must have been destroyed, or at least no longer be in use by the GPU.
+     * @param allocation The allocation to free.
+    */
+    void free(MemoryAllocation& allocation);
+
+    /**
+     * Frees every empty block, including the one spare each pool otherwise keeps.
+     * Done whenever memory pressure is reported.
+    */
+    void trim();
+
+    /**
+     * Accounts memory allocated outside the allocator, like the driver's presentable swapchain images.
+     * @param category What the memory is used for.
+     * @param bytes The size of the memory.
+    */
+    void addExternalBytes(MemoryCategory category, VkDeviceSize bytes);
+
+    /**
+     * Removes memory accounted with addExternalBytes().
+     * @param category What the memory was used for.
+     * @param bytes The size of the memory.
+    */
+    void removeExternalBytes(MemoryCategory category, VkDeviceSize bytes);
+
+    /**
+     * Gets the bytes in use for a category.
+     * @param category The category.
+     * @return The bytes allocated for it, external ones included.
+    */
+    VkDeviceSize getCategoryBytes(MemoryCategory category) const;
+
+    /**
+     * Gets the bytes Prism allocated from the driver in one heap, pooled blocks and dedicated allocations.
+     * @param heapIndex The memory heap index.
+     * @return The bytes allocated from the heap.
+    */
+    VkDeviceSize getHeapBytes(uint32_t heapIndex) const;
+
+    /**
+     * Gets the usage statistics of one memory type.
+     * @param memoryType The memory type index.
+     * @return The statistics.
+    */
+    MemoryStats getStats(uint32_t memoryType) const;
+
+    /**
+     * Gets the usage statistics over all memory types.
+     * @return The statistics.
+    */
+    MemoryStats getTotalStats() const;
+
+    /**
+     * Gets the device's memory types and heaps.
+     * @return The memory properties.
+    */
+    const VkPhysicalDeviceMemoryProperties& getMemoryProperties() const { return memoryProperties; }
+
+private:
+    /**
+     * Finds a memory type satisfying the given requirements.
+     * @param typeBits The allowed memory types.
+     * @param properties The memory properties required.
+     * @return The memory type index. Aborts if there is none.
+    */
+    uint32_t findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties) const;
+
+    /**
+     * Finds another memory type to fall back to once the first choice ran out, dropping the device local requirement.
+     * @param typeBits The allowed memory types.
+     * @param properties The memory properties originally required.
+     * @param failedType The memory type that ran out.
+     * @return The memory type index, UINT32_MAX if there is none.
+    */
+    uint32_t findFallbackMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties, uint32_t failedType) const;
+
+    /**
+     * Allocates from a pool, or from the driver if the pool has no room.
+     * @param requirements The memory requirements of the resource.
+     * @param memoryType The memory type index.
+     * @param kind The kind of resource the memory is for.
+     * @param dedicated Force a dedicated allocation.
+     * @param allocation Receives the allocation.
+     * @return true if allocated; otherwise, false if the driver is out of memory.
+    */
+    bool tryAllocate(const VkMemoryRequirements& requirements, uint32_t memoryType, ResourceKind kind, bool dedicated, MemoryAllocation& allocation);
+
+    /**
+     * Reports memory pressure if a new driver allocation would take its heap past PressureThreshold of the budget.
+     * Expects the mutex not to be held, the callbacks may free memory.
+     * @param memoryType The memory type about to be allocated from.
+     * @param size The size about to be allocated.
+    */
+    void checkBudget(uint32_t memoryType, VkDeviceSize size);
+
+    /**
+     * Allocates memory straight from the driver, mapping it if host visible.
+     * @param size The size to allocate.
+     * @param memoryType The memory type index.
+     * @param mapped Receives the mapping, nullptr if not host visible.
+     * @return The memory, VK_NULL_HANDLE if the driver is out of memory.
+    */
+    VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryType, void** mapped) const;
+
+    /**
+     * Carves a range from a block. Expects the mutex to be held.
+     * @param block The block to allocate from.
+     * @param size The size of the range.
+     * @param alignment The alignment of the range.
+     * @param offset Receives the offset of the range.
+     * @return true if the block had room; otherwise, false.
+    */
+    static bool AllocateFromBlock(MemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+
+    /**
+     * Returns a range to a block, coalescing it with its free neighbours. Expects the mutex to be held.
+     * @param block The block the range came from.
+     * @param offset The offset of the range.
+     * @param size The size of the range.
+    */
+    static void FreeToBlock(MemoryBlock& block, VkDeviceSize offset, VkDeviceSize size);
+};
+
+} // namespace Prism
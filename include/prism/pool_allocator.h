@@ -0,0 +1,114 @@
+/**
+ * @file pool_allocator.h
+ * @author Kyle Pelham (bonezone2001@gmail.com)
+ * @brief Size class pool allocator backing ImGui's allocations.
+ *
+ * This file contains the PoolAllocator class, which serves small allocations from free lists
+ * of fixed size blocks. Prism installs one for ImGui, so its vectors and draw lists growing
+ * and shrinking every frame recycle blocks rather than going through malloc and free.
+ *
+ * @copyright Copyright (c) 2024
+*/
+
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "prism/prism_export.hpp"
+
+namespace Prism {
+
+/**
+ * @class PoolAllocator
+ * Free lists of power of two size classes, carved from large chunks.
+ *
+ * Freed blocks go back to their size class and are never returned to the system before the
+ * allocator is destroyed. Allocations above the largest class go straight to malloc.
+ *
+ * @note Thread-safe. Everything allocated must be freed before the allocator is destroyed.
+*/
+class PRISM_EXPORT PoolAllocator
+{
+public:
+    static constexpr size_t MinBlockSize = 16;              ///< Size of the smallest class in bytes.
+    static constexpr size_t ClassCount = 9;                 ///< Number of size classes, 16 to 4096 bytes.
+    static constexpr size_t ChunkSize = 64 * 1024;          ///< Size of the chunks blocks are carved from.
+
+private:
+    /**
+     * @struct FreeBlock
+     * A free block, linking to the next one of its class.
+    */
+    struct FreeBlock
+    {
+        FreeBlock* next;                                    ///< The next free block of the same class.
+    };
+
+    /**
+     * @struct Header
+     * Precedes every allocation, keeping the payload aligned to max_align_t.
+    */
+    struct alignas(std::max_align_t) Header
+    {
+        uint32_t sizeClass;                                 ///< The class of the block, ClassCount for malloc'd ones.
+    };
+
+    std::array<FreeBlock*, ClassCount> freeBlocks = {};     ///< The head of each class's free list.
+    std::vector<std::byte*> chunks;                         ///< Every chunk allocated, freed on destruction.
+    size_t bytesInUse = 0;                                  ///< Payload bytes handed out, by class size.
+    mutable std::mutex mutex;                               ///< Guards the free lists and chunks.
+
+public:
+    /// Construct a new PoolAllocator object.
+    PoolAllocator() = default;
+
+    /// Destroy the PoolAllocator object, freeing its chunks.
+    virtual ~PoolAllocator();
+
+    PoolAllocator(const PoolAllocator&) = delete;
+    PoolAllocator& operator=(const PoolAllocator&) = delete;
+
+    /**
+     * Allocates memory aligned to max_align_t.
+     * @param size The size in bytes.
+     * @return The memory.
+    */
+    void* allocate(size_t size);
+
+    /**
+     * Frees memory from allocate().
+     * @param ptr The memory, may be nullptr.
+    */
+    void free(void* ptr);
+
+    /**
+     * ImGuiMemAllocFunc forwarding to a PoolAllocator.
+     * @param size The size in bytes.
+     * @param userData The PoolAllocator.
+     * @return The memory.
+    */
+    static void* ImGuiAlloc(size_t size, void* userData);
+
+    /**
+     * ImGuiMemFreeFunc forwarding to a PoolAllocator.
+     * @param ptr The memory, may be nullptr.
+     * @param userData The PoolAllocator.
+    */
+    static void ImGuiFree(void* ptr, void* userData);
+
+    // Getters
+    // -------------------------------------------------------------------------
+    size_t getBytesInUse() const;                           ///< @return Bytes handed out by the size classes, rounded up to the class size.
+    size_t getBytesReserved() const;                        ///< @return Bytes reserved in chunks.
+
+private:
+    /**
+     * Carves a new chunk into free blocks of a class.
+     * @param sizeClass The class to refill.
+    */
+    void refill(uint32_t sizeClass);
+};
+
+} // namespace Prism
@@ -8,25 +8,62 @@
 
 #pragma once
 #include <string>
+#include <typeindex>
+#include <unordered_map>
 #include <fmt/core.h>
 #include "prism/prism_export.hpp"
+#include "prism/pool_allocator.h"
 #include "prism/renderer.h"
+#include "prism/task_queue.h"
 #include "prism/window.h"
 
 namespace Prism {
 
+/**
+ * @enum RunMode
+ * Defines how the application main loop schedules frames.
+*/
+enum class RunMode
+{
+    Continuous,     ///< Poll events and render every window as fast as possible (vsync permitting).
+    Reactive        ///< Block until input arrives or a window requests a redraw, capped by the max idle FPS.
+};
+
+/**
+ * @enum ContextMode
+ * Defines how windows get their ImGui context.
+*/
+enum class ContextMode
+{
+    PerWindow,      ///< Every window owns an ImGui context, backends and style, fully isolated from the others.
+    Shared          ///< The first window owns one multi-viewport ImGui context, later windows become viewports of it. Needs ImGui's docking branch.
+};
+
 class PRISM_EXPORT Application
 {
 protected:
     bool running = true;                                ///< Is the application running?
+    RunMode runMode = RunMode::Continuous;              ///< How the main loop schedules frames.
+    ContextMode contextMode = ContextMode::PerWindow;   ///< How windows added from now on get their ImGui context.
+    float maxIdleFps = 10.f;                            ///< The rate idle windows are redrawn at in reactive mode. 0 disables idle redraws.
     std::string name;                                   ///< The name of the application.
+    RendererSettings rendererSettings;                  ///< The settings init() creates the renderer with.
     static Application* instance;                       ///< The global instance of the application.
+    std::unique_ptr<PoolAllocator> imguiAllocator;      ///< Backs every ImGui allocation, outlives the contexts and the font atlas.
     std::vector<std::shared_ptr<Window>> appWindows;    ///< The windows in the application.
     std::shared_ptr<Renderer> renderer;                 ///< The Vulkan renderer for the application.
+    std::unordered_map<std::type_index, std::vector<std::shared_ptr<Window>>> windowPool;  ///< Hidden windows ready for reuse, by window type.
+    std::unordered_map<Window*, std::type_index> pooledWindowTypes;                         ///< Open windows returning to the pool on close, with their type.
+    size_t windowPoolSize = 4;                          ///< Closed windows kept per window type.
+    TaskQueue taskQueue;                                ///< Work posted from other threads, drained every main loop iteration.
 
 public:
-    /// Construct a new Application object
-    Application(std::string name = "Prism App");
+    /**
+     * Construct a new Application object
+     * @param name The name of the application.
+     * @param rendererSettings The settings to create the renderer with, e.g. which GPU to prefer.
+    */
+    Application(std::string name = "Prism App", RendererSettings rendererSettings = {});
 
     /// Destroy the Application object
     virtual ~Application();
@@ -49,12 +86,70 @@ public:
     */
     virtual void run();
 
+    /**
+     * Run a fixed number of main loop iterations, without waiting on events, vsync or frame rate caps.
+     * Every window renders once per iteration. Together with RendererSettings::headless this makes for
+     * deterministic benchmarks and screenshot tests, read frames back with Window::readPixels().
+     * @param frames The number of iterations to run.
+     * @param deltaTime The delta time every frame gets, 0 to measure it.
+    */
+    virtual void step(uint32_t frames, float deltaTime = 0.f);
+
     /**
      * Stop the application.
      * This will set the running flag to false, causing the application to exit on the next iteration.
     */
     virtual void stop();
 
+    /**
+     * Posts a task to run on the main thread, at the start of the next main loop iteration before any window renders.
+     * Thread safe, and wakes the main loop if it's waiting for events. Use Window::post() for work on a single window.
+     * @param func The task.
+    */
+    void post(std::function<void()> func);
+
+    /**
+     * Posts a task for the next main loop iteration, replacing a task under the same key that hasn't run yet.
+     * Thread safe, like post().
+     * @param key The coalescing key, e.g. the address of the state the task updates.
+     * @param func The task.
+    */
+    void postFrame(uint64_t key, std::function<void()> func);
+
+    /**
+     * Set how the main loop schedules frames.
+     * 
+     * In reactive mode the loop blocks in glfwWaitEventsTimeout() until input arrives,
+     * a window requests a redraw or the idle timeout elapses. Windows that have nothing
+     * new to show are not rendered at all.
+     * 
+     * @param mode The run mode to use.
+    */
+    void setRunMode(RunMode mode) { runMode = mode; }
+
+    /**
+     * Set how windows added from now on get their ImGui context.
+     *
+     * In shared mode the first window added creates the one ImGui context, with the multi-viewport
+     * backends, the style and the font atlas set up once. Every window added after it maps to a viewport
+     * of that context: no GLFW window, swapchain or backend of its own, ImGui creates its platform window
+     * and draws it along with the host's frame. That makes dozens of small tool windows cheap, at the cost
+     * of isolation: all windows share one set of ImGui state and render together with the host.
+     *
+     * Falls back to per-window contexts if ImGui was built without viewports (IMGUI_HAS_VIEWPORT) or the
+     * application is headless. Set it before adding the first window.
+     *
+     * @param mode The context mode to use.
+    */
+    void setContextMode(ContextMode mode);
+
+    /**
+     * Set the rate idle windows are redrawn at in reactive mode.
+     * This keeps timers and data refreshes visible without any input.
+     * @param fps The idle redraw rate in frames per second. 0 disables idle redraws entirely.
+    */
+    void setMaxIdleFps(float fps) { maxIdleFps = fps; }
+
     /**
      * Add a window to the application's window stack.
      * 
@@ -73,18 +168,140 @@ public:
         return window;
     }
 
+    /**
+     * Add a window whose setup runs on a worker thread rather than blocking the main loop.
+     *
+     * The native window and surface are created right away, the swapchain and frame resources on a
+     * worker. The ImGui context and backends follow on the main thread once the worker is done, then
+     * the window shows with its first frame. Meanwhile the other windows keep rendering.
+     *
+     * Note: The constructor of T runs before any of that, so it mustn't touch the window's ImGui context.
+     * Until isInitialized(), the window doesn't render.
+     *
+     * @tparam T The type of window to add.
+     * @param args The arguments to pass to the window's constructor.
+     * @return The window, still initializing.
+    */
+    template<typename T, typename... Args>
+    std::shared_ptr<T> addWindowAsync(Args&&... args)
+    {
+        static_assert(std::is_base_of<Prism::Window, T>::value, "Added type is not subclass of a Prism::Window!");
+        Window::InitNextWindowAsync();
+        auto window = std::make_shared<T>(std::forward<Args>(args)...);
+        appWindows.emplace_back(window);
+        return window;
+    }
+
+    /**
+     * Add a window, reusing a hidden one from the window pool if possible.
+     *
+     * Creating a window builds a native window, swapchain and ImGui context, which can take 100+ ms.
+     * Pooled windows skip all of that: once closed they are hidden and kept, and the next call for
+     * the same type re-skins one with the new settings (see Window::reuse()) and calls its onReuse().
+     * Use this for windows opened and closed often, like inspectors and popups.
+     *
+     * Note: A handle kept past closing can refer to the window's next use, don't hold on to them.
+     *
+     * @tparam T The type of window to add, constructible from its WindowSettings.
+     * @param settings The settings for the window.
+    */
+    template<typename T>
+    std::shared_ptr<T> addPooledWindow(WindowSettings settings = {})
+    {
+        static_assert(std::is_base_of<Prism::Window, T>::value, "Added type is not subclass of a Prism::Window!");
+        std::shared_ptr<T> window;
+        auto& pool = windowPool[typeid(T)];
+        for (size_t i = 0; i < pool.size(); i++) {
+            if (pool[i]->canReuse(settings)) {
+                window = std::static_pointer_cast<T>(pool[i]);
+                pool.erase(pool.begin() + (int64_t)i);
+                window->reuse(settings);
+                break;
+            }
+        }
+        if (!window)
+            window = std::make_shared<T>(std::move(settings));
+
+        // The main window closing ends the application, it never returns to the pool
+        if (!appWindows.empty())
+            pooledWindowTypes.emplace(window.get(), typeid(T));
+        appWindows.emplace_back(window);
+        return window;
+    }
+
+    /**
+     * Create hidden windows ahead of time, so the next addPooledWindow() calls for the type show instantly.
+     * Best called during startup, each one costs as much as creating a window.
+     * @tparam T The type of window to create, constructible from its WindowSettings.
+     * @param count The number of windows to create.
+     * @param settings The settings to create them with, showOnCreate is forced off. Structural settings (see Window::canReuse()) should match later use.
+    */
+    template<typename T>
+    void prewarmWindows(size_t count, WindowSettings settings = {})
+    {
+        static_assert(std::is_base_of<Prism::Window, T>::value, "Added type is not subclass of a Prism::Window!");
+        settings.showOnCreate = false;
+        auto& pool = windowPool[typeid(T)];
+        for (size_t i = 0; i < count; i++)
+            pool.emplace_back(std::make_shared<T>(settings));
+    }
+
+    /**
+     * Set how many closed windows the pool keeps per window type.
+     * Windows closing past that are destroyed as usual.
+     * @param size The number of windows kept per type.
+    */
+    void setWindowPoolSize(size_t size) { windowPoolSize = size; }
+
+    /**
+     * Destroy every hidden window in the pool.
+    */
+    void clearWindowPool();
+
     // Getters
     // -------------------------------------------------------------------------
     bool isRunning() const { return running; }                                      ///< @return bool Is the application running?
+    RunMode getRunMode() const { return runMode; }                                  ///< @return RunMode How the main loop schedules frames.
+    ContextMode getContextMode() const { return contextMode; }                      ///< @return ContextMode How windows added from now on get their ImGui context.
+    float getMaxIdleFps() const { return maxIdleFps; }                              ///< @return float The idle redraw rate in reactive mode.
     std::string getName() const { return name; }                                    ///< @return std::string The name of the application.
     std::shared_ptr<Renderer> getRenderer() const { return renderer; }              ///< @return std::shared_ptr<Renderer> The renderer for the application.
+    bool isHeadless() const { return rendererSettings.headless; }                   ///< @return bool Does the application render without a display?
     std::vector<std::shared_ptr<Window>> getWindows() const { return appWindows; }  ///< @return std::vector<std::shared_ptr<Window>> The windows in the application.
+    PoolAllocator& getImGuiAllocator() const { return *imguiAllocator; }            ///< @return PoolAllocator& The allocator backing every ImGui context.
+    size_t getWindowPoolSize() const { return windowPoolSize; }                     ///< @return size_t Closed windows kept per window type.
 
 private:
     /**
      * Remove windows that have been closed.
     */
     void cullClosedWindowsExitOnMainDeath();
+
+    /**
+     * Return a closing window to the pool, if it came from addPooledWindow() and the pool has room.
+     * @param window The closing window.
+    */
+    void recycleWindow(const std::shared_ptr<Window>& window);
+
+    /**
+     * Poll or wait for events depending on the run mode.
+     * Blocks until an event arrives or the earliest window can render again. In reactive
+     * mode that is a window with a pending redraw or the earliest idle redraw.
+    */
+    void pollEvents();
+
+    /**
+     * Waits for events with a precise timeout.
+     * @param timeout The timeout in seconds. 0 or less only polls, DBL_MAX waits indefinitely.
+    */
+    void waitEvents(double timeout);
+
+    /**
+     * Checks if a window should be rendered this iteration.
+     * @param window The window to check.
+     * @return true if the window should render; otherwise, false.
+    */
+    bool shouldRenderWindow(const Window& window) const;
 };
 
 } // namespace Prism
\ No newline at end of file
@@ -0,0 +1,149 @@
+/**
+ * @file render_target.h
+ * @author Kyle Pelham (bonezone2001@gmail.com)
+ * @brief Offscreen render targets usable with ImGui::Image.
+ *
+ * This file contains the RenderTarget class, which owns a color image (and optionally a depth
+ * image) that custom Vulkan rendering draws into on the GPU, and that ImGui then samples in the
+ * same frame. Nothing is read back to the CPU.
+ *
+ * @copyright Copyright (c) 2024
+*/
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vulkan/vulkan.h>
+#include "prism/prism_export.hpp"
+#include "prism/memory_allocator.h"
+
+#include "imgui.h"
+
+namespace Prism {
+
+/**
+ * @struct RenderTargetSettings
+ * Defines the attachments of a render target.
+*/
+struct PRISM_EXPORT RenderTargetSettings
+{
+    VkFormat colorFormat = VK_FORMAT_R8G8B8A8_UNORM;        ///< Format of the color image.
+    VkFormat depthFormat = VK_FORMAT_UNDEFINED;             ///< Format of the depth image, VK_FORMAT_UNDEFINED for none.
+    VkFilter filter = VK_FILTER_LINEAR;                     ///< Filter used when ImGui samples the color image.
+};
+
+/**
+ * @class RenderTarget
+ * An offscreen color (and depth) target, drawn into from a record callback and shown with ImGui::Image.
+ *
+ * Record into it from Window::onRecord() or a callback added with Window::addRecordCallback(),
+ * between begin() and end(). Its render pass transitions the color image to
+ * VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL and makes the writes visible to the fragment shader,
+ * so the ImGui pass recorded afterwards can sample it without further barriers.
+ *
+ * @note Resizing and destroying are deferred until frames using the old images have completed,
+ *       see DeletionQueue. The device never has to go idle.
+*/
+class PRISM_EXPORT RenderTarget
+{
+private:
+    std::shared_ptr<class Renderer> renderer;               ///< The renderer owning the device.
+    uint32_t width = 0;                                     ///< The width of the target in pixels.
+    uint32_t height = 0;                                    ///< The height of the target in pixels.
+    RenderTargetSettings settings;                          ///< The settings the target was created with.
+
+    VkRenderPass renderPass = VK_NULL_HANDLE;               ///< Render pass clearing and storing the attachments.
+    VkSampler sampler = VK_NULL_HANDLE;                     ///< The sampler ImGui samples the color image with.
+    VkImage colorImage = VK_NULL_HANDLE;                    ///< The color image.
+    MemoryAllocation colorAllocation;                       ///< The memory backing the color image.
+    VkImageView colorView = VK_NULL_HANDLE;                 ///< The view of the color image.
+    VkImage depthImage = VK_NULL_HANDLE;                    ///< The depth image, if any.
+    MemoryAllocation depthAllocation;                       ///< The memory backing the depth image.
+    VkImageView depthView = VK_NULL_HANDLE;                 ///< The view of the depth image.
+    VkFramebuffer framebuffer = VK_NULL_HANDLE;             ///< Framebuffer over the attachments.
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;         ///< The descriptor set used as the ImGui texture id.
+
+public:
+    /**
+     * Construct a new RenderTarget object.
+     * @param width The width of the target in pixels.
+     * @param height The height of the target in pixels.
+     * @param settings The settings to create the target with.
+    */
+    RenderTarget(uint32_t width, uint32_t height, RenderTargetSettings settings = {});
+
+    /// Destroy the RenderTarget object
+    virtual ~RenderTarget();
+
+    RenderTarget(const RenderTarget&) = delete;
+    RenderTarget& operator=(const RenderTarget&) = delete;
+
+    /**
+     * Resizes the target, recreating its images.
+     * The old images stay alive until frames using them complete. The contents are undefined until drawn again,
+     * and getId() changes, so fetch it again after resizing.
+     * @param newWidth The new width in pixels.
+     * @param newHeight The new height in pixels.
+    */
+    void resize(uint32_t newWidth, uint32_t newHeight);
+
+    /**
+     * Begins the target's render pass, clearing it and setting the viewport and scissor to the whole target.
+     * @param commandBuffer The command buffer to record into, outside any render pass.
+     * @param clearColor The color to clear to.
+     * @param clearDepth The depth to clear to.
+    */
+    void begin(VkCommandBuffer commandBuffer, const ImVec4& clearColor = ImVec4(0.f, 0.f, 0.f, 0.f), float clearDepth = 1.f) const;
+
+    /**
+     * Ends the target's render pass, leaving the color image ready to be sampled.
+     * @param commandBuffer The command buffer begin() was recorded into.
+    */
+    void end(VkCommandBuffer commandBuffer) const;
+
+    // Getters
+    // -------------------------------------------------------------------------
+    ImTextureID getId() const { return (ImTextureID)descriptorSet; }            ///< @return The id to pass to ImGui::Image.
+    uint32_t getWidth() const { return width; }                                 ///< @return The width of the target in pixels.
+    uint32_t getHeight() const { return height; }                               ///< @return The height of the target in pixels.
+    ImVec2 getSize() const { return ImVec2((float)width, (float)height); }      ///< @return The size of the target in pixels.
+    VkExtent2D getExtent() const { return { width, height }; }                  ///< @return The size of the target as a Vulkan extent.
+    const RenderTargetSettings& getSettings() const { return settings; }        ///< @return The settings the target was created with.
+    bool hasDepth() const { return settings.depthFormat != VK_FORMAT_UNDEFINED; } ///< @return true if the target has a depth image.
+    VkRenderPass getRenderPass() const { return renderPass; }                   ///< @return The render pass, for creating compatible pipelines.
+    VkFramebuffer getFramebuffer() const { return framebuffer; }                ///< @return The framebuffer over the attachments.
+    VkImage getColorImage() const { return colorImage; }                        ///< @return The color image.
+    VkImageView getColorView() const { return colorView; }                      ///< @return The view of the color image.
+    VkImage getDepthImage() const { return depthImage; }                        ///< @return The depth image, VK_NULL_HANDLE if there is none.
+    VkImageView getDepthView() const { return depthView; }                      ///< @return The view of the depth image, VK_NULL_HANDLE if there is none.
+
+private:
+    /**
+     * Creates the render pass for the target's formats.
+    */
+    void createRenderPass();
+
+    /**
+     * Creates the images, views, framebuffer and descriptor set at the current size.
+    */
+    void createAttachments();
+
+    /**
+     * Hands the images, views, framebuffer and descriptor set to the deletion queue.
+    */
+    void destroyAttachments();
+
+    /**
+     * Creates an image with its memory and view.
+     * @param format The format of the image.
+     * @param usage The usage of the image.
+     * @param aspect The aspect the view covers.
+     * @param image Receives the image.
+     * @param allocation Receives the memory backing the image.
+     * @param view Receives the view.
+    */
+    void createImage(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect,
+                     VkImage& image, MemoryAllocation& allocation, VkImageView& view);
+};
+
+} // namespace Prism
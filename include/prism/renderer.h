@@ -11,15 +11,34 @@
 */
 
 #pragma once
+#include <chrono>
 #include <functional>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 #include <fmt/core.h>
 #include "prism/prism_export.hpp"
+#include "prism/memory_allocator.h"
 #include <vulkan/vulkan.h>
 
 #include "imgui.h"
 
 namespace Prism {
 
+/**
+ * @struct RendererSettings
+ * Settings used when creating the renderer.
+*/
+struct RendererSettings
+{
+    bool diskCache = true;                      ///< Should caches (pipeline cache etc.) be persisted to disk?
+    std::filesystem::path cacheDirectory;       ///< Where on-disk caches are stored. Empty uses "<temp>/prism".
+    bool headless = false;                      ///< Render without a display: no surfaces, windows draw into offscreen images. See Application::step().
+    std::string preferredGpu;                   ///< GPU to use, by index or part of its name. Empty picks the best. The PRISM_GPU environment variable overrides it.
+};
+
 /**
  * The Vulkan renderer class for Prism.
  * 
@@ -32,30 +51,64 @@ class PRISM_EXPORT Renderer
 private:
     VkInstance instance = VK_NULL_HANDLE;                   ///< The Vulkan instance.
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;       ///< The Vulkan physical device. This is the GPU.
+    VkPhysicalDeviceProperties physicalDeviceProperties = {};///< The properties of the physical device, limits included.
     VkAllocationCallbacks* allocator = nullptr;             ///< The Vulkan allocator.
     VkDebugReportCallbackEXT debugReport = VK_NULL_HANDLE;  ///< The Vulkan debug report.
-    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;       ///< The Vulkan descriptor pool.
+    VkDescriptorSetLayout textureSetLayout = VK_NULL_HANDLE;///< Layout for ImGui texture descriptor sets (one combined image sampler).
+    VkCommandPool immediatePool = VK_NULL_HANDLE;           ///< Command pool for one-off submissions such as uploads.
     VkPipelineCache pipelineCache = VK_NULL_HANDLE;         ///< The Vulkan pipeline cache.
     uint32_t queueFamilyIndex = UINT32_MAX;                 ///< The Vulkan queue family index.
+    uint32_t presentQueueFamilyIndex = UINT32_MAX;          ///< The queue family presenting to windows, usually the same as queueFamilyIndex.
+    uint32_t transferQueueFamilyIndex = UINT32_MAX;         ///< The transfer-only queue family index, UINT32_MAX if there is none.
     VkDevice device = VK_NULL_HANDLE;                       ///< The Vulkan device.
     VkQueue queue = VK_NULL_HANDLE;                         ///< The Vulkan queue.
+    VkQueue presentQueue = VK_NULL_HANDLE;                  ///< The queue presenting to windows, the same as queue unless the graphics family can't present.
+    VkQueue transferQueue = VK_NULL_HANDLE;                 ///< The transfer-only queue, VK_NULL_HANDLE if there is none.
+    RendererSettings settings;                              ///< The settings the renderer was created with.
+    std::weak_ptr<class FontAtlas> fontAtlas;               ///< The font atlas shared by all windows, alive while any window uses it.
+    std::mutex queueMutex;                                  ///< Guards the queue, windows may submit and present from their own threads.
+    std::mutex transferQueueMutex;                          ///< Guards the transfer queue.
+    std::unique_ptr<class MemoryAllocator> memoryAllocator; ///< Sub-allocates device memory for buffers and images.
+    std::unique_ptr<class UploadQueue> uploadQueue;         ///< Streams texture data to the GPU through a staging ring.
+    std::unique_ptr<class DeletionQueue> deletionQueue;     ///< Destroys resources once the frames using them completed.
+    std::unique_ptr<class DescriptorAllocator> textureDescriptors; ///< Grows pools of texture descriptor sets as textures are created.
+    std::unique_ptr<class TextureTable> textureTable;       ///< Every texture in one descriptor array, nullptr without descriptor indexing.
+    uint32_t apiVersion = VK_API_VERSION_1_0;               ///< The Vulkan version the instance was created for.
+    bool descriptorIndexing = false;                        ///< Is descriptor indexing enabled on the device?
+    bool memoryBudget = false;                              ///< Is VK_EXT_memory_budget enabled on the device?
+    std::mutex pressureMutex;                               ///< Guards the memory pressure callbacks.
+    std::vector<std::pair<uint32_t, MemoryPressureCallback>> pressureCallbacks; ///< Callbacks freeing memory under pressure, with their ids.
+    uint32_t nextPressureCallbackId = 1;                    ///< The id the next pressure callback gets.
+    std::vector<std::chrono::steady_clock::time_point> lastPressureTimes; ///< When pressure was last reported per heap, guarded by pressureMutex.
+    std::chrono::steady_clock::time_point lastBudgetCheck;  ///< When updateMemoryBudget() last queried the budget.
+    std::mutex frameSerialMutex;                            ///< Guards the frame serials.
+    uint64_t latestFrameSerial = 0;                         ///< The newest frame serial handed out.
+    std::vector<uint64_t> pendingFrameSerials;              ///< Frame serials handed out that haven't completed yet.
 
 public:
-    /// Construct a new Renderer object
-    Renderer();
+    /**
+     * Construct a new Renderer object
+     * @param settings The settings to create the renderer with.
+    */
+    Renderer(RendererSettings settings = {});
 
     /// Destroy the Renderer object
     virtual ~Renderer();
 
     /**
-     * Hook the renderer into a window and initialize ImGui.
-     * This allows the renderer to draw to the specified window.
-     * @param window The window to hook into.
+     * Checks the device can present to a window's surface and selects the format to draw to it with.
      * @param surface The Vulkan surface to render to.
-     * @param width The width of the window.
-     * @param height The height of the window.
+     * @return The first supported of the common 8 bit UNORM formats, in the sRGB nonlinear color space.
     */
-    void setupWindow(class Window* window, VkSurfaceKHR surface, int width, int height);
+    VkSurfaceFormatKHR selectSurfaceFormat(VkSurfaceKHR surface) const;
+
+    /**
+     * Selects the present mode to use for a surface.
+     * @param surface The surface to present to.
+     * @param requested The preferred present mode.
+     * @return The requested mode if the surface supports it; otherwise, FIFO.
+    */
+    VkPresentModeKHR selectPresentMode(VkSurfaceKHR surface, VkPresentModeKHR requested) const;
 
     /**
      * Validates a Vulkan result and handles errors.
@@ -68,6 +121,170 @@ public:
     */
     static void CheckVkResult(VkResult result);
 
+    /**
+     * Submits work to the queue.
+     * Thread safe, submissions from window render threads are serialized here.
+     * @param submitInfo The submission to make.
+     * @param fence The fence to signal once the work completes. May be VK_NULL_HANDLE.
+     * @return The result of vkQueueSubmit.
+    */
+    VkResult submit(const VkSubmitInfo& submitInfo, VkFence fence);
+
+    /**
+     * Presents swapchain images on the present queue.
+     * Thread safe, presents from window render threads are serialized here.
+     * @param presentInfo The present to make.
+     * @return The result of vkQueuePresentKHR.
+    */
+    VkResult present(const VkPresentInfoKHR& presentInfo);
+
+    /**
+     * Submits work to the transfer queue.
+     * Falls back to the graphics queue if the device has no transfer-only queue family.
+     * @param submitInfo The submission to make.
+     * @param fence The fence to signal once the work completes. May be VK_NULL_HANDLE.
+     * @return The result of vkQueueSubmit.
+    */
+    VkResult submitTransfer(const VkSubmitInfo& submitInfo, VkFence fence);
+
+    /**
+     * Waits for the device to become idle.
+     * Thread safe, vkDeviceWaitIdle requires every queue to be externally synchronized.
+    */
+    void waitIdle();
+
+    /**
+     * Locks the queue for direct use.
+     * Hold this around third party calls that use the queue or wait on the device, like the ImGui backend.
+     * @return The lock, the queue is released once it goes out of scope.
+    */
+    std::unique_lock<std::mutex> lockQueue() { return std::unique_lock<std::mutex>(queueMutex); }
+
+    /**
+     * Allocates a descriptor set usable as an ImTextureID.
+     * Sets come from a chain of pools growing with the number of textures, so there is no fixed limit.
+     * The texture is also added to the texture table, if there is one.
+     * Thread safe.
+     * @param sampler The sampler to sample the image with.
+     * @param imageView The image view, expected in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL when drawn.
+     * @return The descriptor set.
+    */
+    VkDescriptorSet allocateTextureDescriptor(VkSampler sampler, VkImageView imageView);
+
+    /**
+     * Frees a descriptor set allocated with allocateTextureDescriptor().
+     * Thread safe.
+     * @param descriptorSet The descriptor set to free.
+    */
+    void freeTextureDescriptor(VkDescriptorSet descriptorSet);
+
+    /**
+     * Starts tracking a frame.
+     * Windows call this before building a frame and pass the serial to completeFrameSerial()
+     * once its fence signaled, or right away if the frame is never submitted.
+     * Thread safe.
+     * @return The frame's serial, increasing with every frame of any window.
+    */
+    uint64_t beginFrameSerial();
+
+    /**
+     * Marks a frame started with beginFrameSerial() as completed on the GPU.
+     * Thread safe.
+     * @param serial The frame's serial.
+    */
+    void completeFrameSerial(uint64_t serial);
+
+    /**
+     * Gets the serial up to which every frame has completed.
+     * Frames complete out of order across windows, so this is one below the oldest frame still pending.
+     * Thread safe.
+     * @return The completed frame serial.
+    */
+    uint64_t getCompletedFrameSerial();
+
+    /**
+     * Gets the newest frame serial handed out.
+     * Thread safe.
+     * @return The latest frame serial.
+    */
+    uint64_t getLatestFrameSerial();
+
+    /**
+     * Records and submits a one-off command buffer, waiting for it to complete.
+     * Only meant for rare work like uploads, it stalls the calling thread.
+     * @param record Function recording the commands into the command buffer.
+    */
+    void submitImmediate(const std::function<void(VkCommandBuffer)>& record);
+
+    /**
+     * Finds a memory type satisfying the given requirements.
+     * Prefer getMemoryAllocator() for allocating, this is only for memory that must be allocated directly.
+     * @param typeBits The allowed memory types, from VkMemoryRequirements::memoryTypeBits.
+     * @param properties The memory properties required.
+     * @return The memory type index. Aborts if there is none.
+    */
+    uint32_t findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties) const;
+
+    /**
+     * Gets the usage and budget of a memory heap.
+     * With VK_EXT_memory_budget these are the driver's figures for the whole process. Without it usage is
+     * what Prism allocated from the heap and the budget is 80% of the heap.
+     * Thread safe.
+     * @param heapIndex The memory heap index.
+     * @return The heap's usage and budget, all zero for an invalid heap.
+    */
+    MemoryHeapBudget getMemoryBudget(uint32_t heapIndex) const;
+
+    /**
+     * Gets the usage and budget of every memory heap, see getMemoryBudget().
+     * @return The budgets indexed by heap.
+    */
+    std::vector<MemoryHeapBudget> getMemoryBudgets() const;
+
+    /**
+     * Adds a callback run when memory runs low, to evict caches or downscale resources.
+     * Runs when a driver allocation would take a heap past MemoryAllocator::PressureThreshold of its budget,
+     * when one fails, and when updateMemoryBudget() finds a heap over that threshold.
+     * Callbacks run on the allocating thread and may free memory, allocations they make don't report pressure again.
+     * Thread safe.
+     * @param callback The callback.
+     * @return The id to pass to removeMemoryPressureCallback().
+    */
+    uint32_t addMemoryPressureCallback(MemoryPressureCallback callback);
+
+    /**
+     * Removes a callback added with addMemoryPressureCallback().
+     * Thread safe, also from within a pressure callback. A call already running on another thread may still finish after this returns.
+     * @param id The callback's id.
+    */
+    void removeMemoryPressureCallback(uint32_t id);
+
+    /**
+     * Reports memory pressure: trims the allocator's empty blocks, then runs the pressure callbacks.
+     * Reported at most once a second per heap, unless an allocation failed.
+     * @param pressure The heap running low.
+    */
+    void notifyMemoryPressure(const MemoryPressure& pressure);
+
+    /**
+     * Checks the heap budgets about once a second, reporting pressure on heaps past MemoryAllocator::PressureThreshold.
+     * Catches other processes eating the budget. Only does anything with VK_EXT_memory_budget, called by Application every frame.
+    */
+    void updateMemoryBudget();
+
+    /**
+     * Gets the font atlas shared by all windows.
+     * The atlas is created on first use and destroyed once no window references it anymore.
+     * @return The shared font atlas.
+    */
+    std::shared_ptr<class FontAtlas> getFontAtlas();
+
+    /**
+     * Gets the directory on-disk caches are stored in.
+     * @return The cache directory, or an empty path if disk caching is disabled.
+    */
+    std::filesystem::path getCacheDirectory() const;
+
     // Getters & Setters
     // -------------------------------------------------------------------------
     inline VkInstance getInstance() const { return instance; }                      ///< @return Vulkan instance.
@@ -76,8 +293,22 @@ public:
     inline VkDevice getDevice() const { return device; }                            ///< @return Logical Vulkan device.
     inline VkQueue getQueue() const { return queue; }                               ///< @return Vulkan queue.
     inline uint32_t getQueueFamilyIndex() const { return queueFamilyIndex; }        ///< @return Index of the queue family.
-    inline VkDescriptorPool getDescriptorPool() const { return descriptorPool; }    ///< @return Vulkan descriptor pool.
+    inline uint32_t getPresentQueueFamilyIndex() const { return presentQueueFamilyIndex; } ///< @return Index of the queue family presenting to windows.
+    inline bool hasSeparatePresentQueue() const { return presentQueueFamilyIndex != queueFamilyIndex; } ///< @return true if presenting runs on another queue family than rendering.
+    inline const VkPhysicalDeviceProperties& getPhysicalDeviceProperties() const { return physicalDeviceProperties; } ///< @return Properties of the physical device.
+    inline const VkPhysicalDeviceLimits& getLimits() const { return physicalDeviceProperties.limits; } ///< @return Limits of the physical device.
+    inline uint32_t getTransferQueueFamilyIndex() const { return hasTransferQueue() ? transferQueueFamilyIndex : queueFamilyIndex; } ///< @return Index of the queue family uploads run on.
+    inline bool hasTransferQueue() const { return transferQueue != VK_NULL_HANDLE; } ///< @return true if uploads run on a dedicated transfer queue.
+    inline UploadQueue& getUploadQueue() const { return *uploadQueue; }             ///< @return The queue streaming texture data to the GPU.
+    inline MemoryAllocator& getMemoryAllocator() const { return *memoryAllocator; } ///< @return The device memory sub-allocator.
+    inline DeletionQueue& getDeletionQueue() const { return *deletionQueue; }       ///< @return The queue destroying resources once frames using them completed.
+    inline DescriptorAllocator& getTextureDescriptors() const { return *textureDescriptors; } ///< @return The allocator of texture descriptor sets.
+    inline TextureTable* getTextureTable() const { return textureTable.get(); }     ///< @return The bindless texture table, nullptr if the device lacks descriptor indexing.
+    inline uint32_t getApiVersion() const { return apiVersion; }                    ///< @return The Vulkan version the instance was created for.
+    inline bool hasMemoryBudget() const { return memoryBudget; }                    ///< @return true if heap budgets come from VK_EXT_memory_budget.
     inline VkPipelineCache getPipelineCache() const { return pipelineCache; }       ///< @return Vulkan pipeline cache.
+    inline VkDescriptorSetLayout getTextureSetLayout() const { return textureSetLayout; } ///< @return Layout for ImGui texture descriptor sets.
+    inline const RendererSettings& getSettings() const { return settings; }         ///< @return The settings the renderer was created with.
 
 
 private:
@@ -103,15 +334,27 @@ private:
      * Selects the physical device (GPU) for rendering.
      * 
      * This method chooses the most appropriate physical device (GPU) from those
-     * available on the system to be used by Vulkan.
+     * available on the system to be used by Vulkan. GPUs that can't present to windows
+     * are skipped, the preferred GPU is used if it's usable, otherwise the best scoring one.
     */
     void selectPhysicalDevice();
 
+    /**
+     * Scores a GPU for rendering windows.
+     * Discrete beats integrated beats virtual beats software, ties are broken on presenting from
+     * the graphics queue and then on device local memory.
+     * @param gpu The GPU to score.
+     * @return The score, higher is better. -1 if it lacks graphics support, or swapchains and presentation unless headless.
+    */
+    int64_t scorePhysicalDevice(VkPhysicalDevice gpu) const;
+
     /**
      * Chooses the appropriate queue family for rendering.
      * 
      * This method selects the queue family index that will be used for submitting
-     * rendering commands to the GPU.
+     * rendering commands to the GPU, preferring one that can present. If none can, a
+     * separate present family is used. A transfer-only family is picked for uploads if
+     * the device has one.
     */
     void chooseQueueFamilyIndex();
 
@@ -124,13 +367,69 @@ private:
     void createDevice();
 
     /**
-     * Creates the Vulkan descriptor pool.
+     * Creates the allocator for texture descriptor sets.
+     * 
+     * Its pools only hold combined image samplers and start small, each further
+     * pool doubling in size, so memory follows the number of textures in use.
+    */
+    void createTextureDescriptors();
+
+    /**
+     * Creates the bindless texture table, if the device has descriptor indexing enabled.
      * 
-     * This method sets up a descriptor pool, which is used to manage resources
-     * such as textures and buffers during rendering.
+     * Every texture descriptor set allocated afterwards is mirrored into it.
     */
-    void createDescriptorPool();
+    void createTextureTable();
 
+    /**
+     * Creates the descriptor set layout used for ImGui textures.
+     * 
+     * The layout matches the ImGui Vulkan backend's, so descriptor sets allocated
+     * with it can be used as ImTextureID in any window.
+    */
+    void createTextureSetLayout();
+
+    /**
+     * Creates the command pool used by submitImmediate().
+    */
+    void createImmediatePool();
+
+    /**
+     * Creates the device memory sub-allocator.
+    */
+    void createMemoryAllocator();
+
+    /**
+     * Creates the upload queue used for texture uploads.
+    */
+    void createUploadQueue();
+
+    /**
+     * Creates the deletion queue used for deferred destruction.
+    */
+    void createDeletionQueue();
+
+    /**
+     * Creates the Vulkan pipeline cache.
+     * 
+     * This method creates the pipeline cache shared by all windows, seeding it with the
+     * on-disk cache if one exists and was written by the same device and driver.
+    */
+    void createPipelineCache();
+
+    /**
+     * Writes the pipeline cache to disk.
+     * 
+     * The file is written to a temporary path first and then renamed over the old one,
+     * so concurrently running instances never read a half written cache.
+    */
+    void savePipelineCache();
+
+    /**
+     * Gets the path of the on-disk pipeline cache.
+     * @return The path of the cache file, or an empty path if disk caching is disabled.
+    */
+    std::filesystem::path getPipelineCachePath() const;
     /**
      * Callback for Vulkan debug reports.
      * 
@@ -0,0 +1,177 @@
+/**
+ * @file swapchain.h
+ * @author Kyle Pelham (bonezone2001@gmail.com)
+ * @brief The swapchain a window presents to.
+ *
+ * This file contains the Swapchain class, which owns a window's surface, its swapchain images
+ * and the framebuffers the UI is drawn into. Recreating it never idles the device: the old
+ * swapchain is handed to the new one and destroyed once the frames using it completed.
+ * Headless swapchains have no surface and cycle through offscreen images instead.
+ *
+ * @copyright Copyright (c) 2024
+*/
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "prism/prism_export.hpp"
+#include "prism/memory_allocator.h"
+
+namespace Prism {
+
+/**
+ * @struct SwapchainImage
+ * A swapchain image and the resources drawing to it.
+*/
+struct PRISM_EXPORT SwapchainImage
+{
+    VkImage image = VK_NULL_HANDLE;                        ///< The image, owned by the swapchain.
+    MemoryAllocation memory;                               ///< The image's memory, only for headless swapchains which create their own images.
+    VkDeviceSize trackedBytes = 0;                         ///< Estimated size of a presentable image, accounted as external swapchain memory.
+    VkImageView view = VK_NULL_HANDLE;                     ///< The view of the image.
+    VkFramebuffer framebuffer = VK_NULL_HANDLE;            ///< Framebuffer of the render pass over the view.
+    VkSemaphore renderCompleteSemaphore = VK_NULL_HANDLE;  ///< Signaled once rendering to the image finished, waited on by present.
+};
+
+/**
+ * @class Swapchain
+ * Owns a surface, its swapchain and a framebuffer per swapchain image.
+ *
+ * The render pass is created once for the surface format and outlives every recreation,
+ * so pipelines (like ImGui's) built against it stay valid.
+ *
+ * @note Recreating passes the old swapchain as VkSwapchainCreateInfoKHR::oldSwapchain. It's kept here with its
+ *       views, framebuffers and semaphores until the frames using it completed and the new swapchain presented
+ *       as many images as the old one had, rather than in the DeletionQueue, since it must be destroyed before
+ *       the surface. No fence covers a present, so the later presents stand in for the old ones having finished.
+*/
+class PRISM_EXPORT Swapchain
+{
+private:
+    /**
+     * @struct RetiredSwapchain
+     * A replaced swapchain waiting for the frames using it.
+    */
+    struct RetiredSwapchain
+    {
+        uint64_t serial = 0;                                ///< The latest frame serial when it was replaced.
+        uint64_t presentCount = 0;                          ///< The present count to reach before its presents are done with it, 0 if headless.
+        VkSwapchainKHR swapchain = VK_NULL_HANDLE;          ///< The replaced swapchain.
+        std::vector<SwapchainImage> images;                 ///< Its images.
+    };
+
+    std::shared_ptr<class Renderer> renderer;               ///< The renderer owning the device.
+    VkSurfaceKHR surface = VK_NULL_HANDLE;                  ///< The surface presented to, VK_NULL_HANDLE if headless.
+    VkSurfaceFormatKHR surfaceFormat = {};                  ///< The format of the swapchain images.
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;///< The present mode in use.
+    VkSwapchainKHR swapchain = VK_NULL_HANDLE;              ///< The current swapchain, VK_NULL_HANDLE until created.
+    VkRenderPass renderPass = VK_NULL_HANDLE;               ///< Render pass clearing the image and leaving it ready to present.
+    VkExtent2D extent = {};                                 ///< The size of the swapchain images.
+    std::vector<SwapchainImage> images;                     ///< The swapchain images.
+    std::vector<RetiredSwapchain> retiredSwapchains;        ///< Replaced swapchains, oldest first.
+    uint32_t nextHeadlessImage = 0;                         ///< The image a headless swapchain hands out next.
+    uint64_t presentCount = 0;                              ///< Images queued for presentation across every swapchain so far, see presented().
+
+public:
+    /**
+     * Construct a new Swapchain object, taking ownership of the surface.
+     * The swapchain itself is only created by recreate().
+     * @param surface The surface to present to.
+     * @param surfaceFormat The format to create the images with, see Renderer::selectSurfaceFormat().
+    */
+    Swapchain(VkSurfaceKHR surface, VkSurfaceFormatKHR surfaceFormat);
+
+    /**
+     * Construct a new headless Swapchain object.
+     * recreate() creates offscreen images, which are left in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL for reading back.
+     * @param surfaceFormat The format to create the images with.
+    */
+    explicit Swapchain(VkSurfaceFormatKHR surfaceFormat);
+
+    /**
+     * Destroy the Swapchain object, its surface included.
+     * @note Nothing may still use the swapchain, the window waits for its frames first.
+    */
+    virtual ~Swapchain();
+
+    Swapchain(const Swapchain&) = delete;
+    Swapchain& operator=(const Swapchain&) = delete;
+
+    /**
+     * Creates the swapchain, or replaces it with one matching the surface's current size.
+     * Frames still using the old swapchain finish normally, it's destroyed once they completed.
+     * @param width The width to use if the surface leaves it up to the swapchain, always used if headless.
+     * @param height The height to use if the surface leaves it up to the swapchain, always used if headless.
+     * @param presentMode The present mode, see Renderer::selectPresentMode(). Ignored if headless.
+     * @param minImageCount The minimum number of images, clamped to what the surface supports. Headless swapchains create exactly this many.
+     * @return true if created; otherwise, false (e.g. the surface has no area while minimized) and the old swapchain is kept.
+    */
+    bool recreate(uint32_t width, uint32_t height, VkPresentModeKHR presentMode, uint32_t minImageCount);
+
+    /**
+     * Acquires the next image to draw to, destroying retired swapchains whose frames completed.
+     * Headless swapchains hand out their images round robin and never signal the semaphore.
+     * @param semaphore The semaphore to signal once the image is ready.
+     * @param timeout The timeout in nanoseconds.
+     * @param imageIndex Receives the index of the image.
+     * @return The result of vkAcquireNextImageKHR.
+    */
+    VkResult acquireNextImage(VkSemaphore semaphore, uint64_t timeout, uint32_t& imageIndex);
+
+    /**
+     * Counts an image queued for presentation, retired swapchains are only destroyed after enough of them.
+    */
+    void presented() { presentCount++; }
+
+    // Getters
+    // -------------------------------------------------------------------------
+    VkSurfaceKHR getSurface() const { return surface; }                         ///< @return The surface presented to.
+    bool isHeadless() const { return surface == VK_NULL_HANDLE; }               ///< @return true if drawing to offscreen images rather than a surface.
+    VkSwapchainKHR getHandle() const { return swapchain; }                      ///< @return The current swapchain.
+    VkSurfaceFormatKHR getSurfaceFormat() const { return surfaceFormat; }       ///< @return The format of the swapchain images.
+    VkPresentModeKHR getPresentMode() const { return presentMode; }             ///< @return The present mode in use.
+    VkRenderPass getRenderPass() const { return renderPass; }                   ///< @return The render pass drawing to the images.
+    VkExtent2D getExtent() const { return extent; }                             ///< @return The size of the swapchain images.
+    uint32_t getImageCount() const { return (uint32_t)images.size(); }          ///< @return The number of swapchain images.
+    const SwapchainImage& getImage(uint32_t index) const { return images[index]; } ///< @return The swapchain image at the index.
+
+private:
+    /**
+     * Creates the render pass for the surface format.
+    */
+    void createRenderPass();
+
+    /**
+     * Creates the views, framebuffers and semaphores of the current swapchain's images.
+     * Headless swapchains create the images themselves.
+     * @param headlessImageCount The number of images to create if headless.
+    */
+    void createImages(uint32_t headlessImageCount);
+
+    /**
+     * Creates an offscreen image for a headless swapchain, at the current extent.
+     * @param swapchainImage Receives the image and its memory.
+    */
+    void createHeadlessImage(SwapchainImage& swapchainImage);
+
+    /**
+     * Retires the current swapchain and its images, so frames using them can finish.
+    */
+    void retireSwapchain();
+
+    /**
+     * Destroys the retired swapchains whose frames completed.
+    */
+    void collectRetiredSwapchains();
+
+    /**
+     * Destroys a swapchain with its views, framebuffers and semaphores, and headless images with their memory.
+     * @param handle The swapchain to destroy, VK_NULL_HANDLE if headless.
+     * @param swapchainImages Its images.
+    */
+    void destroySwapchain(VkSwapchainKHR handle, std::vector<SwapchainImage>& swapchainImages);
+};
+
+} // namespace Prism
@@ -0,0 +1,95 @@
+/**
+ * @file task_queue.h
+ * @author Kyle Pelham (bonezone2001@gmail.com)
+ * @brief Lock-free queue of tasks posted from other threads.
+ *
+ * This file contains the TaskQueue class, a multiple producer single consumer queue of functions.
+ * Windows and the application each own one, so network and worker threads can hand them work that
+ * then runs on the main thread, where window and ImGui state may be touched.
+ *
+ * @copyright Copyright (c) 2024
+*/
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include "prism/prism_export.hpp"
+
+namespace Prism {
+
+/**
+ * @class TaskQueue
+ * A multiple producer single consumer queue of tasks.
+ *
+ * Producers push onto a lock-free stack, the consumer takes the whole stack at once and runs it
+ * in posting order. Coalesced tasks carry a key, and of the tasks under one key taken together
+ * only the latest runs, so a stream of updates turns into one per drain however fast they come.
+ *
+ * @note Any thread may push, but only one thread may drain at a time.
+*/
+class PRISM_EXPORT TaskQueue
+{
+private:
+    /**
+     * @struct Task
+     * A posted task, a node of the stack.
+    */
+    struct Task
+    {
+        Task* next = nullptr;                               ///< The task posted before this one.
+        std::function<void()> func;                         ///< The function to run.
+        uint64_t key = 0;                                   ///< The coalescing key, only meaningful if coalesced.
+        bool coalesced = false;                             ///< Is only the latest task with this key run?
+    };
+
+    std::atomic<Task*> head = nullptr;                      ///< The task posted last, nullptr if empty.
+
+public:
+    TaskQueue() = default;
+
+    /**
+     * Destroy the TaskQueue object, dropping the tasks that never ran.
+    */
+    virtual ~TaskQueue();
+
+    TaskQueue(const TaskQueue&) = delete;
+    TaskQueue& operator=(const TaskQueue&) = delete;
+
+    /**
+     * Posts a task.
+     * @param func The function to run.
+     * @return true if the queue was empty, so the consumer may need waking; otherwise, false.
+    */
+    bool push(std::function<void()> func);
+
+    /**
+     * Posts a coalesced task, replacing any task with the same key that hasn't run yet.
+     * @param key The coalescing key, e.g. the address of the state the task updates.
+     * @param func The function to run.
+     * @return true if the queue was empty, so the consumer may need waking; otherwise, false.
+    */
+    bool push(uint64_t key, std::function<void()> func);
+
+    /**
+     * Runs every task posted so far, in posting order. Tasks posted while draining wait for the next drain.
+     * @return The number of tasks run.
+    */
+    size_t drain();
+
+    /**
+     * Checks if any task is waiting, from any thread.
+     * @return true if a task is waiting; otherwise, false.
+    */
+    bool hasPending() const { return head.load(std::memory_order_relaxed) != nullptr; }
+
+private:
+    /**
+     * Pushes a task onto the stack.
+     * @param task The task, owned by the queue from here on.
+     * @return true if the queue was empty; otherwise, false.
+    */
+    bool pushTask(Task* task);
+};
+
+} // namespace Prism
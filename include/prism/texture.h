@@ -0,0 +1,105 @@
+/**
+ * @file texture.h
+ * @author Kyle Pelham (bonezone2001@gmail.com)
+ * @brief GPU textures usable with ImGui::Image.
+ *
+ * This file contains the Texture class, which owns a sampled Vulkan image and the descriptor
+ * set ImGui uses as its texture id. Pixel data is streamed in through the renderer's upload
+ * queue, so creating even large textures doesn't stall the frame.
+ *
+ * @copyright Copyright (c) 2024
+*/
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vulkan/vulkan.h>
+#include "prism/prism_export.hpp"
+#include "prism/memory_allocator.h"
+
+#include "imgui.h"
+
+namespace Prism {
+
+/**
+ * @struct TextureSettings
+ * Defines how a texture is stored and sampled.
+*/
+struct PRISM_EXPORT TextureSettings
+{
+    VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;                             ///< Format of the pixels passed in and of the image.
+    VkFilter filter = VK_FILTER_LINEAR;                                     ///< Filter used when magnifying and minifying.
+    VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE; ///< Addressing outside of [0, 1].
+};
+
+/**
+ * @class Texture
+ * A sampled image that can be drawn with ImGui::Image in any window.
+ *
+ * The upload runs asynchronously, on the transfer queue if the device has one. Drawing before
+ * isReady() returns true shows undefined contents, so check it (or call wait()) first.
+ *
+ * @note Destroying a texture is deferred until the frames drawing it have completed, see DeletionQueue.
+*/
+class PRISM_EXPORT Texture
+{
+private:
+    std::shared_ptr<class Renderer> renderer;               ///< The renderer owning the device.
+    uint32_t width = 0;                                     ///< The width of the texture in pixels.
+    uint32_t height = 0;                                    ///< The height of the texture in pixels.
+    TextureSettings settings;                               ///< The settings the texture was created with.
+    uint64_t uploadSerial = 0;                              ///< Serial of the upload filling the image.
+
+    VkImage image = VK_NULL_HANDLE;                         ///< The image.
+    MemoryAllocation imageAllocation;                       ///< The memory backing the image.
+    VkImageView imageView = VK_NULL_HANDLE;                 ///< The view of the image.
+    VkSampler sampler = VK_NULL_HANDLE;                     ///< The sampler used for the image.
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;         ///< The descriptor set used as the ImGui texture id.
+
+public:
+    /**
+     * Construct a new Texture object and start uploading its pixels.
+     * Safe to call from any thread.
+     * @param width The width of the texture in pixels.
+     * @param height The height of the texture in pixels.
+     * @param pixels The tightly packed pixels in settings.format, copied before this returns.
+     * @param settings The settings to create the texture with.
+    */
+    Texture(uint32_t width, uint32_t height, const void* pixels, TextureSettings settings = {});
+
+    /// Destroy the Texture object
+    virtual ~Texture();
+
+    Texture(const Texture&) = delete;
+    Texture& operator=(const Texture&) = delete;
+
+    /**
+     * Checks if the pixels finished uploading.
+     * @return true if the texture can be drawn; otherwise, false.
+    */
+    bool isReady() const;
+
+    /**
+     * Blocks until the pixels finished uploading.
+    */
+    void wait() const;
+
+    /**
+     * Gets the size of a pixel in a format.
+     * @param format The format.
+     * @return The size in bytes, or 0 if the format isn't supported for textures.
+    */
+    static uint32_t GetFormatSize(VkFormat format);
+
+    // Getters
+    // -------------------------------------------------------------------------
+    ImTextureID getId() const { return (ImTextureID)descriptorSet; }            ///< @return The id to pass to ImGui::Image.
+    uint32_t getWidth() const { return width; }                                 ///< @return The width of the texture in pixels.
+    uint32_t getHeight() const { return height; }                               ///< @return The height of the texture in pixels.
+    ImVec2 getSize() const { return ImVec2((float)width, (float)height); }      ///< @return The size of the texture in pixels.
+    const TextureSettings& getSettings() const { return settings; }             ///< @return The settings the texture was created with.
+    VkImage getImage() const { return image; }                                  ///< @return The Vulkan image.
+    VkImageView getImageView() const { return imageView; }                      ///< @return The Vulkan image view.
+};
+
+} // namespace Prism
@@ -0,0 +1,110 @@
+/**
+ * @file texture_table.h
+ * @author Kyle Pelham (bonezone2001@gmail.com)
+ * @brief Bindless texture table for Prism.
+ *
+ * This file contains the TextureTable class, which mirrors every texture descriptor set into
+ * one large descriptor array. Shaders index the array per vertex, so drawing with another
+ * texture needs no descriptor set bound, letting the DrawBackend merge draws across textures.
+ *
+ * @copyright Copyright (c) 2024
+*/
+
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "prism/prism_export.hpp"
+
+namespace Prism {
+
+/**
+ * @class TextureTable
+ * A descriptor-indexed array of every texture allocated through the renderer.
+ *
+ * Renderer::allocateTextureDescriptor() adds each texture to a free slot of the array and
+ * Renderer::freeTextureDescriptor() releases it. Texture ids reach the renderer's free through
+ * the DeletionQueue, so a slot is only reused once no frame in flight can still sample it.
+ * The array is created update-after-bind and partially bound, so slots are written while
+ * frames drawing other slots are still pending.
+ *
+ * Only created if the device supports descriptor indexing, see Renderer::getTextureTable().
+ * All methods are thread safe.
+*/
+class PRISM_EXPORT TextureTable
+{
+public:
+    static constexpr uint32_t MaxCapacity = 16384;          ///< Most slots the table has, devices may limit it further.
+    static constexpr uint32_t InvalidSlot = UINT32_MAX;     ///< Returned for texture ids without a slot.
+
+private:
+    class Renderer* renderer = nullptr;                     ///< The renderer owning the device.
+    VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;       ///< Layout of the array, one update-after-bind binding.
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;       ///< Pool holding just the array.
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;         ///< The array, bound once per draw.
+    uint32_t capacity = 0;                                  ///< Number of slots in the array.
+    uint32_t nextSlot = 0;                                  ///< Slots below this were handed out at least once.
+    std::vector<uint32_t> freeSlots;                        ///< Released slots, reused first.
+    bool full = false;                                      ///< Has a texture not fit since a slot was last released? Reported once.
+    std::unordered_map<VkDescriptorSet, uint32_t> slots;    ///< The slot of every texture id.
+    mutable std::mutex mutex;                               ///< Guards the slots and writes to the array.
+
+public:
+    /**
+     * Construct a new TextureTable object, creating the array.
+     * @param renderer The renderer to create the array with. Its device must have descriptor indexing enabled.
+    */
+    TextureTable(class Renderer* renderer);
+
+    /// Destroy the TextureTable object.
+    virtual ~TextureTable();
+
+    TextureTable(const TextureTable&) = delete;
+    TextureTable& operator=(const TextureTable&) = delete;
+
+    /**
+     * Writes a texture into a free slot.
+     * @param textureId The texture's descriptor set, used as its ImTextureID.
+     * @param sampler The sampler to sample the image with.
+     * @param imageView The image view, expected in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL when drawn.
+     * @return The slot, InvalidSlot if the table is full.
+    */
+    uint32_t add(VkDescriptorSet textureId, VkSampler sampler, VkImageView imageView);
+
+    /**
+     * Releases the slot of a texture.
+     * @note No pending frame may sample the slot anymore.
+     * @param textureId The texture's descriptor set.
+    */
+    void remove(VkDescriptorSet textureId);
+
+    /**
+     * Finds the slot of a texture.
+     * @param textureId The texture's descriptor set.
+     * @return The slot, InvalidSlot if the texture wasn't allocated through the renderer or didn't fit.
+    */
+    uint32_t find(VkDescriptorSet textureId) const;
+
+    // Getters & setters
+    // -------------------------------------------------------------------------
+    VkDescriptorSetLayout getSetLayout() const { return setLayout; }       ///< @return Layout of the array, for pipeline layouts.
+    VkDescriptorSet getDescriptorSet() const { return descriptorSet; }     ///< @return The array.
+    uint32_t getCapacity() const { return capacity; }                      ///< @return Number of slots in the array.
+
+    /**
+     * Gets the number of slots in use.
+     * @return The number of textures in the table.
+    */
+    uint32_t getSize() const;
+
+private:
+    /**
+     * Picks the number of slots, the lowest of MaxCapacity and the device's update-after-bind limits.
+     * @return The capacity.
+    */
+    uint32_t queryCapacity() const;
+};
+
+} // namespace Prism
@@ -0,0 +1,174 @@
+/**
+ * @file upload_queue.h
+ * @author Kyle Pelham (bonezone2001@gmail.com)
+ * @brief Asynchronous texture uploads for Prism.
+ *
+ * This file contains the UploadQueue class, which copies image data to the GPU through a
+ * persistently mapped staging ring. Uploads run on the device's transfer-only queue when
+ * it has one, and each is tracked by a serial so callers can poll for completion instead
+ * of stalling the frame.
+ *
+ * @copyright Copyright (c) 2024
+*/
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "prism/prism_export.hpp"
+#include "prism/memory_allocator.h"
+
+namespace Prism {
+
+/**
+ * @class UploadQueue
+ * Streams image data to the GPU without blocking the calling thread on the GPU.
+ *
+ * Data is copied into a ring allocated staging buffer and submitted with a fence. Ring space
+ * is reclaimed once the fences of older uploads signal, so the ring only waits on the GPU when
+ * it's completely full. Uploads larger than the ring get a temporary staging buffer of their own.
+ *
+ * All methods are thread safe.
+*/
+class PRISM_EXPORT UploadQueue
+{
+public:
+    static constexpr VkDeviceSize DefaultRingSize = 32ull * 1024 * 1024;   ///< Size of the staging ring in bytes.
+
+private:
+    /**
+     * @struct PendingUpload
+     * An upload submitted to the GPU that hasn't been retired yet.
+    */
+    struct PendingUpload
+    {
+        uint64_t serial = 0;                                ///< The upload's serial.
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;     ///< The command buffer the copy was recorded into.
+        VkFence fence = VK_NULL_HANDLE;                     ///< Signaled once the copy completes.
+        VkDeviceSize ringEnd = 0;                           ///< Ring offset the upload's staging data ends at.
+        VkBuffer stagingBuffer = VK_NULL_HANDLE;            ///< Temporary staging buffer for uploads larger than the ring.
+        MemoryAllocation stagingAllocation;                 ///< Memory backing the temporary staging buffer.
+    };
+
+    class Renderer* renderer = nullptr;                     ///< The renderer owning the device and queues.
+    VkCommandPool commandPool = VK_NULL_HANDLE;             ///< Command pool on the upload queue family.
+    VkBuffer ringBuffer = VK_NULL_HANDLE;                   ///< The staging ring.
+    MemoryAllocation ringAllocation;                        ///< Host visible memory backing the staging ring.
+    uint8_t* ringMapped = nullptr;                          ///< Persistent mapping of the staging ring.
+    VkDeviceSize ringSize = 0;                              ///< Size of the staging ring in bytes.
+    VkDeviceSize ringHead = 0;                              ///< Offset the next allocation starts at.
+    VkDeviceSize ringTail = 0;                              ///< Offset of the oldest staging data still in use.
+
+    std::mutex mutex;                                       ///< Guards everything below.
+    std::deque<PendingUpload> pending;                      ///< Uploads in flight, oldest first.
+    std::vector<VkFence> freeFences;                        ///< Fences of retired uploads, ready for reuse.
+    std::vector<VkCommandBuffer> freeCommandBuffers;        ///< Command buffers of retired uploads, ready for reuse.
+    uint64_t nextSerial = 1;                                ///< The serial the next upload gets.
+    std::atomic<uint64_t> completedSerial = 0;              ///< Every upload up to this serial has completed.
+
+public:
+    /**
+     * Construct a new UploadQueue object.
+     * @param renderer The renderer to upload with.
+     * @param ringSize The size of the staging ring in bytes.
+    */
+    UploadQueue(class Renderer* renderer, VkDeviceSize ringSize = DefaultRingSize);
+
+    /// Destroy the UploadQueue object, waiting for all uploads to complete.
+    virtual ~UploadQueue();
+
+    UploadQueue(const UploadQueue&) = delete;
+    UploadQueue& operator=(const UploadQueue&) = delete;
+
+    /**
+     * Uploads pixels into a whole image.
+     *
+     * The image is transitioned from VK_IMAGE_LAYOUT_UNDEFINED to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL.
+     * With a dedicated transfer queue the image must have been created with VK_SHARING_MODE_CONCURRENT
+     * across both queue families, see Renderer::getTransferQueueFamilyIndex().
+     * @param image The image to upload to, created with VK_IMAGE_USAGE_TRANSFER_DST_BIT.
+     * @param width The width of the image.
+     * @param height The height of the image.
+     * @param pixels The tightly packed pixels, copied before this returns.
+     * @param size The size of the pixels in bytes.
+     * @return The upload's serial, pass it to isComplete() or wait().
+    */
+    uint64_t uploadImage(VkImage image, uint32_t width, uint32_t height, const void* pixels, VkDeviceSize size);
+
+    /**
+     * Uploads pixels into part of an image that was uploaded to before, leaving the rest of it untouched.
+     *
+     * The image stays in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL. On the graphics queue, work submitted earlier finishes
+     * sampling it before the copy starts. With a dedicated transfer queue nothing orders the two, so nothing may sample
+     * the image until the upload completed.
+     * @param image The image to upload to, in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL.
+     * @param offset The first texel to write.
+     * @param extent The size of the region to write.
+     * @param pixels The tightly packed pixels of the region, copied before this returns.
+     * @param size The size of the pixels in bytes.
+     * @return The upload's serial, pass it to isComplete() or wait().
+    */
+    uint64_t uploadImageRegion(VkImage image, VkOffset2D offset, VkExtent2D extent, const void* pixels, VkDeviceSize size);
+
+    /**
+     * Checks if an upload has completed, retiring any finished uploads.
+     * @param serial The serial returned by uploadImage().
+     * @return true if the upload completed and the image can be sampled; otherwise, false.
+    */
+    bool isComplete(uint64_t serial);
+
+    /**
+     * Blocks until an upload has completed.
+     * @param serial The serial returned by uploadImage().
+    */
+    void wait(uint64_t serial);
+
+    /**
+     * Retires finished uploads, reclaiming their ring space.
+    */
+    void poll();
+
+    // Getters
+    // -------------------------------------------------------------------------
+    uint64_t getCompletedSerial() const { return completedSerial; }     ///< @return Every upload up to this serial has completed.
+    VkDeviceSize getRingSize() const { return ringSize; }               ///< @return The size of the staging ring in bytes.
+
+private:
+    /**
+     * Stages pixels and submits their copy into an image region, see uploadImage() and uploadImageRegion().
+     * @param image The image to upload to.
+     * @param offset The first texel to write.
+     * @param extent The size of the region to write.
+     * @param pixels The tightly packed pixels of the region.
+     * @param size The size of the pixels in bytes.
+     * @param preserve Is the image already in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL with contents to keep?
+     * @return The upload's serial.
+    */
+    uint64_t submitUpload(VkImage image, VkOffset2D offset, VkExtent2D extent, const void* pixels, VkDeviceSize size, bool preserve);
+
+    /**
+     * Retires the uploads whose fences signaled. Expects the mutex to be held.
+     * @param waitForOldest Block until at least the oldest pending upload completes.
+    */
+    void retire(bool waitForOldest);
+
+    /**
+     * Allocates space in the staging ring, waiting for older uploads if it's full. Expects the mutex to be held.
+     * @param size The number of bytes to allocate, no larger than the ring.
+     * @return The offset of the allocation.
+    */
+    VkDeviceSize allocateRing(VkDeviceSize size);
+
+    /**
+     * Creates a host visible staging buffer.
+     * @param size The size of the buffer.
+     * @param buffer Receives the buffer.
+     * @param allocation Receives the mapped memory backing it.
+    */
+    void createStagingBuffer(VkDeviceSize size, VkBuffer& buffer, MemoryAllocation& allocation) const;
+};
+
+} // namespace Prism
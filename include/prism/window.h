@@ -19,8 +19,19 @@
 #include <vector>
 #include <functional>
 #include <unordered_map>
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
 #include <vulkan/vulkan.h>
 #include "prism/prism_export.hpp"
+#include "prism/frame_limiter.h"
+#include "prism/frame_profiler.h"
+#include "prism/frame_arena.h"
+#include "prism/input_queue.h"
+#include "prism/task_queue.h"
+#include "prism/descriptor_allocator.h"
 
 #ifdef _WIN32
 #include <Windows.h>
@@ -29,7 +40,6 @@
 struct GLFWwindow;
 struct GLFWmonitor;
 struct ImGuiContext;
-struct ImGui_ImplVulkanH_Window;
 struct ImDrawData;
 struct ImFont;
 
@@ -48,9 +58,49 @@ struct PRISM_EXPORT WindowSettings
     bool fullscreen = false;                ///< Specifies if the window is fullscreen.
     bool useCustomTitlebar = false;         ///< Specifies if a custom titlebar should be used.
     bool showOnCreate = true;               ///< Specifies if the window should be shown on creation.
+    bool threadedRendering = false;         ///< Acquire, submit and present on a dedicated thread so this window never blocks the others.
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;    ///< Preferred present mode. Falls back to FIFO if the surface doesn't support it.
+    float frameRateCap = 0.f;               ///< Max frames per second, 0 for uncapped.
+    float unfocusedFrameRateCap = 0.f;      ///< Max frames per second while the window isn't focused, 0 for the same as frameRateCap.
+    bool pauseWhenHidden = true;            ///< Stop rendering while the window is hidden. Minimized windows never render.
+    uint32_t swapchainImageCount = 0;       ///< Minimum swapchain images. 0 picks the minimum suited to the present mode.
+    uint32_t framesInFlight = 2;            ///< Frames the CPU may record ahead of the GPU, 1 to 3.
+    bool skipUnchangedFrames = false;       ///< Skip recording and presenting frames whose draw data matches the last presented frame. See Window::invalidate().
+    bool batchedDrawing = true;             ///< Draw the UI with Prism's DrawBackend where the device supports it, otherwise with the ImGui Vulkan backend.
     class Window* parent = nullptr;         ///< Pointer to the parent window, if any.
 };
 
+/**
+ * @struct FrameCommandBuffers
+ * Command buffers handed out by Window::getCommandBuffer() for one frame in flight.
+ * The buffers are allocated once and recycled with the frame's command pool reset, never freed per frame.
+*/
+struct PRISM_EXPORT FrameCommandBuffers
+{
+    std::vector<VkCommandBuffer> primary;                  ///< Extra primary command buffers allocated so far.
+    std::vector<VkCommandBuffer> secondary;                ///< Secondary command buffers allocated so far.
+    uint32_t primaryUsed = 0;                              ///< Primary buffers handed out this frame.
+    uint32_t secondaryUsed = 0;                            ///< Secondary buffers handed out this frame.
+    std::vector<VkCommandBuffer> submitList;               ///< The used primaries followed by the frame's own buffer, in submission order.
+};
+
+/**
+ * @struct FrameInFlight
+ * Resources of one frame the CPU may record while the GPU still draws the others.
+ * Frames in flight are cycled independently of the swapchain images, which only provide framebuffers.
+*/
+struct PRISM_EXPORT FrameInFlight
+{
+    VkCommandPool commandPool = VK_NULL_HANDLE;            ///< Pool of the frame's command buffers, reset once its fence signals.
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;        ///< The frame's own command buffer.
+    VkFence fence = VK_NULL_HANDLE;                        ///< Signaled once the GPU finished the frame.
+    VkSemaphore imageAcquiredSemaphore = VK_NULL_HANDLE;   ///< Signaled once the frame's swapchain image is acquired.
+    FrameCommandBuffers extraCommandBuffers;               ///< Buffers handed out by Window::getCommandBuffer().
+    std::unique_ptr<DescriptorAllocator> descriptors;      ///< Sets handed out by Window::allocateFrameDescriptor(), reset with the frame.
+    uint64_t recordedSerial = 0;                           ///< Serial of the frame recorded into the slot, pending from its submit on.
+    uint64_t serial = 0;                                   ///< Serial of the frame last submitted, 0 if none is pending.
+};
+
 /**
  * @class Window
  * Manages a single window in Prism.
@@ -62,18 +112,69 @@ class PRISM_EXPORT Window
 {
 protected:
     WindowSettings settings;                                       ///< The settings for the window.
-    uint32_t minImageCount = 2;                                    ///< The minimum number of images in the swapchain.
     bool swapchainNeedRebuild = false;                             ///< Indicates if the swapchain needs to be rebuilt.
-    std::vector<std::vector<VkCommandBuffer>> allocatedCommandBuffers;  ///< Command buffers allocated for the window.
-    std::vector<std::vector<std::function<void()>>> resourceFreeQueue;  ///< Queue of resources to free.
-
-    ImGui_ImplVulkanH_Window* imguiWindow = nullptr;               ///< Vulkan information specific to ImGui.
-    std::unordered_map<std::string, ImFont*> loadedFonts;          ///< Map of loaded ImGui fonts.
+    std::vector<FrameInFlight> framesInFlight;                     ///< Per frame fences, semaphores and command pools.
+    uint32_t frameInFlightIndex = 0;                               ///< The frame in flight being recorded next.
+    bool recordingFrame = false;                                   ///< Indicates if a frame is being recorded, getCommandBuffer() is only valid then.
+    std::vector<std::pair<uint32_t, std::function<void(VkCommandBuffer)>>> recordCallbacks; ///< Callbacks recording ahead of the UI, with their ids.
+    uint32_t nextRecordCallbackId = 1;                             ///< The id the next record callback gets.
+    uint64_t frameSerial = 0;                                      ///< Serial of the frame being built, 0 between frames.
+    std::mutex frameSerialMutex;                                   ///< Guards the frames' serials and fence resets, polled by the main thread while a render thread submits.
+
+    std::unique_ptr<class Swapchain> swapchain;                    ///< The swapchain presenting to the window.
+    std::unique_ptr<class DrawBackend> drawBackend;                ///< Records the UI in merged draws, nullptr if the ImGui backend draws it.
+    uint32_t imageIndex = 0;                                       ///< The swapchain image acquired for the current frame.
+    bool imageAcquired = false;                                    ///< Indicates if an image was acquired but not yet submitted to.
+    VkClearValue clearValue = {};                                  ///< The color the swapchain image is cleared to.
+    bool rendering = false;                                        ///< Indicates if render() is running, so callbacks don't re-enter it.
+    uint64_t presentedDrawDataHash = 0;                            ///< Hash of the draw data last presented, 0 if it must be drawn again.
+    double skipWaitUntil = 0.0;                                    ///< The glfwGetTime() before which no frame starts after a skipped one.
+    uint64_t skippedFrames = 0;                                    ///< Frames skipped because their draw data was unchanged.
+    float fixedDeltaTime = 0.f;                                    ///< Delta time handed to every frame, 0 to measure it.
+    uint32_t readableImage = UINT32_MAX;                           ///< The headless image last submitted to, UINT32_MAX if none holds a frame.
+    std::shared_ptr<class FontAtlas> fontAtlas;                    ///< The font atlas shared with the other windows.
+    std::unordered_map<std::string, ImFont*> loadedFonts;          ///< Map of loaded ImGui fonts, pointing into the shared atlas.
     ImGuiContext* imguiContext = nullptr;                          ///< The ImGui context associated with this window.
+    VkDescriptorPool imguiDescriptorPool = VK_NULL_HANDLE;         ///< Small pool the ImGui backend allocates its own font set from.
+    int redrawFrames = 2;                                          ///< Number of frames still requested to be drawn in reactive mode.
+    double lastRenderTime = 0.0;                                   ///< The glfwGetTime() of the last render, used for idle redraws.
+    FrameLimiter frameLimiter;                                     ///< Paces the window to settings.frameRateCap.
+    FrameProfiler profiler;                                        ///< Per-frame CPU and GPU timings of the window.
+    FrameArena frameArena;                                         ///< Scratch memory reset at the start of every render().
+    InputQueue inputQueue;                                         ///< Raw input from the GLFW callbacks, drained into ImGui every render().
+    TaskQueue taskQueue;                                           ///< Work posted from other threads, drained at the start of every frame.
+    bool focused = false;                                          ///< Does the window have input focus? Tracked by the focus callback.
+    bool iconified = false;                                        ///< Is the window minimized? Tracked by the iconify callback.
+    bool visible = false;                                          ///< Is the window shown? Tracked by setVisible().
+    std::future<void> asyncInit;                                   ///< The worker creating the Vulkan resources of an asynchronously initialized window.
+    std::vector<Window*> viewportWindows;                          ///< Windows mapped to viewports of this window's shared ImGui context, drawn with its frames.
+    Window* viewportHost = nullptr;                                ///< The window whose shared context this one is a viewport of, nullptr once it's gone.
+    bool viewportWindow = false;                                   ///< Is this window a viewport of a shared context? See Application::setContextMode().
+    bool closeRequested = false;                                   ///< Has a viewport window been asked to close? Others use the GLFW flag.
+    bool focusRequested = false;                                   ///< Should a viewport window take focus on its next frame?
+    uint32_t viewportId = 0;                                       ///< The ImGui viewport a viewport window was last drawn into.
 
 private:
     GLFWwindow* windowHandle = nullptr;                            ///< Handle to the GLFW window. (NOT NATIVE HANDLE)
 
+    /**
+     * @enum FrameState
+     * Hand-off state between the main thread and the window's render thread.
+    */
+    enum class FrameState
+    {
+        Acquire,    ///< The render thread is acquiring the next image and waiting for its fence.
+        Ready,      ///< An image is acquired, the main thread may build the UI and record.
+        Recorded,   ///< The command buffer is recorded, the render thread submits and presents it.
+        Rebuild,    ///< The swapchain is out of date, the main thread must rebuild it.
+        Stopping    ///< The render thread should exit.
+    };
+
+    std::thread renderThread;                                      ///< Thread acquiring, submitting and presenting, if threaded rendering is enabled.
+    std::mutex frameMutex;                                         ///< Guards frame state changes.
+    std::condition_variable frameCondition;                        ///< Signaled when the frame state changes.
+    std::atomic<FrameState> frameState = FrameState::Acquire;      ///< Current frame hand-off state.
+
 public:
     /// Construct a new Window object.
     Window(WindowSettings settings);
@@ -81,6 +182,20 @@ public:
     /// Destroy the Window object.
     virtual ~Window();
 
+    /**
+     * Makes the next window constructed initialize asynchronously, see Application::addWindowAsync().
+     * Only the native window and surface are created by the constructor, the rest finishes in finishAsyncInit().
+    */
+    static void InitNextWindowAsync();
+
+    /**
+     * Finishes initializing an asynchronously constructed window, once its worker is done.
+     * Creates the ImGui context and backends, renders the first frame and shows the window.
+     * Called by the application every iteration, doesn't block.
+     * @return true if the window is initialized; otherwise, false if the worker is still busy.
+    */
+    bool finishAsyncInit();
+
     /**
      * Renders the content of the window.
      * 
@@ -88,6 +203,159 @@ public:
     */
     void render();
 
+    /**
+     * Renders a frame right away, ignoring the frame rate cap and redraw scheduling.
+     * Threaded windows still only render once their render thread is ready.
+     * @param deltaTime The delta time to run the frame with, 0 to measure it.
+    */
+    void step(float deltaTime = 0.f);
+
+    /**
+     * Completes the frame serials of the frames the GPU finished, without waiting.
+     * Windows only complete them before reusing a frame, this keeps paused, hidden and idle windows from holding back deferred deletions.
+     * Called by the application every iteration.
+    */
+    void completeFinishedFrames();
+
+    /**
+     * Reads back the last frame rendered by a headless window.
+     * Waits for the window's frames to complete, so only call it between frames.
+     * @param pixels Receives the frame as tightly packed 8 bit RGBA rows, top to bottom.
+     * @param width Receives the width of the frame.
+     * @param height Receives the height of the frame.
+     * @return true if read; otherwise, false if the window isn't headless or hasn't rendered yet.
+    */
+    bool readPixels(std::vector<uint8_t>& pixels, uint32_t& width, uint32_t& height);
+
+    /**
+     * Checks if the window can be reused with other settings, see Application::addPooledWindow().
+     * Only settings that are fixed at creation have to match: fullscreen, the custom titlebar,
+     * threaded rendering and the parent.
+     * @param other The settings to reuse the window with.
+     * @return true if reuse() can apply the settings; otherwise, false.
+    */
+    bool canReuse(const WindowSettings& other) const;
+
+    /**
+     * Parks the window in a pool instead of destroying it.
+     * Hides the window, clears its close request and waits for its frames, so nothing draws with it while parked.
+    */
+    void release();
+
+    /**
+     * Hands a parked window out again with new settings.
+     * Size, title, present mode and the like are applied in place, the swapchain is only rebuilt if they need it.
+     * The ImGui context is kept, so onReuse() (called from here) should reset whatever of its state matters.
+     * @param settings The new settings, canReuse() must hold for them.
+    */
+    void reuse(const WindowSettings& settings);
+
+    /**
+     * Posts a task to run at the start of the window's next frame, before onUpdate().
+     * Thread safe, this is how other threads hand the window work. Wakes the main loop, so reactive
+     * windows render right away, and the window's ImGui context is current while the task runs.
+     * @param func The task.
+    */
+    void post(std::function<void()> func);
+
+    /**
+     * Posts a task to run at the start of the window's next frame, replacing a task under the same key that hasn't run yet.
+     * Use this for updates arriving faster than frames, e.g. the latest state of a feed debounced into one update per frame.
+     * Thread safe, like post().
+     * @param key The coalescing key, e.g. the address of the state the task updates.
+     * @param func The task.
+    */
+    void postFrame(uint64_t key, std::function<void()> func);
+
+    /**
+     * Requests the window to be redrawn.
+     * 
+     * This is only relevant for the reactive run mode, where windows are otherwise only
+     * redrawn on input or once the idle timeout elapses. Input automatically requests a few frames.
+     * @param frames The number of frames to draw. Use more than one to let animations finish.
+    */
+    void requestRedraw(int frames = 1);
+
+    /**
+     * Checks if the window can render without blocking.
+     * Windows without threaded rendering can always render, threaded ones only once their
+     * render thread acquired the next image (or the swapchain needs rebuilding).
+     * @return true if calling render() won't wait on the GPU; otherwise, false.
+    */
+    bool isFrameReady() const;
+
+    /**
+     * Gets how long until the window can render without any outside event.
+     * @return 0 if ready now, the time until the frame rate cap allows the next frame,
+     *         or DBL_MAX if only an event (input, restore, render thread) can make it ready.
+    */
+    double getTimeUntilFrameReady() const;
+
+    /**
+     * Gets a command buffer recycled with the current frame.
+     *
+     * Only valid inside onRecord() and record callbacks. The buffer comes back reset, begin and end it yourself.
+     * Primary buffers are submitted ahead of the frame's own command buffer in the order they were
+     * handed out. Secondary buffers must be executed from a primary buffer of the same frame.
+     * Buffers are reused once the frame's fence signals, so nothing is allocated once warmed up.
+     * @param level The level of the command buffer.
+     * @return The command buffer, or VK_NULL_HANDLE if called outside of recording.
+    */
+    VkCommandBuffer getCommandBuffer(VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+    /**
+     * Allocates a descriptor set that lives until the current frame completed.
+     * Only valid while recording, like getCommandBuffer(). Sets are released in bulk when the frame in flight is reused,
+     * and the frame's pools grow to fit the busiest frame, so per-frame descriptors cost no frees and no hard limit.
+     * @param layout The layout of the set. Its bindings may use uniform, storage and texel buffers, samplers and images.
+     * @return The descriptor set, or VK_NULL_HANDLE if called outside of recording.
+    */
+    VkDescriptorSet allocateFrameDescriptor(VkDescriptorSetLayout layout);
+
+    /**
+     * Forces the next frame to be presented, even if its draw data is unchanged.
+     *
+     * Only relevant with WindowSettings::skipUnchangedFrames. Draw data is compared by its vertices, indices,
+     * clip rects and texture ids, so call this whenever what ImGui shows changes without those changing:
+     * new pixels uploaded to a Texture, or a RenderTarget redrawn in onRecord() or a record callback.
+    */
+    void invalidate();
+
+    /**
+     * Allocates scratch memory for the current frame, freed at the start of the next render().
+     * Use it for the short-lived arrays UI code builds every frame, e.g. table cells, instead of the heap.
+     * @tparam T The element type, trivially destructible.
+     * @param count The number of elements.
+     * @return The first of count default constructed elements.
+    */
+    template<typename T>
+    T* frameAlloc(size_t count = 1) { return frameArena.alloc<T>(count); }
+
+    /**
+     * Formats a string into the current frame's scratch memory, freed at the start of the next render().
+     * @param format The fmt format string.
+     * @param args The arguments to format.
+     * @return The string, null terminated so data() can be passed to ImGui::TextUnformatted() etc.
+    */
+    template<typename... Args>
+    std::string_view frameString(fmt::format_string<Args...> format, Args&&... args) { return frameArena.format(format, std::forward<Args>(args)...); }
+
+    /**
+     * Adds a callback recording into the frame's command buffer before the ImGui render pass begins.
+     * Callbacks run after onRecord(), in the order they were added, with the same rules: the command buffer
+     * is begun and outside any render pass, and getCommandBuffer() may be used. Draw RenderTargets shown
+     * with ImGui::Image this frame here.
+     * @param callback The callback, given the frame's command buffer.
+     * @return The id to pass to removeRecordCallback().
+    */
+    uint32_t addRecordCallback(std::function<void(VkCommandBuffer)> callback);
+
+    /**
+     * Removes a callback added with addRecordCallback().
+     * @param id The id of the callback.
+    */
+    void removeRecordCallback(uint32_t id);
+
     /**
      * GLFW callback for errors.
      * @param error The error code.
@@ -160,10 +428,97 @@ public:
     */
     bool isMaximized() const;
 
-    GLFWwindow* getHandle() const { return windowHandle; }                      ///< @return The GLFW window handle.
-    ImGui_ImplVulkanH_Window* getImGuiWindow() const { return imguiWindow; }    ///< @return The ImGui Vulkan window information.
-    uint32_t getMinImageCount() const { return minImageCount; }                 ///< @return The minimum number of images in the swapchain.
+    /**
+     * Sets the preferred present mode, rebuilding the swapchain before the next frame.
+     * @param mode The present mode. Falls back to FIFO if the surface doesn't support it.
+    */
+    void setPresentMode(VkPresentModeKHR mode);
+
+    /**
+     * Enables or disables skipping frames whose draw data is unchanged.
+     * Skipped frames still run onUpdate() and onRender(), paced to the monitor's refresh rate.
+     * @param skip true to skip unchanged frames.
+    */
+    void setSkipUnchangedFrames(bool skip);
+
+    /**
+     * Sets a fixed delta time for every frame, for deterministic animation in benchmarks and tests.
+     * @param deltaTime The delta time in seconds, 0 to measure it.
+    */
+    void setFixedDeltaTime(float deltaTime) { fixedDeltaTime = deltaTime; }
+
+    /**
+     * Sets the maximum frame rate of the window.
+     * @param fps The maximum frames per second, 0 for uncapped.
+    */
+    void setFrameRateCap(float fps);
+
+    /**
+     * Set the frame rate cap while the window isn't focused, so background windows leave the frame budget to the focused one.
+     * @param fps Max frames per second while unfocused, 0 for the same as the frame rate cap.
+    */
+    void setUnfocusedFrameRateCap(float fps);
+
+    /**
+     * Set whether the window stops rendering while hidden.
+     * @param pause Should hidden windows pause?
+    */
+    void setPauseWhenHidden(bool pause) { settings.pauseWhenHidden = pause; }
+
+    /**
+     * Checks if the window is paused, rendering nothing until it's restored or shown again.
+     * Minimized windows are always paused, hidden ones unless pauseWhenHidden is off. Headless windows never pause.
+     * @return true if the window is paused; otherwise, false.
+    */
+    bool isPaused() const;
+
+    /**
+     * Checks if the window requested more frames, has tasks waiting or a font atlas rebuild for requested glyphs is due.
+     * A window hosting a shared context also counts its viewport windows and the input ImGui queued for them.
+     * @return true if the window has something new to draw; otherwise, false.
+    */
+    bool hasPendingRedraw() const;
+
+    /**
+     * Sets the minimum number of swapchain images, rebuilding the swapchain before the next frame.
+     * @param count The minimum image count. 0 picks the minimum suited to the present mode.
+    */
+    void setSwapchainImageCount(uint32_t count);
+
+    /**
+     * Sets the number of frames the CPU may record ahead of the GPU, recreating them before the next frame.
+     * @param count The frames in flight, 1 to 3.
+    */
+    void setFramesInFlight(uint32_t count);
+
+    /**
+     * Gets the number of frames in flight in use.
+     * @return settings.framesInFlight clamped to 1 to 3.
+    */
+    uint32_t getFramesInFlight() const;
+
+    /**
+     * Gets the minimum number of images to create the swapchain with.
+     * @return The requested image count, or the minimum suited to the present mode. Never less than 2.
+    */
+    uint32_t getMinImageCount() const;
+
+    GLFWwindow* getHandle() const { return windowHandle; }                      ///< @return The GLFW window handle. For viewport windows the one ImGui created, nullptr until first drawn.
+    Swapchain& getSwapchain() const { return *swapchain; }                     ///< @return The swapchain presenting to the window.
+    bool isHeadless() const;                                                    ///< @return true if the window draws offscreen, see RendererSettings::headless.
+    const WindowSettings& getSettings() const { return settings; }              ///< @return The settings for the window.
     ImGuiContext* getImGuiContext() const { return imguiContext; }              ///< @return The ImGui context associated with this window.
+    std::shared_ptr<class FontAtlas> getFontAtlas() const { return fontAtlas; } ///< @return The font atlas shared with the other windows.
+    bool isInitialized() const { return imguiContext != nullptr; }              ///< @return true once the window can render, see finishAsyncInit().
+    bool isViewportWindow() const { return viewportWindow; }                    ///< @return true if the window is a viewport of a shared ImGui context.
+    Window* getViewportHost() const { return viewportHost; }                    ///< @return The window owning the shared context this one is a viewport of, nullptr if none.
+    double getLastRenderTime() const { return lastRenderTime; }                 ///< @return The glfwGetTime() of the last render.
+    FrameProfiler& getProfiler() { return profiler; }                           ///< @return The frame profiler of the window.
+    FrameArena& getFrameArena() { return frameArena; }                          ///< @return The scratch memory of the current frame.
+    uint64_t getSkippedFrames() const { return skippedFrames; }                 ///< @return Frames skipped because their draw data was unchanged.
+    class DrawBackend* getDrawBackend() const { return drawBackend.get(); }     ///< @return The batched draw backend, nullptr if the ImGui backend draws the UI.
+    uint32_t getDroppedInputEvents() const { return inputQueue.getDropped(); } ///< @return Input events dropped because the queue was full.
+    class DeletionQueue& getDeletionQueue() const;                              ///< @return The queue destroying resources once the frames using them completed.
 
 private:
     // Internal Methods
@@ -176,26 +531,143 @@ private:
     void setDefaultTheme();
 
     // rebuildSwapchain
+    /**
+     * Creates the swapchain, frames in flight and ImGui descriptor pool.
+     * Touches neither GLFW nor ImGui, so asynchronously initialized windows run it on a worker.
+     * @param width The framebuffer width.
+     * @param height The framebuffer height.
+    */
+    void initGpuResources(int width, int height);
+
+    /**
+     * Creates the ImGui context and backends and installs the GLFW callbacks.
+     * Must run on the main thread, the current ImGui context is global.
+    */
+    void initImGui();
+
+    /**
+     * Draws the viewport windows of the shared context into the current frame, each as an ImGui window
+     * forced into a platform window of its own.
+     * @param deltaTime The delta time of the frame.
+    */
+    void drawViewportWindows(float deltaTime);
+
+    /**
+     * Lets the ImGui backends create, update and draw the platform windows of the shared context's viewports.
+     * Runs before the host's frame is submitted, so its fence and frame serial cover the viewports' submissions.
+     * @return true if viewports other than the host's were drawn, the host's frame must then be submitted.
+    */
+    bool updatePlatformWindows();
+
+    /**
+     * Centers the window on the monitor of its parent, or the primary monitor without one.
+    */
+    void centerOnMonitor();
+
+    /**
+     * Applies the frame rate cap matching the window's focus.
+    */
+    void updateFrameRate();
+
     /**
      * Rebuilds the swapchain for the window.
      *
      * This method is called when the swapchain needs to be rebuilt due to a window resize or other event.
-     * It will recreate the swapchain and associated resources.
+     * The old swapchain is retired rather than waited on, so the device never goes idle. Only a change
+     * in the number of frames in flight waits, and only for this window's own frames.
      * @note This method is called automatically inside the render() method.
     */
     void rebuildSwapchain();
 
+    /**
+     * Rebuilds the swapchain for a known framebuffer size, so it can run off the main thread.
+     * @param width The framebuffer width.
+     * @param height The framebuffer height.
+    */
+    void rebuildSwapchain(int width, int height);
+
+    /**
+     * Gets the minimum number of images to create the swapchain with.
+     * @param presentMode The present mode the swapchain will use.
+     * @return The requested image count, or the minimum suited to the present mode. Never less than 2.
+    */
+    uint32_t getMinImageCount(VkPresentModeKHR presentMode) const;
+
+    /**
+     * Waits until the GPU finished every frame in flight of this window, completing their frame serials.
+    */
+    void waitForFrames();
+
+    /**
+     * Drains the input queue into the window's ImGui context.
+     * Modifiers are taken from the GLFW mods bits of each event rather than queried.
+     * @note The window's ImGui context must be current.
+    */
+    void processInputEvents();
+
+    /**
+     * Creates the frames in flight.
+    */
+    void createFramesInFlight();
+
+    /**
+     * Destroys the frames in flight, completing their frame serials.
+     * @note The frames must have completed, see waitForFrames().
+    */
+    void destroyFramesInFlight();
+
     /**
      * Renders ImGui's content to command buffers.
      * @param drawData The ImGui draw data to render.
     */
     void frameRender(ImDrawData* drawData);
 
+    /**
+     * Waits until the next frame in flight is free, then acquires a swapchain image for it.
+     * @return true if an image was acquired; otherwise, false and the swapchain needs rebuilding.
+    */
+    bool acquireFrame();
+
+    /**
+     * Records ImGui's draw data into the acquired frame's command buffer.
+     * @param drawData The ImGui draw data to record.
+    */
+    void recordFrame(ImDrawData* drawData);
+
+    /**
+     * Submits the acquired frame's command buffers and moves on to the next frame in flight.
+    */
+    void submitFrame();
+
+    /**
+     * Submits an empty batch under the next frame in flight's fence, making the frame serial pending without drawing.
+     * Its fence signals once the work submitted to the queue before it completed, such as the viewports' draws.
+    */
+    void submitEmptyFrame();
+
+    /**
+     * The render thread's main loop, used with threaded rendering.
+     * Waits for the main thread to record each frame, then submits, presents and acquires the next.
+    */
+    void renderThreadLoop();
+
+    /**
+     * Changes the frame state and wakes whoever is waiting on it.
+     * @param state The new frame state.
+    */
+    void setFrameState(FrameState state);
+
+    /**
+     * Renders a frame, render() and step() decide when.
+    */
+    void renderFrame();
+
     /**
      * Presents the frame to the window.
      * Displaying the rendered content from frameRender() to the window.
+     * @return true if presented; otherwise, false and the swapchain needs rebuilding.
     */
-    void framePresent();
+    bool framePresent();
 
     /**
      * Renders and presents the frame.
@@ -238,6 +710,7 @@ private:
     /**
      * Install custom glfw callbacks.
      * We use custom ones since the default ImGui ones are not compatible with the multi-context.
+     * The input callbacks only queue the raw event, see processInputEvents().
     */
     void installGlfwCallbacks();
 
@@ -248,6 +721,30 @@ private:
     */
     static void WindowFocusCallback(GLFWwindow* glfwWindow, int focused);
 
+    /**
+     * Custom glfw callback for window iconification.
+     * Minimized windows pause, restoring them wakes the main loop with the event itself.
+     * @param glfwWindow The glfw window handle that received the event.
+     * @param iconified Indicates if the window was minimized.
+    */
+    static void WindowIconifyCallback(GLFWwindow* glfwWindow, int iconified);
+
+    /**
+     * Custom glfw callback for window refresh.
+     * Called when the window contents are damaged and need to be redrawn. This also fires while the OS
+     * runs its modal resize loop and the main loop is stuck in glfwPollEvents(), so the window renders right away.
+     * @param glfwWindow The glfw window handle that received the event.
+    */
+    static void WindowRefreshCallback(GLFWwindow* glfwWindow);
+
+    /**
+     * Custom glfw callback for framebuffer resizes.
+     * @param glfwWindow The glfw window handle that received the event.
+     * @param width The new width of the framebuffer in pixels.
+     * @param height The new height of the framebuffer in pixels.
+    */
+    static void FramebufferSizeCallback(GLFWwindow* glfwWindow, int width, int height);
+
     /**
      * Custom glfw callback for cursor enter.
      * @param glfwWindow The glfw window handle that received the event.
@@ -317,9 +814,26 @@ protected:
     /**
      * Called when the window is rendering.
      * Override this method to implement custom rendering logic.
-     * @note The ImGui context will be CORRECT during this callback.
+     * @note The ImGui context will be CORRECT during this callback. In a viewport window this draws into the
+     *       window's own ImGui window, further ImGui::Begin() calls open separate windows rather than fill it.
     */
     virtual void onRender(float deltaTime) {}
+
+    /**
+     * Called while the frame is recorded, before the ImGui render pass begins.
+     * Override this method to record custom passes, e.g. an offscreen viewport sampled by the UI.
+     * Use getCommandBuffer() for extra buffers.
+     * @param commandBuffer The frame's command buffer, already begun and outside any render pass.
+     * @note This may run after onRender(), when the swapchain image is known. The ImGui context is CORRECT.
+    */
+    virtual void onRecord(VkCommandBuffer commandBuffer) {}
+
+    /**
+     * Called when a pooled window is handed out again by Application::addPooledWindow().
+     * Override this method to reset per use state, the object and its ImGui context live on between uses.
+     * @note The ImGui context will be CORRECT during this callback.
+    */
+    virtual void onReuse() {}
 };
 
 } // namespace Prism
\ No newline at end of file
@@ -0,0 +1,320 @@
+#include "prism/data_table.h"
+#include "prism/font_atlas.h"
+#include "prism/prism.h"
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <iterator>
+#include <fmt/core.h>
+
+#include "imgui.h"
+#include "imgui_internal.h"
+
+// Rows kept formatted at least, so scrolling back and forth a little never reformats
+static constexpr size_t MinCachedRows = 256;
+
+// Past this fraction of the rows edited, sorting everything again beats merging the edits in
+static constexpr size_t MaxChangedRowsDivisor = 4;
+
+// Every filter matches case insensitively, the filter itself is lowercased once
+static bool ContainsIgnoreCase(std::string_view text, std::string_view lowerNeedle)
+{
+    auto it = std::search(text.begin(), text.end(), lowerNeedle.begin(), lowerNeedle.end(),
+                          [](char a, char b) { return (char)std::tolower((unsigned char)a) == b; });
+    return it != text.end();
+}
+
+// Orders numbers with NaN after everything else, so sorting always sees a strict weak ordering
+static int CompareNumbers(double a, double b)
+{
+    const bool aNan = std::isnan(a);
+    const bool bNan = std::isnan(b);
+    if (aNan || bNan)
+        return (int)aNan - (int)bNan;
+    return a < b ? -1 : (b < a ? 1 : 0);
+}
+
+// Grows the std::string an InputText edits in place, like imgui_stdlib does
+static int ResizeFilterCallback(ImGuiInputTextCallbackData* data)
+{
+    if (data->EventFlag == ImGuiInputTextFlags_CallbackResize) {
+        std::string* text = (std::string*)data->UserData;
+        text->resize((size_t)data->BufTextLen);
+        data->Buf = text->data();
+    }
+    return 0;
+}
+
+static bool RowMatches(const Prism::TableDataSource& source, size_t row, size_t columnCount, std::string_view filter, std::string& text)
+{
+    for (size_t column = 0; column < columnCount; column++) {
+        if (source.getColumnType(column) == Prism::TableColumnType::Text) {
+            if (ContainsIgnoreCase(source.getText(row, column), filter))
+                return true;
+            continue;
+        }
+        source.formatCell(row, column, text);
+        if (ContainsIgnoreCase(text, filter))
+            return true;
+    }
+    return false;
+}
+
+namespace Prism {
+
+void TableDataSource::formatCell(size_t row, size_t column, std::string& text) const
+{
+    text.clear();
+    if (getColumnType(column) == TableColumnType::Text)
+        text.append(getText(row, column));
+    else
+        fmt::format_to(std::back_inserter(text), "{}", getNumber(row, column));
+}
+
+DataTable::DataTable(std::shared_ptr<TableDataSource> source) :
+    source(std::move(source))
+{
+    indexThread = std::thread(&DataTable::indexThreadLoop, this);
+}
+
+DataTable::~DataTable()
+{
+    {
+        std::lock_guard<std::mutex> lock(indexMutex);
+        stopping = true;
+    }
+    indexCondition.notify_one();
+    indexThread.join();
+}
+
+void DataTable::draw(const char* id, float width, float height)
+{
+    drawCount++;
+
+    // The filter box sits above the table, sharing its width
+    if (filterVisible) {
+        // Edited in place, so a filter of any length round trips untouched
+        ImGui::PushID(id);
+        ImGui::SetNextItemWidth(width > 0.f ? width : -FLT_MIN);
+        if (ImGui::InputTextWithHint("##filter", "Filter", filterText.data(), filterText.capacity() + 1,
+                                     ImGuiInputTextFlags_CallbackResize, ResizeFilterCallback, &filterText))
+            setFilter(std::string(filterText));
+        ImGui::PopID();
+    }
+
+    const int columns = (int)std::min<size_t>(source->getColumnCount(), IMGUI_TABLE_MAX_COLUMNS);
+    if (columns == 0)
+        return;
+
+    const ImGuiTableFlags flags = ImGuiTableFlags_Sortable | ImGuiTableFlags_SortTristate | ImGuiTableFlags_ScrollY |
+        ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersOuter | ImGuiTableFlags_BordersV |
+        ImGuiTableFlags_Resizable | ImGuiTableFlags_Reorderable | ImGuiTableFlags_Hideable;
+    if (!ImGui::BeginTable(id, columns, flags, ImVec2(width, height)))
+        return;
+
+    ImGui::TableSetupScrollFreeze(0, 1);
+    for (int column = 0; column < columns; column++)
+        ImGui::TableSetupColumn(source->getColumnName((size_t)column).c_str());
+    ImGui::TableHeadersRow();
+
+    // Clicking a header only changes the spec, the index thread does the sorting
+    ImGuiTableSortSpecs* sortSpecs = ImGui::TableGetSortSpecs();
+    if (sortSpecs && sortSpecs->SpecsDirty) {
+        spec.sortColumn = sortSpecs->SpecsCount > 0 ? sortSpecs->Specs[0].ColumnIndex : -1;
+        spec.ascending = sortSpecs->SpecsCount == 0 || sortSpecs->Specs[0].SortDirection == ImGuiSortDirection_Ascending;
+        sortSpecs->SpecsDirty = false;
+    }
+    updateIndex();
+
+    // Without sort and filter rows come straight from the source. Otherwise the last order
+    // built is shown, even while a newer one is still building.
+    const size_t rowCount = source->getRowCount();
+    const bool useIndex = index && !spec.isIdentity();
+    const size_t shownRows = useIndex ? index->rows.size() : rowCount;
+
+    // Cell text is data no one requested glyphs for, visible cells request and keep theirs in the atlas
+    std::shared_ptr<FontAtlas> fontAtlas = Application::Get().getRenderer()->getFontAtlas();
+
+    ImGuiListClipper clipper;
+    clipper.Begin((int)std::min<size_t>(shownRows, INT_MAX));
+    size_t visibleRows = 0;
+    while (clipper.Step()) {
+        for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+            const uint32_t row = useIndex ? index->rows[(size_t)i] : (uint32_t)i;
+            ImGui::TableNextRow();
+
+            // Rows removed since the order was built stay blank until the next one arrives
+            if (row >= rowCount)
+                continue;
+
+            const CachedRow& cached = getCachedRow(row);
+            for (int column = 0; column < columns; column++) {
+                ImGui::TableSetColumnIndex(column);
+                const std::string& text = cached.cells[(size_t)column];
+                fontAtlas->requestGlyphs(text);
+                ImGui::TextUnformatted(text.data(), text.data() + text.size());
+            }
+            visibleRows++;
+        }
+    }
+    ImGui::EndTable();
+
+    // Forget rows scrolled away from once the cache outgrows what's on screen
+    if (textCache.size() > std::max(MinCachedRows, visibleRows * 4))
+        std::erase_if(textCache, [this](const auto& entry) { return entry.second.lastDrawn != drawCount; });
+}
+
+void DataTable::setFilter(std::string_view filter)
+{
+    filterText = filter;
+    spec.filter.resize(filter.size());
+    std::transform(filter.begin(), filter.end(), spec.filter.begin(), [](char c) { return (char)std::tolower((unsigned char)c); });
+}
+
+size_t DataTable::getShownRowCount() const
+{
+    if (spec.isIdentity() || !index)
+        return source->getRowCount();
+    return index->rows.size();
+}
+
+bool DataTable::isIndexing()
+{
+    std::lock_guard<std::mutex> lock(indexMutex);
+    return indexRequested || indexBuilding;
+}
+
+void DataTable::updateIndex()
+{
+    std::lock_guard<std::mutex> lock(indexMutex);
+    index = publishedIndex;
+    if (spec.isIdentity())
+        return;
+
+    // Re-requesting while a build runs is free, the thread starts the next one from the newest state once done
+    if (index && index->spec == spec && index->version == source->getVersion() && index->rowCount == source->getRowCount()
+        && index->changeCounter == source->getChangeCounter())
+        return;
+    requestedSpec = spec;
+    indexRequested = true;
+    indexCondition.notify_one();
+}
+
+const DataTable::CachedRow& DataTable::getCachedRow(uint32_t row)
+{
+    CachedRow& cached = textCache[row];
+    cached.lastDrawn = drawCount;
+    const uint64_t version = source->getRowVersion(row);
+    const size_t columnCount = source->getColumnCount();
+    if (cached.version == version && cached.cells.size() == columnCount)
+        return cached;
+
+    cached.version = version;
+    cached.cells.resize(columnCount);
+    for (size_t column = 0; column < columnCount; column++)
+        source->formatCell(row, column, cached.cells[column]);
+    return cached;
+}
+
+void DataTable::indexThreadLoop()
+{
+    std::unique_lock<std::mutex> lock(indexMutex);
+    while (true) {
+        indexCondition.wait(lock, [this] { return indexRequested || stopping; });
+        if (stopping)
+            return;
+
+        const IndexSpec buildSpec = requestedSpec;
+        std::shared_ptr<const RowIndex> previous = publishedIndex;
+        indexRequested = false;
+        indexBuilding = true;
+        lock.unlock();
+
+        std::shared_ptr<const RowIndex> built = BuildIndex(*source, buildSpec, previous);
+
+        // Swapped in whole, the UI thread picks it up with its next draw()
+        lock.lock();
+        publishedIndex = std::move(built);
+        indexBuilding = false;
+    }
+}
+
+std::shared_ptr<const DataTable::RowIndex> DataTable::BuildIndex(const TableDataSource& source, const IndexSpec& spec,
+                                                                 const std::shared_ptr<const RowIndex>& previous)
+{
+    // Read the version and change counter first, rows appended or edited meanwhile are picked up by the next build
+    const uint64_t version = source.getVersion();
+    const uint64_t changeCounter = source.getChangeCounter();
+    const size_t rowCount = std::min<size_t>(source.getRowCount(), UINT32_MAX);
+    bool extend = previous && previous->spec == spec && previous->version == version && previous->rowCount <= rowCount;
+    if (extend && previous->rowCount == rowCount && previous->changeCounter == changeCounter)
+        return previous;
+
+    // Rows edited in place are taken out of the previous order and go back in like appended ones.
+    // Edited rows past the previous order are appended anyway.
+    std::vector<size_t> changed;
+    if (extend && previous->changeCounter != changeCounter) {
+        extend = source.getChangedRows(previous->changeCounter, changed);
+        std::sort(changed.begin(), changed.end());
+        changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+        changed.erase(std::lower_bound(changed.begin(), changed.end(), previous->rowCount), changed.end());
+        extend = extend && changed.size() <= previous->rowCount / MaxChangedRowsDivisor;
+    }
+
+    auto index = std::make_shared<RowIndex>();
+    index->spec = spec;
+    index->version = version;
+    index->changeCounter = changeCounter;
+    index->rowCount = rowCount;
+    if (extend)
+        index->rows = previous->rows;
+    if (!changed.empty() && extend)
+        std::erase_if(index->rows, [&](uint32_t row) { return std::binary_search(changed.begin(), changed.end(), (size_t)row); });
+
+    // Only the edited rows and those the previous order doesn't cover are filtered, in source order
+    const size_t columnCount = source.getColumnCount();
+    const size_t firstRow = extend ? previous->rowCount : 0;
+    std::vector<uint32_t> added;
+    if (spec.filter.empty())
+        added.reserve(rowCount - firstRow + (extend ? changed.size() : 0));
+    std::string text;
+    if (extend) {
+        for (size_t row : changed)
+            if (spec.filter.empty() || RowMatches(source, row, columnCount, spec.filter, text))
+                added.push_back((uint32_t)row);
+    }
+    for (size_t row = firstRow; row < rowCount; row++)
+        if (spec.filter.empty() || RowMatches(source, row, columnCount, spec.filter, text))
+            added.push_back((uint32_t)row);
+
+    // Unsorted the order is the source order, edited rows are merged back into their place
+    if (spec.sortColumn < 0 || (size_t)spec.sortColumn >= columnCount) {
+        const size_t existing = index->rows.size();
+        index->rows.insert(index->rows.end(), added.begin(), added.end());
+        if (extend && !changed.empty())
+            std::inplace_merge(index->rows.begin(), index->rows.begin() + (ptrdiff_t)existing, index->rows.end());
+        return index;
+    }
+
+    // Ties keep source order, in both directions
+    const size_t column = (size_t)spec.sortColumn;
+    const bool numeric = source.getColumnType(column) == TableColumnType::Number;
+    const bool ascending = spec.ascending;
+    auto less = [&](uint32_t a, uint32_t b) {
+        const int order = numeric ? CompareNumbers(source.getNumber(a, column), source.getNumber(b, column))
+                                  : source.getText(a, column).compare(source.getText(b, column));
+        if (order == 0)
+            return a < b;
+        return ascending ? order < 0 : order > 0;
+    };
+
+    // Sort just the new and edited rows, then merge them into the existing order
+    std::sort(added.begin(), added.end(), less);
+    const size_t existing = index->rows.size();
+    index->rows.insert(index->rows.end(), added.begin(), added.end());
+    std::inplace_merge(index->rows.begin(), index->rows.begin() + (ptrdiff_t)existing, index->rows.end(), less);
+    return index;
+}
+
+} // namespace Prism
@@ -0,0 +1,191 @@
+#include "prism/deletion_queue.h"
+#include "prism/renderer.h"
+
+namespace Prism {
+
+DeletionQueue::DeletionQueue(Renderer* renderer) :
+    renderer(renderer)
+{
+    // Reserve up front, so deferring never allocates unless a bucket overflows
+    for (Bucket& bucket : buckets)
+        bucket.entries.reserve(BucketCapacity);
+}
+
+DeletionQueue::~DeletionQueue()
+{
+    flush();
+}
+
+void DeletionQueue::destroyBuffer(VkBuffer buffer)
+{
+    if (buffer == VK_NULL_HANDLE)
+        return;
+    Entry entry = {};
+    entry.type = EntryType::Buffer;
+    entry.buffer = buffer;
+    push(entry);
+}
+
+void DeletionQueue::destroyImage(VkImage image)
+{
+    if (image == VK_NULL_HANDLE)
+        return;
+    Entry entry = {};
+    entry.type = EntryType::Image;
+    entry.image = image;
+    push(entry);
+}
+
+void DeletionQueue::destroyImageView(VkImageView imageView)
+{
+    if (imageView == VK_NULL_HANDLE)
+        return;
+    Entry entry = {};
+    entry.type = EntryType::ImageView;
+    entry.imageView = imageView;
+    push(entry);
+}
+
+void DeletionQueue::destroySampler(VkSampler sampler)
+{
+    if (sampler == VK_NULL_HANDLE)
+        return;
+    Entry entry = {};
+    entry.type = EntryType::Sampler;
+    entry.sampler = sampler;
+    push(entry);
+}
+
+void DeletionQueue::freeDescriptorSet(VkDescriptorSet descriptorSet)
+{
+    if (descriptorSet == VK_NULL_HANDLE)
+        return;
+    Entry entry = {};
+    entry.type = EntryType::DescriptorSet;
+    entry.descriptorSet = descriptorSet;
+    push(entry);
+}
+
+void DeletionQueue::destroyFramebuffer(VkFramebuffer framebuffer)
+{
+    if (framebuffer == VK_NULL_HANDLE)
+        return;
+    Entry entry = {};
+    entry.type = EntryType::Framebuffer;
+    entry.framebuffer = framebuffer;
+    push(entry);
+}
+
+void DeletionQueue::destroyRenderPass(VkRenderPass renderPass)
+{
+    if (renderPass == VK_NULL_HANDLE)
+        return;
+    Entry entry = {};
+    entry.type = EntryType::RenderPass;
+    entry.renderPass = renderPass;
+    push(entry);
+}
+
+void DeletionQueue::destroySemaphore(VkSemaphore semaphore)
+{
+    if (semaphore == VK_NULL_HANDLE)
+        return;
+    Entry entry = {};
+    entry.type = EntryType::Semaphore;
+    entry.semaphore = semaphore;
+    push(entry);
+}
+
+void DeletionQueue::freeMemory(MemoryAllocation& allocation)
+{
+    if (!allocation)
+        return;
+    Entry entry = {};
+    entry.type = EntryType::Memory;
+    entry.allocation = allocation;
+    push(entry);
+    allocation = MemoryAllocation();
+}
+
+void DeletionQueue::collect()
+{
+    const uint64_t completedSerial = renderer->getCompletedFrameSerial();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (Bucket& bucket : buckets) {
+        if (bucket.entries.empty() || bucket.serial > completedSerial)
+            continue;
+        for (Entry& entry : bucket.entries)
+            destroy(entry);
+        bucket.entries.clear();
+    }
+}
+
+void DeletionQueue::flush()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (Bucket& bucket : buckets) {
+        for (Entry& entry : bucket.entries)
+            destroy(entry);
+        bucket.entries.clear();
+    }
+}
+
+void DeletionQueue::push(const Entry& entry)
+{
+    // Any frame that could still use the handle has this serial or an older one
+    const uint64_t serial = renderer->getLatestFrameSerial();
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Move on to the next bucket once the serial changes, as long as it's been collected.
+    // If it hasn't, keep filling the current one, it just waits for the newer serial.
+    Bucket* head = &buckets[headBucket];
+    if (head->serial != serial && !head->entries.empty()) {
+        const size_t next = (headBucket + 1) % BucketCount;
+        if (buckets[next].entries.empty()) {
+            headBucket = next;
+            head = &buckets[next];
+        }
+    }
+    head->serial = serial;
+    head->entries.push_back(entry);
+}
+
+void DeletionQueue::destroy(Entry& entry)
+{
+    VkDevice device = renderer->getDevice();
+    VkAllocationCallbacks* allocator = renderer->getAllocator();
+
+    switch (entry.type) {
+    case EntryType::Buffer:
+        vkDestroyBuffer(device, entry.buffer, allocator);
+        break;
+    case EntryType::Image:
+        vkDestroyImage(device, entry.image, allocator);
+        break;
+    case EntryType::ImageView:
+        vkDestroyImageView(device, entry.imageView, allocator);
+        break;
+    case EntryType::Sampler:
+        vkDestroySampler(device, entry.sampler, allocator);
+        break;
+    case EntryType::DescriptorSet:
+        renderer->freeTextureDescriptor(entry.descriptorSet);
+        break;
+    case EntryType::Framebuffer:
+        vkDestroyFramebuffer(device, entry.framebuffer, allocator);
+        break;
+    case EntryType::RenderPass:
+        vkDestroyRenderPass(device, entry.renderPass, allocator);
+        break;
+    case EntryType::Semaphore:
+        vkDestroySemaphore(device, entry.semaphore, allocator);
+        break;
+    case EntryType::Memory:
+        renderer->getMemoryAllocator().free(entry.allocation);
+        break;
+    }
+}
+
+} // namespace Prism
@@ -0,0 +1,170 @@
+#include "prism/descriptor_allocator.h"
+#include "prism/renderer.h"
+#include <algorithm>
+#include <cmath>
+
+namespace Prism {
+
+DescriptorAllocator::DescriptorAllocator(Renderer* renderer, std::vector<DescriptorPoolRatio> ratios, bool freeable,
+                                         uint32_t initialSets, uint32_t maxPoolSets) :
+    renderer(renderer),
+    ratios(std::move(ratios)),
+    freeable(freeable),
+    nextPoolSets(std::max(initialSets, 1u)),
+    maxPoolSets(std::max(maxPoolSets, initialSets))
+{
+}
+
+DescriptorAllocator::~DescriptorAllocator()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (freeable && !owners.empty())
+        fmt::print("Prism: Destroying descriptor allocator with {} live sets\n", owners.size());
+    destroyPools();
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout)
+{
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto tryAllocate = [&](size_t index) {
+        Pool& pool = pools[index];
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+        allocInfo.descriptorPool = pool.pool;
+        VkResult err = vkAllocateDescriptorSets(renderer->getDevice(), &allocInfo, &descriptorSet);
+        if (err == VK_ERROR_OUT_OF_POOL_MEMORY || err == VK_ERROR_FRAGMENTED_POOL) {
+            pool.full = true;
+            return (VkDescriptorSet)VK_NULL_HANDLE;
+        }
+        Renderer::CheckVkResult(err);
+
+        pool.usedSets++;
+        currentPool = index;
+        if (freeable)
+            owners.emplace(descriptorSet, (uint32_t)index);
+        return descriptorSet;
+    };
+
+    // Try the current pool, then any other with room (freed sets leave holes), then grow
+    if (!pools.empty() && !pools[currentPool].full)
+        if (VkDescriptorSet descriptorSet = tryAllocate(currentPool))
+            return descriptorSet;
+    for (size_t i = 0; i < pools.size(); i++)
+        if (!pools[i].full)
+            if (VkDescriptorSet descriptorSet = tryAllocate(i))
+                return descriptorSet;
+
+    createPool(nextPoolSets);
+    nextPoolSets = std::min(nextPoolSets * 2, maxPoolSets);
+    if (VkDescriptorSet descriptorSet = tryAllocate(currentPool))
+        return descriptorSet;
+
+    // A fresh pool failing means the layout uses types the ratios don't cover
+    fmt::print("Error: Descriptor set layout doesn't fit the allocator's pools\n");
+    abort();
+}
+
+void DescriptorAllocator::free(VkDescriptorSet descriptorSet)
+{
+    if (descriptorSet == VK_NULL_HANDLE)
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = owners.find(descriptorSet);
+    if (!freeable || it == owners.end())
+        return;
+
+    Pool& pool = pools[it->second];
+    VkResult err = vkFreeDescriptorSets(renderer->getDevice(), pool.pool, 1, &descriptorSet);
+    Renderer::CheckVkResult(err);
+    pool.usedSets--;
+    pool.full = false;
+    owners.erase(it);
+}
+
+void DescriptorAllocator::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    owners.clear();
+
+    // One pool that fits everything beats a chain, nothing references the old ones anymore
+    if (pools.size() > 1) {
+        uint32_t totalSets = 0;
+        for (const Pool& pool : pools)
+            totalSets += pool.maxSets;
+        destroyPools();
+        createPool(totalSets);
+        nextPoolSets = std::min(totalSets * 2, maxPoolSets);
+        return;
+    }
+
+    for (Pool& pool : pools) {
+        VkResult err = vkResetDescriptorPool(renderer->getDevice(), pool.pool, 0);
+        Renderer::CheckVkResult(err);
+        pool.usedSets = 0;
+        pool.full = false;
+    }
+    currentPool = 0;
+}
+
+uint32_t DescriptorAllocator::getPoolCount()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return (uint32_t)pools.size();
+}
+
+uint32_t DescriptorAllocator::getSetsInUse()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    uint32_t sets = 0;
+    for (const Pool& pool : pools)
+        sets += pool.usedSets;
+    return sets;
+}
+
+uint32_t DescriptorAllocator::getSetCapacity()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    uint32_t sets = 0;
+    for (const Pool& pool : pools)
+        sets += pool.maxSets;
+    return sets;
+}
+
+void DescriptorAllocator::createPool(uint32_t maxSets)
+{
+    // Only the types in use are reserved, scaled by how many sets the pool holds
+    std::vector<VkDescriptorPoolSize> poolSizes;
+    poolSizes.reserve(ratios.size());
+    for (const DescriptorPoolRatio& ratio : ratios)
+        poolSizes.push_back({ ratio.type, std::max(1u, (uint32_t)std::ceil(ratio.ratio * (float)maxSets)) });
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = freeable ? VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT : 0;
+    poolInfo.maxSets = maxSets;
+    poolInfo.poolSizeCount = (uint32_t)poolSizes.size();
+    poolInfo.pPoolSizes = poolSizes.data();
+
+    Pool pool;
+    pool.maxSets = maxSets;
+    VkResult err = vkCreateDescriptorPool(renderer->getDevice(), &poolInfo, renderer->getAllocator(), &pool.pool);
+    Renderer::CheckVkResult(err);
+    pools.push_back(pool);
+    currentPool = pools.size() - 1;
+}
+
+void DescriptorAllocator::destroyPools()
+{
+    // Destroying a pool frees every set allocated from it
+    for (Pool& pool : pools)
+        vkDestroyDescriptorPool(renderer->getDevice(), pool.pool, renderer->getAllocator());
+    pools.clear();
+    currentPool = 0;
+}
+
+} // namespace Prism
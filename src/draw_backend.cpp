@@ -0,0 +1,355 @@
+#include "prism/draw_backend.h"
+#include "prism/renderer.h"
+#include "prism/texture_table.h"
+#include "prism/deletion_queue.h"
+#include <algorithm>
+#include <cstddef>
+
+#ifdef PRISM_DRAW_SHADERS
+// SPIR-V compiled from src/shaders at build time
+#include "draw_vert.h"
+#include "draw_frag.h"
+#endif
+
+static bool SameRect(const VkRect2D& a, const VkRect2D& b)
+{
+    return a.offset.x == b.offset.x && a.offset.y == b.offset.y && a.extent.width == b.extent.width && a.extent.height == b.extent.height;
+}
+
+#ifdef PRISM_DRAW_SHADERS
+static VkShaderModule CreateShaderModule(Prism::Renderer* renderer, const uint32_t* code, size_t codeSize)
+{
+    VkShaderModuleCreateInfo moduleInfo = {};
+    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleInfo.codeSize = codeSize;
+    moduleInfo.pCode = code;
+    VkShaderModule module = VK_NULL_HANDLE;
+    VkResult err = vkCreateShaderModule(renderer->getDevice(), &moduleInfo, renderer->getAllocator(), &module);
+    Prism::Renderer::CheckVkResult(err);
+    return module;
+}
+#endif
+
+namespace Prism {
+
+DrawBackend::DrawBackend(Renderer* renderer, VkRenderPass renderPass, uint32_t frameCount) :
+    renderer(renderer),
+    textureTable(renderer->getTextureTable()),
+    frames(std::max(frameCount, 1u))
+{
+    createPipeline(renderPass);
+}
+
+DrawBackend::~DrawBackend()
+{
+    DeletionQueue& deletionQueue = renderer->getDeletionQueue();
+    for (FrameBuffer& frame : frames) {
+        if (frame.buffer == VK_NULL_HANDLE)
+            continue;
+        deletionQueue.destroyBuffer(frame.buffer);
+        deletionQueue.freeMemory(frame.allocation);
+        frame.buffer = VK_NULL_HANDLE;
+    }
+
+    // Windows only destroy the backend once their frames completed
+    VkDevice device = renderer->getDevice();
+    vkDestroyPipeline(device, pipeline, renderer->getAllocator());
+    vkDestroyPipelineLayout(device, pipelineLayout, renderer->getAllocator());
+    pipeline = VK_NULL_HANDLE;
+    pipelineLayout = VK_NULL_HANDLE;
+}
+
+bool DrawBackend::IsSupported(const Renderer& renderer)
+{
+#ifdef PRISM_DRAW_SHADERS
+    return renderer.getTextureTable() != nullptr;
+#else
+    return false;
+#endif
+}
+
+bool DrawBackend::render(ImDrawData* drawData, VkCommandBuffer commandBuffer, uint32_t frameIndex)
+{
+    drawCallCount = 0;
+    commandCount = 0;
+
+    // Minimized windows have nothing to draw to
+    const float fbWidth = drawData->DisplaySize.x * drawData->FramebufferScale.x;
+    const float fbHeight = drawData->DisplaySize.y * drawData->FramebufferScale.y;
+    if (fbWidth <= 0.f || fbHeight <= 0.f)
+        return true;
+    if (!resolveTextures(drawData))
+        return false;
+    if (drawData->TotalVtxCount == 0 || drawData->TotalIdxCount == 0)
+        return true;
+
+    // Vertices first, then indices. Both are written straight into the mapped buffer, the frame's fence was waited already.
+    const VkDeviceSize vertexBytes = (VkDeviceSize)drawData->TotalVtxCount * sizeof(DrawVertex);
+    const VkDeviceSize indexBytes = (VkDeviceSize)drawData->TotalIdxCount * sizeof(uint32_t);
+    FrameBuffer& frame = frames[frameIndex % frames.size()];
+    reserve(frame, vertexBytes + indexBytes);
+    DrawVertex* vertexOut = (DrawVertex*)frame.allocation.mapped;
+    uint32_t* indexOut = (uint32_t*)((uint8_t*)frame.allocation.mapped + vertexBytes);
+
+    const ImVec2 clipOffset = drawData->DisplayPos;
+    const ImVec2 clipScale = drawData->FramebufferScale;
+    draws.clear();
+    uint32_t vertexBase = 0;
+    uint32_t indexCount = 0;
+    size_t command = 0;
+    for (int n = 0; n < drawData->CmdListsCount; n++) {
+        const ImDrawList* list = drawData->CmdLists[n];
+        const ImDrawIdx* listIndices = list->IdxBuffer.Data;
+        vertexSlots.assign((size_t)list->VtxBuffer.Size, TextureTable::InvalidSlot);
+
+        for (const ImDrawCmd& cmd : list->CmdBuffer) {
+            const uint32_t slot = commandSlots[command++];
+
+            // Project the clip rect into the framebuffer, commands clipped away entirely are dropped
+            const float clipMinX = std::max((cmd.ClipRect.x - clipOffset.x) * clipScale.x, 0.f);
+            const float clipMinY = std::max((cmd.ClipRect.y - clipOffset.y) * clipScale.y, 0.f);
+            const float clipMaxX = std::min((cmd.ClipRect.z - clipOffset.x) * clipScale.x, fbWidth);
+            const float clipMaxY = std::min((cmd.ClipRect.w - clipOffset.y) * clipScale.y, fbHeight);
+            if (cmd.ElemCount == 0 || clipMaxX <= clipMinX || clipMaxY <= clipMinY)
+                continue;
+
+            // Rebase the indices onto the frame's vertices. Vertices take the texture of the command drawing them,
+            // ImGui never shares them between commands, but a list that does is left to the ImGui backend.
+            const ImDrawIdx* indices = listIndices + cmd.IdxOffset;
+            uint32_t* out = indexOut + indexCount;
+            for (uint32_t i = 0; i < cmd.ElemCount; i++) {
+                const uint32_t vertex = cmd.VtxOffset + indices[i];
+                uint32_t& vertexSlot = vertexSlots[vertex];
+                if (vertexSlot != slot) {
+                    if (vertexSlot != TextureTable::InvalidSlot)
+                        return false;
+                    vertexSlot = slot;
+                }
+                out[i] = vertexBase + vertex;
+            }
+
+            // Texture changes don't split draws, only scissor changes do
+            VkRect2D scissor;
+            scissor.offset.x = (int32_t)clipMinX;
+            scissor.offset.y = (int32_t)clipMinY;
+            scissor.extent.width = (uint32_t)(clipMaxX - clipMinX);
+            scissor.extent.height = (uint32_t)(clipMaxY - clipMinY);
+            if (!draws.empty() && SameRect(draws.back().scissor, scissor))
+                draws.back().indexCount += cmd.ElemCount;
+            else
+                draws.push_back({ scissor, indexCount, cmd.ElemCount });
+            indexCount += cmd.ElemCount;
+            commandCount++;
+        }
+
+        // Vertices of dropped commands are copied too, so the list keeps its offsets
+        const ImDrawVert* vertices = list->VtxBuffer.Data;
+        DrawVertex* out = vertexOut + vertexBase;
+        for (int i = 0; i < list->VtxBuffer.Size; i++) {
+            const uint32_t slot = vertexSlots[(size_t)i];
+            out[i] = { vertices[i].pos, vertices[i].uv, vertices[i].col, slot != TextureTable::InvalidSlot ? slot : 0 };
+        }
+        vertexBase += (uint32_t)list->VtxBuffer.Size;
+    }
+    if (draws.empty())
+        return true;
+
+    // The texture table is bound once, every slot stays reachable for the whole frame
+    VkDescriptorSet textures = textureTable->getDescriptorSet();
+    const VkDeviceSize vertexOffset = 0;
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &textures, 0, nullptr);
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &frame.buffer, &vertexOffset);
+    vkCmdBindIndexBuffer(commandBuffer, frame.buffer, vertexBytes, VK_INDEX_TYPE_UINT32);
+
+    VkViewport viewport = {};
+    viewport.width = fbWidth;
+    viewport.height = fbHeight;
+    viewport.maxDepth = 1.f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    // Scale and translate from ImGui display coordinates into clip space
+    float transform[4];
+    transform[0] = 2.f / drawData->DisplaySize.x;
+    transform[1] = 2.f / drawData->DisplaySize.y;
+    transform[2] = -1.f - drawData->DisplayPos.x * transform[0];
+    transform[3] = -1.f - drawData->DisplayPos.y * transform[1];
+    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(transform), transform);
+
+    for (const MergedDraw& draw : draws) {
+        vkCmdSetScissor(commandBuffer, 0, 1, &draw.scissor);
+        vkCmdDrawIndexed(commandBuffer, draw.indexCount, 1, draw.firstIndex, 0, 0);
+    }
+    drawCallCount = (uint32_t)draws.size();
+    return true;
+}
+
+void DrawBackend::createPipeline(VkRenderPass renderPass)
+{
+#ifdef PRISM_DRAW_SHADERS
+    VkResult err;
+    VkDevice device = renderer->getDevice();
+    VkAllocationCallbacks* allocator = renderer->getAllocator();
+
+    // The texture table, plus the display transform
+    VkDescriptorSetLayout setLayout = textureTable->getSetLayout();
+    VkPushConstantRange pushConstants = {};
+    pushConstants.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstants.size = sizeof(float) * 4;
+    VkPipelineLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pSetLayouts = &setLayout;
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &pushConstants;
+    err = vkCreatePipelineLayout(device, &layoutInfo, allocator, &pipelineLayout);
+    Renderer::CheckVkResult(err);
+
+    VkShaderModule vertexModule = CreateShaderModule(renderer, draw_vert_spv, sizeof(draw_vert_spv));
+    VkShaderModule fragmentModule = CreateShaderModule(renderer, draw_frag_spv, sizeof(draw_frag_spv));
+    VkPipelineShaderStageCreateInfo stages[2] = {};
+    stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    stages[0].module = vertexModule;
+    stages[0].pName = "main";
+    stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    stages[1].module = fragmentModule;
+    stages[1].pName = "main";
+
+    // The ImGui vertex layout, plus the texture slot
+    VkVertexInputBindingDescription binding = {};
+    binding.stride = sizeof(DrawVertex);
+    binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    VkVertexInputAttributeDescription attributes[4] = {};
+    attributes[0] = { 0, 0, VK_FORMAT_R32G32_SFLOAT, (uint32_t)offsetof(DrawVertex, pos) };
+    attributes[1] = { 1, 0, VK_FORMAT_R32G32_SFLOAT, (uint32_t)offsetof(DrawVertex, uv) };
+    attributes[2] = { 2, 0, VK_FORMAT_R8G8B8A8_UNORM, (uint32_t)offsetof(DrawVertex, col) };
+    attributes[3] = { 3, 0, VK_FORMAT_R32_UINT, (uint32_t)offsetof(DrawVertex, texture) };
+    VkPipelineVertexInputStateCreateInfo vertexInfo = {};
+    vertexInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInfo.vertexBindingDescriptionCount = 1;
+    vertexInfo.pVertexBindingDescriptions = &binding;
+    vertexInfo.vertexAttributeDescriptionCount = 4;
+    vertexInfo.pVertexAttributeDescriptions = attributes;
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+    VkPipelineViewportStateCreateInfo viewportInfo = {};
+    viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportInfo.viewportCount = 1;
+    viewportInfo.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterInfo = {};
+    rasterInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterInfo.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterInfo.cullMode = VK_CULL_MODE_NONE;
+    rasterInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rasterInfo.lineWidth = 1.f;
+
+    VkPipelineMultisampleStateCreateInfo multisampleInfo = {};
+    multisampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampleInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkPipelineDepthStencilStateCreateInfo depthInfo = {};
+    depthInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+
+    // Blended the same as the ImGui backend, so both paths look identical
+    VkPipelineColorBlendAttachmentState blendAttachment = {};
+    blendAttachment.blendEnable = VK_TRUE;
+    blendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    blendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    blendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+    blendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    blendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    blendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+    blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    VkPipelineColorBlendStateCreateInfo blendInfo = {};
+    blendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    blendInfo.attachmentCount = 1;
+    blendInfo.pAttachments = &blendAttachment;
+
+    VkDynamicState dynamicStates[2] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+    VkPipelineDynamicStateCreateInfo dynamicInfo = {};
+    dynamicInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicInfo.dynamicStateCount = 2;
+    dynamicInfo.pDynamicStates = dynamicStates;
+
+    VkGraphicsPipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = 2;
+    pipelineInfo.pStages = stages;
+    pipelineInfo.pVertexInputState = &vertexInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pViewportState = &viewportInfo;
+    pipelineInfo.pRasterizationState = &rasterInfo;
+    pipelineInfo.pMultisampleState = &multisampleInfo;
+    pipelineInfo.pDepthStencilState = &depthInfo;
+    pipelineInfo.pColorBlendState = &blendInfo;
+    pipelineInfo.pDynamicState = &dynamicInfo;
+    pipelineInfo.layout = pipelineLayout;
+    pipelineInfo.renderPass = renderPass;
+    err = vkCreateGraphicsPipelines(device, renderer->getPipelineCache(), 1, &pipelineInfo, allocator, &pipeline);
+    Renderer::CheckVkResult(err);
+
+    vkDestroyShaderModule(device, fragmentModule, allocator);
+    vkDestroyShaderModule(device, vertexModule, allocator);
+#else
+    (void)renderPass;
+#endif
+}
+
+void DrawBackend::reserve(FrameBuffer& frame, VkDeviceSize size)
+{
+    if (frame.size >= size)
+        return;
+
+    // Doubling keeps reallocations rare while a UI grows, the old buffer goes through the deletion queue
+    DeletionQueue& deletionQueue = renderer->getDeletionQueue();
+    if (frame.buffer != VK_NULL_HANDLE) {
+        deletionQueue.destroyBuffer(frame.buffer);
+        deletionQueue.freeMemory(frame.allocation);
+    }
+    VkDeviceSize newSize = std::max(frame.size * 2, InitialBufferSize);
+    while (newSize < size)
+        newSize *= 2;
+
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = newSize;
+    bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VkResult err = vkCreateBuffer(renderer->getDevice(), &bufferInfo, renderer->getAllocator(), &frame.buffer);
+    Renderer::CheckVkResult(err);
+
+    // Coherent, so writes need no flush before the submit
+    frame.allocation = renderer->getMemoryAllocator().allocateBuffer(frame.buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    frame.size = newSize;
+}
+
+bool DrawBackend::resolveTextures(const ImDrawData* drawData)
+{
+    // Neighbouring commands mostly share a texture, the table is only asked when the id changes
+    commandSlots.clear();
+    ImTextureID lastId = {};
+    uint32_t lastSlot = TextureTable::InvalidSlot;
+    for (int n = 0; n < drawData->CmdListsCount; n++) {
+        for (const ImDrawCmd& cmd : drawData->CmdLists[n]->CmdBuffer) {
+            if (cmd.UserCallback != nullptr)
+                return false;
+            const ImTextureID id = cmd.GetTexID();
+            if (commandSlots.empty() || id != lastId) {
+                lastId = id;
+                lastSlot = textureTable->find((VkDescriptorSet)id);
+            }
+            if (lastSlot == TextureTable::InvalidSlot)
+                return false;
+            commandSlots.push_back(lastSlot);
+        }
+    }
+    return true;
+}
+
+} // namespace Prism
@@ -0,0 +1,635 @@
+#include "prism/font_atlas.h"
+#include "prism/renderer.h"
+#include "prism/deletion_queue.h"
+#include "prism/upload_queue.h"
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <cfloat>
+#include <fstream>
+#include <fmt/core.h>
+
+#include "imgui.h"
+#include "imgui_internal.h"
+
+#include "prism/embeds/roboto_regular.embed"
+#include "prism/embeds/roboto_italic.embed"
+#include "prism/embeds/roboto_bold.embed"
+
+#ifndef PRISM_EXCLUDE_FA
+#include "prism/embeds/font_awesome.embed"
+#include "prism/fa_embedings.h"
+#endif
+
+namespace Prism {
+
+// On-disk atlas cache layout. Header, atlas uvs, then per font metrics followed by its glyphs, then the pixels.
+struct FontAtlasCacheHeader
+{
+    uint32_t magic;             ///< Always FontAtlasCacheMagic.
+    uint32_t version;           ///< Always FontAtlasCacheVersion.
+    uint32_t imguiVersion;      ///< IMGUI_VERSION_NUM of the writer, ImFontGlyph etc. may change layout.
+    uint32_t fontCount;         ///< Number of fonts in the atlas.
+    uint64_t key;               ///< FontAtlas::computeCacheKey() of the writer.
+    int32_t width;              ///< Width of the atlas in pixels.
+    int32_t height;             ///< Height of the atlas in pixels.
+};
+
+struct FontAtlasCacheFont
+{
+    float fontSize;             ///< ImFont::FontSize.
+    float ascent;               ///< ImFont::Ascent.
+    float descent;              ///< ImFont::Descent.
+    uint32_t fallbackChar;      ///< ImFont::FallbackChar.
+    uint32_t ellipsisChar;      ///< ImFont::EllipsisChar.
+    int32_t metricsTotalSurface;///< ImFont::MetricsTotalSurface.
+    uint32_t glyphCount;        ///< Number of ImFontGlyph following.
+};
+
+static constexpr uint32_t FontAtlasCacheMagic = 0x43415250; // "PRAC"
+static constexpr uint32_t FontAtlasCacheVersion = 1;
+
+// Unchanged rows between two changed runs up to which they're uploaded as one
+static constexpr uint32_t RowMergeGap = 8;
+
+// FNV-1a, only used to detect changes so it doesn't need to be strong
+static uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    return hash;
+}
+
+template<typename T>
+static uint64_t HashValue(uint64_t hash, const T& value)
+{
+    return HashBytes(hash, &value, sizeof(T));
+}
+
+FontAtlas::FontAtlas(Renderer* renderer) :
+    renderer(renderer)
+{
+    atlas = IM_NEW(ImFontAtlas)();
+
+    // Software cursors aren't used, leaving them out keeps the cached atlas free of custom rects
+    atlas->Flags |= ImFontAtlasFlags_NoMouseCursors;
+    addDefaultFonts();
+
+    // Pressure may be reported on any thread, the atlas shrinks on its next build
+    pressureCallbackId = renderer->addMemoryPressureCallback([trimRequested = trimRequested](const MemoryPressure& pressure) {
+        if (pressure.heap.deviceLocal)
+            *trimRequested = true;
+    });
+}
+
+FontAtlas::~FontAtlas()
+{
+    renderer->removeMemoryPressureCallback(pressureCallbackId);
+    destroyTexture();
+    IM_DELETE(atlas);
+    atlas = nullptr;
+}
+
+void FontAtlas::addDefaultFonts()
+{
+    ImFontConfig fontConfig;
+    fontConfig.FontDataOwnedByAtlas = false;
+
+    // Roboto font
+    addFont("default", Fonts::robotoRegular, sizeof(Fonts::robotoRegular), 20.f, &fontConfig);
+
+    // Font awesome, merged into the default font
+#ifndef PRISM_EXCLUDE_FA
+    static const ImWchar faRanges[] = { ICON_MIN_FA, ICON_MAX_FA, 0 };
+    ImFontConfig faConfig;
+    faConfig.FontDataOwnedByAtlas = false;
+    faConfig.MergeMode = true;         // Merge icon font with the default font
+    faConfig.GlyphMinAdvanceX = 20.0f; // Ensure icons are rendered with a similar size as the font
+    faConfig.PixelSnapH = true;        // Align icons on pixel boundaries
+    atlas->AddFontFromMemoryCompressedTTF((void*)Fonts::fontAwesome, sizeof(Fonts::fontAwesome), 20.0f, &faConfig, faRanges);
+#endif
+
+    addFont("bold", Fonts::robotoBold, sizeof(Fonts::robotoBold), 20.0f, &fontConfig);
+    addFont("italic", Fonts::robotoItalic, sizeof(Fonts::robotoItalic), 20.0f, &fontConfig);
+}
+
+ImFont* FontAtlas::addFont(const std::string& name,
+                           const void* data,
+                           int dataSize,
+                           float sizePixels,
+                           const ImFontConfig* config,
+                           const ImWchar* glyphRanges)
+{
+    ImFontConfig fontConfig = config ? *config : ImFontConfig();
+    fontConfig.FontDataOwnedByAtlas = false;
+
+    ImFont* font = atlas->AddFontFromMemoryTTF((void*)data, dataSize, sizePixels, &fontConfig, glyphRanges);
+    if (font)
+        fonts[name] = font;
+    dirty = true;
+    return font;
+}
+
+ImFont* FontAtlas::addDynamicFont(const std::string& name,
+                                  const void* data,
+                                  int dataSize,
+                                  float sizePixels,
+                                  const ImFontConfig* config)
+{
+    // The ranges are pointed at again before every build, the vector may move as glyphs are requested
+    if (dynamicRanges.empty())
+        updateDynamicRanges();
+    const int configIndex = atlas->ConfigData.Size;
+    ImFont* font = addFont(name, data, dataSize, sizePixels, config, dynamicRanges.data());
+    if (atlas->ConfigData.Size > configIndex)
+        dynamicConfigs.push_back(configIndex);
+    return font;
+}
+
+void FontAtlas::requestGlyphs(std::string_view text)
+{
+    const char* it = text.data();
+    const char* end = it + text.size();
+    while (it < end) {
+        unsigned int codepoint = 0;
+        it += ImTextCharFromUtf8(&codepoint, it, end);
+        requestGlyph(codepoint);
+    }
+}
+
+void FontAtlas::requestGlyph(unsigned int codepoint)
+{
+    // The default ranges are always there, and ImWchar might not reach past the BMP
+    if (dynamicConfigs.empty() || codepoint < 0x100 || codepoint > IM_UNICODE_CODEPOINT_MAX)
+        return;
+    auto [it, added] = requestedGlyphs.try_emplace((ImWchar)codepoint, buildCount);
+    it->second = buildCount;
+    if (added)
+        glyphsPending = true;
+}
+
+ImFont* FontAtlas::getFont(const std::string& name) const
+{
+    auto it = fonts.find(name);
+    return it != fonts.end() ? it->second : nullptr;
+}
+
+void FontAtlas::trim()
+{
+    bool shrunk = false;
+    for (ImFontConfig& config : atlas->ConfigData) {
+        shrunk |= config.OversampleH > 1 || config.OversampleV > 1;
+        config.OversampleH = 1;
+        config.OversampleV = 1;
+    }
+    if (!dynamicConfigs.empty() && glyphBudget > MinGlyphBudget) {
+        glyphBudget = std::max(glyphBudget / 2, MinGlyphBudget);
+        shrunk = true;
+    }
+    if (!shrunk)
+        return;
+
+    fmt::print("Prism: Shrinking the font atlas under memory pressure\n");
+    dirty = true;
+}
+
+void FontAtlas::build()
+{
+    if (trimRequested->exchange(false))
+        trim();
+
+    // Every rebuild rasterizes and uploads the whole atlas, so glyphs typed in a burst are batched up
+    const auto now = std::chrono::steady_clock::now();
+    if (glyphsPending && now - lastBuild >= DynamicRebuildInterval)
+        dirty = true;
+    if (!dirty)
+        return;
+    glyphsPending = false;
+    lastBuild = now;
+
+    // Point the dynamic fonts at the glyphs requested so far
+    if (!dynamicConfigs.empty()) {
+        updateDynamicRanges();
+        for (int configIndex : dynamicConfigs)
+            atlas->ConfigData[configIndex].GlyphRanges = dynamicRanges.data();
+    }
+    buildCount++;
+
+    // Try the serialized atlas first, skipping rasterization entirely
+    std::filesystem::path cachePath = getCachePath();
+    std::vector<unsigned char> cachedPixels;
+    int width = 0, height = 0;
+    if (!cachePath.empty() && loadCache(cachePath, cachedPixels, width, height)) {
+        uploadTexture(cachedPixels.data(), width, height);
+    }
+    else {
+        // Rasterize the atlas, only alpha is needed so the texture is a quarter of the RGBA32 size
+        unsigned char* pixels = nullptr;
+        atlas->Build();
+        atlas->GetTexDataAsAlpha8(&pixels, &width, &height);
+
+        // Upload and cache, then drop the CPU copy
+        uploadTexture(pixels, width, height);
+        if (!cachePath.empty())
+            saveCache(cachePath, pixels, width, height);
+        atlas->ClearTexData();
+    }
+
+    atlas->SetTexID((ImTextureID)descriptorSet);
+    dirty = false;
+}
+
+void FontAtlas::updateDynamicRanges()
+{
+    // Past the budget, drop the glyphs that went unused the longest. Glyphs used within the last few builds
+    // are likely still on screen, they stay even if that keeps the atlas over budget.
+    if (requestedGlyphs.size() > glyphBudget) {
+        std::vector<std::pair<uint64_t, ImWchar>> byAge;
+        byAge.reserve(requestedGlyphs.size());
+        for (const auto& [codepoint, lastUsed] : requestedGlyphs)
+            if (lastUsed + UnusedBuildsBeforeEviction <= buildCount)
+                byAge.emplace_back(lastUsed, codepoint);
+        const size_t evictCount = std::min(requestedGlyphs.size() - glyphBudget, byAge.size());
+        std::nth_element(byAge.begin(), byAge.begin() + (ptrdiff_t)evictCount, byAge.end());
+        for (size_t i = 0; i < evictCount; i++)
+            requestedGlyphs.erase(byAge[i].second);
+    }
+
+    // Sorted and merged into ranges, so the same glyphs always give the same ranges (and cache key)
+    std::vector<ImWchar> codepoints;
+    codepoints.reserve(requestedGlyphs.size());
+    for (const auto& [codepoint, lastUsed] : requestedGlyphs)
+        codepoints.push_back(codepoint);
+    std::sort(codepoints.begin(), codepoints.end());
+
+    dynamicRanges.clear();
+    for (const ImWchar* ranges = atlas->GetGlyphRangesDefault(); ranges[0]; ranges += 2) {
+        dynamicRanges.push_back(ranges[0]);
+        dynamicRanges.push_back(ranges[1]);
+    }
+    for (size_t i = 0; i < codepoints.size();) {
+        size_t last = i;
+        while (last + 1 < codepoints.size() && codepoints[last + 1] == codepoints[last] + 1)
+            last++;
+        dynamicRanges.push_back(codepoints[i]);
+        dynamicRanges.push_back(codepoints[last]);
+        i = last + 1;
+    }
+    dynamicRanges.push_back(0);
+}
+
+uint64_t FontAtlas::computeCacheKey() const
+{
+    uint64_t key = 0xcbf29ce484222325ull;
+    key = HashValue(key, FontAtlasCacheVersion);
+    key = HashValue(key, (int)IMGUI_VERSION_NUM);
+#ifdef IMGUI_ENABLE_FREETYPE
+    key = HashValue(key, true);
+#endif
+
+    // Atlas wide settings
+    key = HashValue(key, atlas->Flags);
+    key = HashValue(key, atlas->TexDesiredWidth);
+    key = HashValue(key, atlas->TexGlyphPadding);
+    key = HashValue(key, atlas->Fonts.Size);
+
+    // Everything in the font configs that affects rasterization
+    for (const ImFontConfig& config : atlas->ConfigData) {
+        key = HashBytes(key, config.FontData, (size_t)config.FontDataSize);
+        key = HashValue(key, config.FontDataSize);
+        key = HashValue(key, config.FontNo);
+        key = HashValue(key, config.SizePixels);
+        key = HashValue(key, config.OversampleH);
+        key = HashValue(key, config.OversampleV);
+        key = HashValue(key, config.PixelSnapH);
+        key = HashValue(key, config.GlyphExtraSpacing.x);
+        key = HashValue(key, config.GlyphExtraSpacing.y);
+        key = HashValue(key, config.GlyphOffset.x);
+        key = HashValue(key, config.GlyphOffset.y);
+        key = HashValue(key, config.GlyphMinAdvanceX);
+        key = HashValue(key, config.GlyphMaxAdvanceX);
+        key = HashValue(key, config.MergeMode);
+        key = HashValue(key, config.FontBuilderFlags);
+        key = HashValue(key, config.RasterizerMultiply);
+        key = HashValue(key, config.EllipsisChar);
+        key = HashValue(key, (int)(std::find(atlas->Fonts.begin(), atlas->Fonts.end(), config.DstFont) - atlas->Fonts.begin()));
+
+        // Glyph ranges are zero terminated pairs
+        const ImWchar* ranges = config.GlyphRanges ? config.GlyphRanges : atlas->GetGlyphRangesDefault();
+        for (; ranges[0]; ranges += 2) {
+            key = HashValue(key, ranges[0]);
+            key = HashValue(key, ranges[1]);
+        }
+    }
+
+    return key;
+}
+
+std::filesystem::path FontAtlas::getCachePath() const
+{
+    // Requested glyphs make a new atlas every few rebuilds, unlikely to be seen again, only the static ranges are cached
+    std::filesystem::path cacheDirectory = renderer->getCacheDirectory();
+    if (cacheDirectory.empty() || !requestedGlyphs.empty())
+        return {};
+    return cacheDirectory / fmt::format("font_atlas_{:016x}.bin", computeCacheKey());
+}
+
+bool FontAtlas::loadCache(const std::filesystem::path& path, std::vector<unsigned char>& pixels, int& width, int& height)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    // Validate the header
+    FontAtlasCacheHeader header = {};
+    if (!file.read((char*)&header, sizeof(header)))
+        return false;
+    if (header.magic != FontAtlasCacheMagic
+        || header.version != FontAtlasCacheVersion
+        || header.imguiVersion != (uint32_t)IMGUI_VERSION_NUM
+        || header.key != computeCacheKey()
+        || header.fontCount != (uint32_t)atlas->Fonts.Size
+        || header.width <= 0 || header.height <= 0)
+        return false;
+
+    // Read everything before touching the atlas, so a truncated file leaves it intact
+    ImVec2 texUvScale, texUvWhitePixel;
+    ImVec4 texUvLines[IM_DRAWLIST_TEX_LINES_WIDTH_MAX + 1];
+    file.read((char*)&texUvScale, sizeof(texUvScale));
+    file.read((char*)&texUvWhitePixel, sizeof(texUvWhitePixel));
+    file.read((char*)texUvLines, sizeof(texUvLines));
+
+    std::vector<FontAtlasCacheFont> cachedFonts(header.fontCount);
+    std::vector<std::vector<ImFontGlyph>> cachedGlyphs(header.fontCount);
+    for (uint32_t i = 0; i < header.fontCount && file; i++) {
+        file.read((char*)&cachedFonts[i], sizeof(FontAtlasCacheFont));
+        cachedGlyphs[i].resize(file ? cachedFonts[i].glyphCount : 0);
+        file.read((char*)cachedGlyphs[i].data(), (std::streamsize)(cachedGlyphs[i].size() * sizeof(ImFontGlyph)));
+    }
+
+    pixels.resize((size_t)header.width * (size_t)header.height);
+    if (!file.read((char*)pixels.data(), (std::streamsize)pixels.size()))
+        return false;
+
+    // Restore the atlas as if Build() ran
+    atlas->ClearTexData();
+    atlas->TexWidth = header.width;
+    atlas->TexHeight = header.height;
+    atlas->TexUvScale = texUvScale;
+    atlas->TexUvWhitePixel = texUvWhitePixel;
+    memcpy(atlas->TexUvLines, texUvLines, sizeof(texUvLines));
+
+    for (int i = 0; i < atlas->Fonts.Size; i++) {
+        ImFont* font = atlas->Fonts[i];
+        const FontAtlasCacheFont& cached = cachedFonts[(size_t)i];
+        font->ClearOutputData();
+
+        // Link the font to its configs, the first one is the font itself, the rest are merged in
+        font->ConfigData = nullptr;
+        font->ConfigDataCount = 0;
+        for (const ImFontConfig& config : atlas->ConfigData) {
+            if (config.DstFont != font)
+                continue;
+            if (!font->ConfigData)
+                font->ConfigData = &config;
+            font->ConfigDataCount++;
+        }
+
+        font->ContainerAtlas = atlas;
+        font->FontSize = cached.fontSize;
+        font->Ascent = cached.ascent;
+        font->Descent = cached.descent;
+        font->FallbackChar = (ImWchar)cached.fallbackChar;
+        font->EllipsisChar = (ImWchar)cached.ellipsisChar;
+        font->MetricsTotalSurface = cached.metricsTotalSurface;
+        font->Glyphs.resize((int)cachedGlyphs[(size_t)i].size());
+        if (!cachedGlyphs[(size_t)i].empty())
+            memcpy(font->Glyphs.Data, cachedGlyphs[(size_t)i].data(), cachedGlyphs[(size_t)i].size() * sizeof(ImFontGlyph));
+        font->BuildLookupTable();
+    }
+
+    width = header.width;
+    height = header.height;
+    atlas->TexReady = true;
+    return true;
+}
+
+void FontAtlas::saveCache(const std::filesystem::path& path, const unsigned char* pixels, int width, int height) const
+{
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+    if (ec) return;
+
+    // Write to a unique temporary file and swap it in, other instances may be reading or writing too
+    std::filesystem::path tempPath = path;
+    tempPath += fmt::format(".{}.tmp", std::chrono::steady_clock::now().time_since_epoch().count());
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        FontAtlasCacheHeader header = {};
+        header.magic = FontAtlasCacheMagic;
+        header.version = FontAtlasCacheVersion;
+        header.imguiVersion = (uint32_t)IMGUI_VERSION_NUM;
+        header.fontCount = (uint32_t)atlas->Fonts.Size;
+        header.key = computeCacheKey();
+        header.width = width;
+        header.height = height;
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)&atlas->TexUvScale, sizeof(atlas->TexUvScale));
+        file.write((const char*)&atlas->TexUvWhitePixel, sizeof(atlas->TexUvWhitePixel));
+        file.write((const char*)atlas->TexUvLines, sizeof(atlas->TexUvLines));
+
+        for (const ImFont* font : atlas->Fonts) {
+            FontAtlasCacheFont cached = {};
+            cached.fontSize = font->FontSize;
+            cached.ascent = font->Ascent;
+            cached.descent = font->Descent;
+            cached.fallbackChar = (uint32_t)font->FallbackChar;
+            cached.ellipsisChar = (uint32_t)font->EllipsisChar;
+            cached.metricsTotalSurface = font->MetricsTotalSurface;
+            cached.glyphCount = (uint32_t)font->Glyphs.Size;
+            file.write((const char*)&cached, sizeof(cached));
+            file.write((const char*)font->Glyphs.Data, (std::streamsize)(font->Glyphs.Size * sizeof(ImFontGlyph)));
+        }
+
+        file.write((const char*)pixels, (std::streamsize)width * height);
+        if (!file.good()) {
+            file.close();
+            std::filesystem::remove(tempPath, ec);
+            return;
+        }
+    }
+
+    std::filesystem::rename(tempPath, path, ec);
+    if (ec) {
+        fmt::print("Prism: Failed to write font atlas cache {}: {}\n", path.string(), ec.message());
+        std::filesystem::remove(tempPath, ec);
+        return;
+    }
+    PruneCache(path);
+}
+
+void FontAtlas::PruneCache(const std::filesystem::path& keep)
+{
+    // Only finished files are removed, temporary ones may belong to another instance still writing
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(keep.parent_path(), ec)) {
+        const std::string name = entry.path().filename().string();
+        if (entry.path().filename() == keep.filename() || !name.starts_with("font_atlas_") || entry.path().extension() != ".bin")
+            continue;
+        std::error_code removeError;
+        std::filesystem::remove(entry.path(), removeError);
+    }
+}
+
+void FontAtlas::uploadTexture(const unsigned char* pixels, int width, int height)
+{
+    VkResult err;
+    VkDevice device = renderer->getDevice();
+    VkAllocationCallbacks* allocator = renderer->getAllocator();
+
+    // Row hashes find the rows a rebuild changed, glyph rects mostly pack where they were before
+    std::vector<uint64_t> hashes((size_t)height);
+    for (int y = 0; y < height; y++)
+        hashes[(size_t)y] = HashBytes(0xcbf29ce484222325ull, pixels + (size_t)y * (size_t)width, (size_t)width);
+
+    // At the same size, rewrite only the changed rows in place. On the graphics queue, frames submitted
+    // earlier finish sampling before the copy, a dedicated transfer queue isn't ordered with them.
+    if (image != VK_NULL_HANDLE && (uint32_t)width == imageWidth && (uint32_t)height == imageHeight && !renderer->hasTransferQueue()) {
+        uint32_t runStart = UINT32_MAX;
+        uint32_t lastChanged = 0;
+        for (uint32_t y = 0; y <= imageHeight; y++) {
+            if (y < imageHeight && hashes[y] != rowHashes[y]) {
+                if (runStart == UINT32_MAX)
+                    runStart = y;
+                lastChanged = y;
+                continue;
+            }
+
+            // Runs separated by a few unchanged rows go up together, rather than as many tiny copies
+            if (runStart == UINT32_MAX || (y < imageHeight && y - lastChanged < RowMergeGap))
+                continue;
+            const uint32_t rows = lastChanged + 1 - runStart;
+            uploadSerial = renderer->getUploadQueue().uploadImageRegion(image, { 0, (int32_t)runStart }, { imageWidth, rows },
+                pixels + (size_t)runStart * imageWidth, (VkDeviceSize)rows * imageWidth);
+            runStart = UINT32_MAX;
+        }
+        rowHashes = std::move(hashes);
+        return;
+    }
+
+    // The old image may still be referenced by frames in flight, the deletion queue waits for them
+    destroyImage();
+    imageWidth = (uint32_t)width;
+    imageHeight = (uint32_t)height;
+    rowHashes = std::move(hashes);
+
+    // Create the image, shared with the transfer queue family if uploads run on one
+    const uint32_t queueFamilies[] = { renderer->getQueueFamilyIndex(), renderer->getTransferQueueFamilyIndex() };
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = VK_FORMAT_R8_UNORM;
+    imageInfo.extent.width = (uint32_t)width;
+    imageInfo.extent.height = (uint32_t)height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    if (renderer->hasTransferQueue()) {
+        imageInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        imageInfo.queueFamilyIndexCount = 2;
+        imageInfo.pQueueFamilyIndices = queueFamilies;
+    }
+    else {
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    err = vkCreateImage(device, &imageInfo, allocator, &image);
+    Renderer::CheckVkResult(err);
+
+    imageAllocation = renderer->getMemoryAllocator().allocateImage(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::FontAtlas);
+
+    // Create the image view, swizzled so the shader sees white with the glyph coverage as alpha
+    VkImageViewCreateInfo viewInfo = {};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = VK_FORMAT_R8_UNORM;
+    viewInfo.components = { VK_COMPONENT_SWIZZLE_ONE, VK_COMPONENT_SWIZZLE_ONE, VK_COMPONENT_SWIZZLE_ONE, VK_COMPONENT_SWIZZLE_R };
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.layerCount = 1;
+    err = vkCreateImageView(device, &viewInfo, allocator, &imageView);
+    Renderer::CheckVkResult(err);
+
+    // Create the sampler once, matching the ImGui backend's font sampler
+    if (sampler == VK_NULL_HANDLE) {
+        VkSamplerCreateInfo samplerInfo = {};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_LINEAR;
+        samplerInfo.minFilter = VK_FILTER_LINEAR;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.minLod = -1000;
+        samplerInfo.maxLod = 1000;
+        samplerInfo.maxAnisotropy = 1.0f;
+        err = vkCreateSampler(device, &samplerInfo, allocator, &sampler);
+        Renderer::CheckVkResult(err);
+    }
+
+    // Allocate the descriptor set used as the ImGui texture id
+    descriptorSet = renderer->allocateTextureDescriptor(sampler, imageView);
+
+    // Kick off the upload, frames sampling the atlas wait for it in waitForUpload()
+    const VkDeviceSize uploadSize = (VkDeviceSize)width * (VkDeviceSize)height;
+    uploadSerial = renderer->getUploadQueue().uploadImage(image, (uint32_t)width, (uint32_t)height, pixels, uploadSize);
+}
+
+void FontAtlas::waitForUpload()
+{
+    if (renderer->hasTransferQueue())
+        renderer->getUploadQueue().wait(uploadSerial);
+}
+
+double FontAtlas::getTimeUntilRebuild() const
+{
+    if (dirty || *trimRequested)
+        return 0.0;
+    if (!glyphsPending)
+        return DBL_MAX;
+    const auto due = lastBuild + DynamicRebuildInterval;
+    return std::max(std::chrono::duration<double>(due - std::chrono::steady_clock::now()).count(), 0.0);
+}
+
+void FontAtlas::destroyImage()
+{
+    // The upload writes the image until it completes, frames drawing it are waited on by the deletion queue
+    renderer->getUploadQueue().wait(uploadSerial);
+    uploadSerial = 0;
+
+    DeletionQueue& deletionQueue = renderer->getDeletionQueue();
+    deletionQueue.freeDescriptorSet(descriptorSet);
+    deletionQueue.destroyImageView(imageView);
+    deletionQueue.destroyImage(image);
+    deletionQueue.freeMemory(imageAllocation);
+    descriptorSet = VK_NULL_HANDLE;
+    imageView = VK_NULL_HANDLE;
+    image = VK_NULL_HANDLE;
+    imageWidth = 0;
+    imageHeight = 0;
+    rowHashes.clear();
+}
+
+void FontAtlas::destroyTexture()
+{
+    destroyImage();
+    renderer->getDeletionQueue().destroySampler(sampler);
+    sampler = VK_NULL_HANDLE;
+}
+
+} // namespace Prism
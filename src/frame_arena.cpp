@@ -0,0 +1,58 @@
+#include "prism/frame_arena.h"
+#include <algorithm>
+
+namespace Prism {
+
+FrameArena::FrameArena(size_t blockSize) :
+    defaultBlockSize(std::max<size_t>(blockSize, 256))
+{
+}
+
+void* FrameArena::allocate(size_t size, size_t alignment)
+{
+    // Bump within the last block if it fits
+    if (!blocks.empty()) {
+        Block& block = blocks.back();
+        const uintptr_t base = (uintptr_t)block.data.get();
+        const size_t aligned = ((base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+        if (aligned + size <= block.size) {
+            used += aligned + size - offset;
+            offset = aligned + size;
+            return block.data.get() + aligned;
+        }
+    }
+
+    // Chain on a block at least twice the last, so a growing frame only needs a few
+    const size_t lastSize = blocks.empty() ? defaultBlockSize / 2 : blocks.back().size;
+    Block block;
+    block.size = std::max(lastSize * 2, size + alignment);
+    block.data = std::make_unique<std::byte[]>(block.size);
+    blocks.push_back(std::move(block));
+    offset = 0;
+    return allocate(size, alignment);
+}
+
+void FrameArena::reset()
+{
+    // A frame that outgrew the first block gets a single block sized for all of it next time
+    if (blocks.size() > 1) {
+        const size_t capacity = getCapacity();
+        blocks.clear();
+        Block block;
+        block.size = capacity;
+        block.data = std::make_unique<std::byte[]>(block.size);
+        blocks.push_back(std::move(block));
+    }
+    offset = 0;
+    used = 0;
+}
+
+size_t FrameArena::getCapacity() const
+{
+    size_t capacity = 0;
+    for (const Block& block : blocks)
+        capacity += block.size;
+    return capacity;
+}
+
+} // namespace Prism
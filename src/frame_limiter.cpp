@@ -0,0 +1,95 @@
+#include "prism/frame_limiter.h"
+#include <thread>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+namespace Prism {
+
+// The last stretch before a deadline is yielded through rather than slept, OS sleeps overshoot
+static constexpr std::chrono::microseconds SleepSpinThreshold(500);
+
+#ifdef _WIN32
+// One high resolution waitable timer per thread, created on first use
+struct WaitableTimer
+{
+    HANDLE handle = nullptr;
+
+    WaitableTimer()
+    {
+        // CREATE_WAITABLE_TIMER_HIGH_RESOLUTION needs Windows 10 1803, fall back to a regular timer
+#ifdef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+        handle = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+#endif
+        if (!handle)
+            handle = CreateWaitableTimerW(nullptr, TRUE, nullptr);
+    }
+
+    ~WaitableTimer()
+    {
+        if (handle)
+            CloseHandle(handle);
+    }
+};
+#endif
+
+void FrameLimiter::setFrameRate(float fps)
+{
+    intervalNs = fps > 0.f ? (int64_t)(1e9 / (double)fps) : 0;
+}
+
+bool FrameLimiter::isDue() const
+{
+    return intervalNs <= 0 || Clock::now() >= nextDeadline;
+}
+
+void FrameLimiter::markFrame()
+{
+    const int64_t interval = intervalNs;
+    if (interval <= 0)
+        return;
+
+    // Advance from the previous deadline to avoid drift, but don't try to catch up on long stalls
+    const Clock::time_point now = Clock::now();
+    nextDeadline += std::chrono::nanoseconds(interval);
+    if (nextDeadline < now - std::chrono::nanoseconds(interval))
+        nextDeadline = now;
+}
+
+void FrameLimiter::wait()
+{
+    if (intervalNs <= 0)
+        return;
+    SleepUntil(nextDeadline);
+    markFrame();
+}
+
+void FrameLimiter::SleepUntil(Clock::time_point deadline)
+{
+    // Coarse sleep until shortly before the deadline
+    const Clock::time_point coarseDeadline = deadline - SleepSpinThreshold;
+    if (Clock::now() < coarseDeadline) {
+#ifdef _WIN32
+        thread_local WaitableTimer timer;
+        if (timer.handle) {
+            // Relative due time in 100ns units
+            LARGE_INTEGER dueTime;
+            dueTime.QuadPart = -std::chrono::duration_cast<std::chrono::nanoseconds>(coarseDeadline - Clock::now()).count() / 100;
+            if (dueTime.QuadPart < 0 && SetWaitableTimer(timer.handle, &dueTime, 0, nullptr, nullptr, FALSE))
+                WaitForSingleObject(timer.handle, INFINITE);
+        }
+        else {
+            std::this_thread::sleep_until(coarseDeadline);
+        }
+#else
+        std::this_thread::sleep_until(coarseDeadline);
+#endif
+    }
+
+    // Then yield through the rest
+    while (Clock::now() < deadline)
+        std::this_thread::yield();
+}
+
+} // namespace Prism
@@ -0,0 +1,250 @@
+#include "prism/frame_profiler.h"
+#include "prism/renderer.h"
+#include <algorithm>
+#include <cfloat>
+
+#include "imgui.h"
+
+namespace Prism {
+
+using Milliseconds = std::chrono::duration<double, std::milli>;
+
+FrameProfiler::Scope::Scope(FrameProfiler* profiler, ProfileScope scope) :
+    profiler(profiler && profiler->isEnabled() ? profiler : nullptr),
+    scope(scope)
+{
+    if (this->profiler)
+        start = Clock::now();
+}
+
+FrameProfiler::Scope::~Scope()
+{
+    if (profiler)
+        profiler->addCpuTime(scope, Milliseconds(Clock::now() - start).count());
+}
+
+FrameProfiler::~FrameProfiler()
+{
+    destroyQueryPool();
+}
+
+void FrameProfiler::createQueryPool(Renderer* renderer, uint32_t frameCount)
+{
+    destroyQueryPool();
+
+    // Check timestamps are supported on the queue we render on
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(renderer->getPhysicalDevice(), &properties);
+    uint32_t queueCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(renderer->getPhysicalDevice(), &queueCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueProps(queueCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(renderer->getPhysicalDevice(), &queueCount, queueProps.data());
+
+    const uint32_t validBits = queueProps[renderer->getQueueFamilyIndex()].timestampValidBits;
+    if (validBits == 0 || properties.limits.timestampPeriod <= 0.f)
+        return;
+
+    device = renderer->getDevice();
+    allocator = renderer->getAllocator();
+    timestampPeriod = properties.limits.timestampPeriod;
+    timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    // Two timestamps per frame in flight, each slot reads back its own pair once its fence signaled
+    VkQueryPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = frameCount * 2;
+    VkResult err = vkCreateQueryPool(device, &poolInfo, allocator, &queryPool);
+    Renderer::CheckVkResult(err);
+    queryFrameNumbers.assign(frameCount, 0);
+}
+
+void FrameProfiler::destroyQueryPool()
+{
+    if (queryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(device, queryPool, allocator);
+        queryPool = VK_NULL_HANDLE;
+    }
+    queryFrameNumbers.clear();
+}
+
+void FrameProfiler::beginFrame()
+{
+    if (!enabled)
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    const Clock::time_point now = Clock::now();
+
+    // Push the previous frame into the history
+    if (current.frameNumber != 0) {
+        current.frameTime = Milliseconds(now - frameStart).count();
+        history[historyHead] = current;
+        historyHead = (historyHead + 1) % HistorySize;
+        historyCount = std::min(historyCount + 1, HistorySize);
+    }
+
+    // Start the new one
+    const uint64_t frameNumber = current.frameNumber + 1;
+    current = FrameTimings();
+    current.frameNumber = frameNumber;
+    frameStart = now;
+}
+
+void FrameProfiler::addCpuTime(ProfileScope scope, double milliseconds)
+{
+    if (!enabled)
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    current.cpu[(size_t)scope] += milliseconds;
+}
+
+void FrameProfiler::writeGpuBegin(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+{
+    if (!enabled || queryPool == VK_NULL_HANDLE || frameIndex >= queryFrameNumbers.size())
+        return;
+
+    vkCmdResetQueryPool(commandBuffer, queryPool, frameIndex * 2, 2);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, frameIndex * 2);
+}
+
+void FrameProfiler::writeGpuEnd(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+{
+    if (!enabled || queryPool == VK_NULL_HANDLE || frameIndex >= queryFrameNumbers.size())
+        return;
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, frameIndex * 2 + 1);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    queryFrameNumbers[frameIndex] = current.frameNumber;
+}
+
+void FrameProfiler::collectGpuTimings(uint32_t frameIndex)
+{
+    if (queryPool == VK_NULL_HANDLE || frameIndex >= queryFrameNumbers.size())
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    const uint64_t frameNumber = queryFrameNumbers[frameIndex];
+    if (frameNumber == 0)
+        return;
+    queryFrameNumbers[frameIndex] = 0;
+
+    // The fence was waited on, so the results are available without waiting
+    uint64_t timestamps[2] = {};
+    VkResult err = vkGetQueryPoolResults(device, queryPool, frameIndex * 2, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if (err != VK_SUCCESS)
+        return;
+    const double gpuTime = (double)((timestamps[1] - timestamps[0]) & timestampMask) * timestampPeriod / 1e6;
+
+    // Attribute it to the frame that recorded it
+    if (current.frameNumber == frameNumber) {
+        current.gpuTime = gpuTime;
+        return;
+    }
+    for (size_t i = 0; i < historyCount; i++) {
+        FrameTimings& frame = history[(historyHead + HistorySize - 1 - i) % HistorySize];
+        if (frame.frameNumber == frameNumber) {
+            frame.gpuTime = gpuTime;
+            break;
+        }
+    }
+}
+
+std::vector<FrameTimings> FrameProfiler::getHistory() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<FrameTimings> frames;
+    frames.reserve(historyCount);
+    for (size_t i = 0; i < historyCount; i++)
+        frames.push_back(history[(historyHead + HistorySize - historyCount + i) % HistorySize]);
+    return frames;
+}
+
+FrameTimings FrameProfiler::getLatest() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (historyCount == 0)
+        return FrameTimings();
+    return history[(historyHead + HistorySize - 1) % HistorySize];
+}
+
+FrameTimings FrameProfiler::getAverage() const
+{
+    std::vector<FrameTimings> frames = getHistory();
+    FrameTimings average;
+    if (frames.empty())
+        return average;
+
+    size_t gpuFrames = 0;
+    double gpuTotal = 0.0;
+    for (const FrameTimings& frame : frames) {
+        average.frameTime += frame.frameTime;
+        for (size_t i = 0; i < frame.cpu.size(); i++)
+            average.cpu[i] += frame.cpu[i];
+        if (frame.gpuTime >= 0.0) {
+            gpuTotal += frame.gpuTime;
+            gpuFrames++;
+        }
+    }
+
+    average.frameNumber = frames.back().frameNumber;
+    average.frameTime /= (double)frames.size();
+    for (double& time : average.cpu)
+        time /= (double)frames.size();
+    average.gpuTime = gpuFrames ? gpuTotal / (double)gpuFrames : -1.0;
+    return average;
+}
+
+void FrameProfiler::drawOverlay()
+{
+    if (!overlayVisible || !enabled)
+        return;
+
+    std::vector<FrameTimings> frames = getHistory();
+    FrameTimings average = getAverage();
+
+    // Frame time graph
+    std::vector<float> frameTimes(frames.size());
+    for (size_t i = 0; i < frames.size(); i++)
+        frameTimes[i] = (float)frames[i].frameTime;
+
+    // Pin the overlay to the top right of the window
+    const ImGuiViewport* viewport = ImGui::GetMainViewport();
+    ImGui::SetNextWindowPos(ImVec2(viewport->WorkPos.x + viewport->WorkSize.x - 10.f, viewport->WorkPos.y + 10.f), ImGuiCond_Always, ImVec2(1.f, 0.f));
+    ImGui::SetNextWindowBgAlpha(0.75f);
+    const ImGuiWindowFlags flags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoSavedSettings
+        | ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav | ImGuiWindowFlags_NoInputs;
+    if (ImGui::Begin("##PrismProfiler", nullptr, flags)) {
+        ImGui::Text("Frame %.2f ms (%.0f fps)", average.frameTime, average.frameTime > 0.0 ? 1000.0 / average.frameTime : 0.0);
+        ImGui::PlotLines("##FrameTimes", frameTimes.data(), (int)frameTimes.size(), 0, nullptr, 0.f, FLT_MAX, ImVec2(240.f, 40.f));
+        ImGui::Separator();
+        for (size_t i = 0; i < (size_t)ProfileScope::Count; i++)
+            ImGui::Text("%-12s %6.2f ms", GetScopeName((ProfileScope)i), average.cpu[i]);
+        ImGui::Separator();
+        if (average.gpuTime >= 0.0)
+            ImGui::Text("%-12s %6.2f ms", "GPU", average.gpuTime);
+        else
+            ImGui::TextDisabled("GPU timestamps unavailable");
+    }
+    ImGui::End();
+}
+
+const char* FrameProfiler::GetScopeName(ProfileScope scope)
+{
+    switch (scope) {
+        case ProfileScope::Events:      return "Events";
+        case ProfileScope::Update:      return "Update";
+        case ProfileScope::Render:      return "Render";
+        case ProfileScope::ImGuiRender: return "ImGui";
+        case ProfileScope::Acquire:     return "Acquire";
+        case ProfileScope::FenceWait:   return "Fence wait";
+        case ProfileScope::Record:      return "Record";
+        case ProfileScope::Submit:      return "Submit";
+        case ProfileScope::Present:     return "Present";
+        default:                        return "Unknown";
+    }
+}
+
+} // namespace Prism
@@ -0,0 +1,18 @@
+#include "prism/input_queue.h"
+
+namespace Prism {
+
+bool InputQueue::push(const InputEvent& event)
+{
+    // The consumer only ever frees slots, so a stale tail just looks fuller than it is
+    const uint32_t write = head.load(std::memory_order_relaxed);
+    if (write - tail.load(std::memory_order_acquire) >= Capacity) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    events[write & (Capacity - 1)] = event;
+    head.store(write + 1, std::memory_order_release);
+    return true;
+}
+
+} // namespace Prism
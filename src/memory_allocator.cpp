@@ -0,0 +1,418 @@
+#include "prism/memory_allocator.h"
+#include "prism/renderer.h"
+#include <algorithm>
+
+namespace Prism {
+
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+}
+
+MemoryAllocator::MemoryAllocator(Renderer* renderer, VkDeviceSize blockSize) :
+    renderer(renderer)
+{
+    vkGetPhysicalDeviceMemoryProperties(renderer->getPhysicalDevice(), &memoryProperties);
+
+    // Small heaps (e.g. the host visible BAR window) get smaller blocks, so one block can't eat the whole heap
+    pools.resize(memoryProperties.memoryTypeCount * 2);
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        const VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[i].heapIndex].size;
+        const VkDeviceSize typeBlockSize = std::max<VkDeviceSize>(std::min(blockSize, heapSize / 8), 1);
+        pools[i * 2 + 0].blockSize = typeBlockSize;
+        pools[i * 2 + 1].blockSize = typeBlockSize;
+    }
+    dedicatedBytesPerType.resize(memoryProperties.memoryTypeCount, 0);
+}
+
+MemoryAllocator::~MemoryAllocator()
+{
+    VkDevice device = renderer->getDevice();
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Anything still allocated is leaked by its owner, its block goes regardless
+    for (Pool& pool : pools) {
+        for (auto& block : pool.blocks) {
+            if (block->allocationCount > 0)
+                fmt::print("Prism: Freeing memory block with {} live allocations\n", block->allocationCount);
+            vkFreeMemory(device, block->memory, renderer->getAllocator());
+        }
+        pool.blocks.clear();
+    }
+    if (dedicatedCount > 0)
+        fmt::print("Prism: {} dedicated allocations were never freed\n", dedicatedCount);
+}
+
+MemoryAllocation MemoryAllocator::allocate(const VkMemoryRequirements& requirements,
+                                           VkMemoryPropertyFlags properties,
+                                           ResourceKind kind,
+                                           MemoryCategory category,
+                                           bool dedicated)
+{
+    MemoryAllocation allocation;
+    const uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+    bool allocated = tryAllocate(requirements, memoryType, kind, dedicated, allocation);
+
+    // Out of memory, give the pressure callbacks a chance to free some and retry
+    if (!allocated) {
+        MemoryPressure pressure;
+        pressure.heapIndex = memoryProperties.memoryTypes[memoryType].heapIndex;
+        pressure.requestedBytes = requirements.size;
+        pressure.heap = renderer->getMemoryBudget(pressure.heapIndex);
+        pressure.allocationFailed = true;
+        renderer->notifyMemoryPressure(pressure);
+        allocated = tryAllocate(requirements, memoryType, kind, dedicated, allocation);
+    }
+
+    // A whole block may not fit where the resource alone still does
+    if (!allocated && !dedicated)
+        allocated = tryAllocate(requirements, memoryType, kind, true, allocation);
+
+    // Slower system memory beats aborting
+    if (!allocated) {
+        const uint32_t fallbackType = findFallbackMemoryType(requirements.memoryTypeBits, properties, memoryType);
+        if (fallbackType != UINT32_MAX) {
+            fmt::print("Prism: Out of device memory, falling back to system memory\n");
+            allocated = tryAllocate(requirements, fallbackType, kind, dedicated, allocation);
+        }
+    }
+
+    if (!allocated) {
+        fmt::print("Error: Out of memory allocating {} bytes\n", requirements.size);
+        abort();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    allocation.category = category;
+    categoryBytes[(size_t)category] += allocation.size;
+    return allocation;
+}
+
+bool MemoryAllocator::tryAllocate(const VkMemoryRequirements& requirements,
+                                  uint32_t memoryType,
+                                  ResourceKind kind,
+                                  bool dedicated,
+                                  MemoryAllocation& allocation)
+{
+    allocation = MemoryAllocation();
+    allocation.memoryType = memoryType;
+    allocation.size = requirements.size;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    Pool& pool = pools[memoryType * 2 + (kind == ResourceKind::Image ? 1 : 0)];
+
+    // First fit in the existing blocks
+    auto fitInBlocks = [&]() {
+        for (auto& candidate : pool.blocks) {
+            VkDeviceSize offset = 0;
+            if (candidate->size - candidate->usedBytes >= requirements.size && AllocateFromBlock(*candidate, requirements.size, requirements.alignment, offset)) {
+                candidate->usedBytes += requirements.size;
+                candidate->allocationCount++;
+                allocation.memory = candidate->memory;
+                allocation.offset = offset;
+                allocation.mapped = candidate->mapped ? candidate->mapped + offset : nullptr;
+                allocation.block = candidate.get();
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // Large resources get memory of their own, they'd only fragment the blocks
+    const bool useDedicated = dedicated || requirements.size >= pool.blockSize / 2;
+    if (!useDedicated && fitInBlocks())
+        return true;
+
+    // Going to the driver, callbacks may free memory first so the lock can't be held
+    lock.unlock();
+    checkBudget(memoryType, useDedicated ? requirements.size : pool.blockSize);
+    lock.lock();
+
+    if (useDedicated) {
+        allocation.memory = allocateDeviceMemory(requirements.size, memoryType, &allocation.mapped);
+        if (allocation.memory == VK_NULL_HANDLE)
+            return false;
+        dedicatedCount++;
+        dedicatedBytes += requirements.size;
+        dedicatedBytesPerType[memoryType] += requirements.size;
+        return true;
+    }
+
+    // Another thread may have added a block meanwhile
+    if (fitInBlocks())
+        return true;
+
+    // No room anywhere, add a block
+    auto newBlock = std::make_unique<MemoryBlock>();
+    void* mapped = nullptr;
+    newBlock->size = pool.blockSize;
+    newBlock->memory = allocateDeviceMemory(pool.blockSize, memoryType, &mapped);
+    if (newBlock->memory == VK_NULL_HANDLE)
+        return false;
+    newBlock->mapped = (uint8_t*)mapped;
+    newBlock->freeRanges[0] = pool.blockSize;
+    pool.blocks.push_back(std::move(newBlock));
+    return fitInBlocks();
+}
+
+void MemoryAllocator::checkBudget(uint32_t memoryType, VkDeviceSize size)
+{
+    MemoryPressure pressure;
+    pressure.heapIndex = memoryProperties.memoryTypes[memoryType].heapIndex;
+    pressure.requestedBytes = size;
+    pressure.heap = renderer->getMemoryBudget(pressure.heapIndex);
+    if (pressure.heap.budget == 0 || (double)(pressure.heap.usage + size) <= (double)pressure.heap.budget * PressureThreshold)
+        return;
+    renderer->notifyMemoryPressure(pressure);
+}
+
+MemoryAllocation MemoryAllocator::allocateBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties, MemoryCategory category)
+{
+    VkDevice device = renderer->getDevice();
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device, buffer, &requirements);
+
+    MemoryAllocation allocation = allocate(requirements, properties, ResourceKind::Buffer, category);
+    VkResult err = vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset);
+    Renderer::CheckVkResult(err);
+    return allocation;
+}
+
+MemoryAllocation MemoryAllocator::allocateImage(VkImage image, VkMemoryPropertyFlags properties, MemoryCategory category)
+{
+    VkDevice device = renderer->getDevice();
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(device, image, &requirements);
+
+    MemoryAllocation allocation = allocate(requirements, properties, ResourceKind::Image, category);
+    VkResult err = vkBindImageMemory(device, image, allocation.memory, allocation.offset);
+    Renderer::CheckVkResult(err);
+    return allocation;
+}
+
+void MemoryAllocator::free(MemoryAllocation& allocation)
+{
+    if (!allocation)
+        return;
+
+    VkDevice device = renderer->getDevice();
+    std::lock_guard<std::mutex> lock(mutex);
+    categoryBytes[(size_t)allocation.category] -= allocation.size;
+
+    if (allocation.isDedicated()) {
+        vkFreeMemory(device, allocation.memory, renderer->getAllocator());
+        dedicatedCount--;
+        dedicatedBytes -= allocation.size;
+        dedicatedBytesPerType[allocation.memoryType] -= allocation.size;
+        allocation = MemoryAllocation();
+        return;
+    }
+
+    MemoryBlock* block = allocation.block;
+    FreeToBlock(*block, allocation.offset, allocation.size);
+    block->usedBytes -= allocation.size;
+    block->allocationCount--;
+
+    // Release empty blocks, but keep one per pool around so alternating alloc/free doesn't hit the driver
+    if (block->allocationCount == 0) {
+        for (Pool& pool : pools) {
+            auto it = std::find_if(pool.blocks.begin(), pool.blocks.end(), [block](const auto& b) { return b.get() == block; });
+            if (it == pool.blocks.end())
+                continue;
+            const bool hasOtherEmpty = std::any_of(pool.blocks.begin(), pool.blocks.end(), [block](const auto& b) { return b.get() != block && b->allocationCount == 0; });
+            if (pool.blocks.size() > 1 && hasOtherEmpty) {
+                vkFreeMemory(device, block->memory, renderer->getAllocator());
+                pool.blocks.erase(it);
+            }
+            break;
+        }
+    }
+
+    allocation = MemoryAllocation();
+}
+
+void MemoryAllocator::trim()
+{
+    VkDevice device = renderer->getDevice();
+    std::lock_guard<std::mutex> lock(mutex);
+
+    size_t freedBlocks = 0;
+    for (Pool& pool : pools) {
+        auto it = std::remove_if(pool.blocks.begin(), pool.blocks.end(), [&](const auto& block) {
+            if (block->allocationCount > 0)
+                return false;
+            vkFreeMemory(device, block->memory, renderer->getAllocator());
+            freedBlocks++;
+            return true;
+        });
+        pool.blocks.erase(it, pool.blocks.end());
+    }
+    if (freedBlocks > 0)
+        fmt::print("Prism: Freed {} empty memory blocks\n", freedBlocks);
+}
+
+void MemoryAllocator::addExternalBytes(MemoryCategory category, VkDeviceSize bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    categoryBytes[(size_t)category] += bytes;
+}
+
+void MemoryAllocator::removeExternalBytes(MemoryCategory category, VkDeviceSize bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    categoryBytes[(size_t)category] -= std::min(bytes, categoryBytes[(size_t)category]);
+}
+
+VkDeviceSize MemoryAllocator::getCategoryBytes(MemoryCategory category) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return category < MemoryCategory::Count ? categoryBytes[(size_t)category] : 0;
+}
+
+VkDeviceSize MemoryAllocator::getHeapBytes(uint32_t heapIndex) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    VkDeviceSize bytes = 0;
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        if (memoryProperties.memoryTypes[i].heapIndex != heapIndex)
+            continue;
+        for (int kind = 0; kind < 2; kind++)
+            for (const auto& block : pools[i * 2 + kind].blocks)
+                bytes += block->size;
+        bytes += dedicatedBytesPerType[i];
+    }
+    return bytes;
+}
+
+MemoryStats MemoryAllocator::getStats(uint32_t memoryType) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    MemoryStats stats;
+    if (memoryType >= memoryProperties.memoryTypeCount)
+        return stats;
+
+    for (int kind = 0; kind < 2; kind++) {
+        for (const auto& block : pools[memoryType * 2 + kind].blocks) {
+            stats.blockCount++;
+            stats.allocationCount += block->allocationCount;
+            stats.blockBytes += block->size;
+            stats.usedBytes += block->usedBytes;
+        }
+    }
+    stats.dedicatedBytes = dedicatedBytesPerType[memoryType];
+    return stats;
+}
+
+MemoryStats MemoryAllocator::getTotalStats() const
+{
+    MemoryStats total;
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        MemoryStats stats = getStats(i);
+        total.blockCount += stats.blockCount;
+        total.allocationCount += stats.allocationCount;
+        total.blockBytes += stats.blockBytes;
+        total.usedBytes += stats.usedBytes;
+        total.dedicatedBytes += stats.dedicatedBytes;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    total.dedicatedCount = dedicatedCount;
+    return total;
+}
+
+uint32_t MemoryAllocator::findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties) const
+{
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+        if ((typeBits & (1u << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+            return i;
+
+    fmt::print("Vulkan error: No memory type matching properties {:#x}\n", (uint32_t)properties);
+    abort();
+}
+
+uint32_t MemoryAllocator::findFallbackMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties, uint32_t failedType) const
+{
+    if (!(properties & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT))
+        return UINT32_MAX;
+
+    // Any type outside the exhausted heap that isn't device local, system memory the GPU reads over the bus
+    const VkMemoryPropertyFlags required = properties & ~VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    const uint32_t failedHeap = memoryProperties.memoryTypes[failedType].heapIndex;
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        const VkMemoryType& type = memoryProperties.memoryTypes[i];
+        if ((typeBits & (1u << i)) && type.heapIndex != failedHeap && (type.propertyFlags & required) == required &&
+            !(memoryProperties.memoryHeaps[type.heapIndex].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT))
+            return i;
+    }
+    return UINT32_MAX;
+}
+
+VkDeviceMemory MemoryAllocator::allocateDeviceMemory(VkDeviceSize size, uint32_t memoryType, void** mapped) const
+{
+    VkResult err;
+    VkDevice device = renderer->getDevice();
+
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryType;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    err = vkAllocateMemory(device, &allocInfo, renderer->getAllocator(), &memory);
+    if (err == VK_ERROR_OUT_OF_DEVICE_MEMORY || err == VK_ERROR_OUT_OF_HOST_MEMORY) {
+        *mapped = nullptr;
+        return VK_NULL_HANDLE;
+    }
+    Renderer::CheckVkResult(err);
+
+    // Host visible memory stays mapped until it's freed
+    *mapped = nullptr;
+    if (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        err = vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, mapped);
+        Renderer::CheckVkResult(err);
+    }
+    return memory;
+}
+
+bool MemoryAllocator::AllocateFromBlock(MemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset)
+{
+    for (auto it = block.freeRanges.begin(); it != block.freeRanges.end(); ++it) {
+        const VkDeviceSize rangeStart = it->first;
+        const VkDeviceSize rangeEnd = it->first + it->second;
+        const VkDeviceSize alignedStart = AlignUp(rangeStart, alignment);
+        if (alignedStart + size > rangeEnd)
+            continue;
+
+        // Split the range, keeping the alignment padding and the tail free
+        block.freeRanges.erase(it);
+        if (alignedStart > rangeStart)
+            block.freeRanges[rangeStart] = alignedStart - rangeStart;
+        if (alignedStart + size < rangeEnd)
+            block.freeRanges[alignedStart + size] = rangeEnd - (alignedStart + size);
+        offset = alignedStart;
+        return true;
+    }
+    return false;
+}
+
+void MemoryAllocator::FreeToBlock(MemoryBlock& block, VkDeviceSize offset, VkDeviceSize size)
+{
+    auto it = block.freeRanges.emplace(offset, size).first;
+
+    // Merge with the following range
+    auto next = std::next(it);
+    if (next != block.freeRanges.end() && it->first + it->second == next->first) {
+        it->second += next->second;
+        block.freeRanges.erase(next);
+    }
+
+    // Merge with the preceding range
+    if (it != block.freeRanges.begin()) {
+        auto prev = std::prev(it);
+        if (prev->first + prev->second == it->first) {
+            prev->second += it->second;
+            block.freeRanges.erase(it);
+        }
+    }
+}
+
+} // namespace Prism
@@ -0,0 +1,100 @@
+#include "prism/pool_allocator.h"
+#include <bit>
+#include <cstdlib>
+#include <new>
+
+namespace Prism {
+
+PoolAllocator::~PoolAllocator()
+{
+    for (std::byte* chunk : chunks)
+        std::free(chunk);
+}
+
+void* PoolAllocator::allocate(size_t size)
+{
+    // Large allocations are rare, let malloc handle them
+    const size_t maxSize = MinBlockSize << (ClassCount - 1);
+    if (size > maxSize) {
+        Header* header = (Header*)std::malloc(sizeof(Header) + size);
+        if (!header)
+            throw std::bad_alloc();
+        header->sizeClass = ClassCount;
+        return header + 1;
+    }
+
+    // Round up to the next power of two class
+    const uint32_t sizeClass = size <= MinBlockSize ? 0 : (uint32_t)std::bit_width((size - 1) / MinBlockSize);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!freeBlocks[sizeClass])
+        refill(sizeClass);
+    FreeBlock* block = freeBlocks[sizeClass];
+    freeBlocks[sizeClass] = block->next;
+    bytesInUse += MinBlockSize << sizeClass;
+
+    Header* header = (Header*)block;
+    header->sizeClass = sizeClass;
+    return header + 1;
+}
+
+void PoolAllocator::free(void* ptr)
+{
+    if (!ptr)
+        return;
+
+    Header* header = (Header*)ptr - 1;
+    const uint32_t sizeClass = header->sizeClass;
+    if (sizeClass == ClassCount) {
+        std::free(header);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    FreeBlock* block = (FreeBlock*)header;
+    block->next = freeBlocks[sizeClass];
+    freeBlocks[sizeClass] = block;
+    bytesInUse -= MinBlockSize << sizeClass;
+}
+
+void* PoolAllocator::ImGuiAlloc(size_t size, void* userData)
+{
+    return ((PoolAllocator*)userData)->allocate(size);
+}
+
+void PoolAllocator::ImGuiFree(void* ptr, void* userData)
+{
+    ((PoolAllocator*)userData)->free(ptr);
+}
+
+size_t PoolAllocator::getBytesInUse() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return bytesInUse;
+}
+
+size_t PoolAllocator::getBytesReserved() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return chunks.size() * ChunkSize;
+}
+
+void PoolAllocator::refill(uint32_t sizeClass)
+{
+    // malloc aligns to max_align_t, as do the block sizes
+    std::byte* chunk = (std::byte*)std::malloc(ChunkSize);
+    if (!chunk)
+        throw std::bad_alloc();
+    chunks.push_back(chunk);
+
+    // Thread the chunk's blocks onto the free list
+    const size_t blockSize = sizeof(Header) + (MinBlockSize << sizeClass);
+    const size_t blockCount = ChunkSize / blockSize;
+    for (size_t i = blockCount; i-- > 0;) {
+        FreeBlock* block = (FreeBlock*)(chunk + i * blockSize);
+        block->next = freeBlocks[sizeClass];
+        freeBlocks[sizeClass] = block;
+    }
+}
+
+} // namespace Prism
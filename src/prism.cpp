@@ -1,4 +1,8 @@
 #include "prism/prism.h"
+#include "prism/deletion_queue.h"
+#include "prism/font_atlas.h"
+#include <algorithm>
+#include <cfloat>
 #include <iostream>
 #include <ranges>
 
@@ -13,9 +17,22 @@
 
 Prism::Application* Prism::Application::instance = nullptr;
 
+// Waits shorter than this (in seconds) are slept precisely rather than handed to glfwWaitEventsTimeout
+static constexpr double EventWaitPrecision = 0.002;
+
+// ImGui's allocator functions from before the pool was installed, restored on shutdown
+static struct
+{
+    ImGuiMemAllocFunc allocFunc = nullptr;
+    ImGuiMemFreeFunc freeFunc = nullptr;
+    void* userData = nullptr;
+} previousImGuiAlloc;
+
 namespace Prism {
 
-Application::Application(std::string name)
+Application::Application(std::string name, RendererSettings rendererSettings) :
+    name(std::move(name)),
+    rendererSettings(std::move(rendererSettings))
 {
     // Always assume that any given instance of an application is the main instance.
     // As there should only ever be one instance of an application.
@@ -28,24 +45,147 @@ Application::Application(std::string name)
 Application::~Application()
 {
     stop();
+    pooledWindowTypes.clear();
+    clearWindowPool();
     for (auto& window : std::ranges::reverse_view(appWindows))
         window.reset();
     renderer.reset();
+
+    // Nothing allocated by ImGui is left, hand allocation back to the heap
+    if (imguiAllocator)
+        ImGui::SetAllocatorFunctions(previousImGuiAlloc.allocFunc, previousImGuiAlloc.freeFunc, previousImGuiAlloc.userData);
 }
 
 void Application::run()
 {
     if (!running) return;
     while (running) {
-        // Poll and handle events & cull closed windows
+        // Poll and handle events, run posted work & cull closed windows
+        pollEvents();
+        taskQueue.drain();
+        cullClosedWindowsExitOnMainDeath();
+
+        // Render the windows that are due. Windows opened meanwhile are appended and closed ones
+        // only culled above, so indexing stays valid without copying the list every iteration.
+        for (size_t i = 0; i < appWindows.size(); i++) {
+            Window& window = *appWindows[i];
+            if (window.finishAsyncInit() && shouldRenderWindow(window))
+                window.render();
+        }
+
+        // Destroy resources the GPU is done with, including frames of windows that stopped rendering, then see if memory runs low
+        for (auto& window : appWindows)
+            if (window->isInitialized())
+                window->completeFinishedFrames();
+        renderer->getDeletionQueue().collect();
+        renderer->updateMemoryBudget();
+    }
+}
+
+void Application::step(uint32_t frames, float deltaTime)
+{
+    for (uint32_t frame = 0; frame < frames && running; frame++) {
         glfwPollEvents();
+        taskQueue.drain();
         cullClosedWindowsExitOnMainDeath();
 
-        // Render the windows
-        std::vector<std::shared_ptr<Window>> appWindowsCopy = appWindows; // Quick fix for windows closing/opening during render, revisit later
-        for (auto& window : appWindowsCopy)
-            window->render();
+        for (size_t i = 0; i < appWindows.size(); i++) {
+            Window& window = *appWindows[i];
+            if (window.finishAsyncInit())
+                window.step(deltaTime);
+        }
+
+        // Destroy resources the GPU is done with, including frames of windows that stopped rendering, then see if memory runs low
+        for (auto& window : appWindows)
+            if (window->isInitialized())
+                window->completeFinishedFrames();
+        renderer->getDeletionQueue().collect();
+        renderer->updateMemoryBudget();
+    }
+}
+
+void Application::pollEvents()
+{
+    // Find how long we can block before some window can render again.
+    // Threaded windows, restored windows and input wake us with an event.
+    double timeout = appWindows.empty() || taskQueue.hasPending() ? 0.0 : DBL_MAX;
+    const double now = glfwGetTime();
+    for (auto& window : appWindows) {
+        const double untilReady = window->getTimeUntilFrameReady();
+        if (runMode == RunMode::Continuous || window->hasPendingRedraw())
+            timeout = std::min(timeout, untilReady);
+        else if (maxIdleFps > 0.f) // Idle redraw so timers and data refreshes still show up
+            timeout = std::min(timeout, std::max(untilReady, window->getLastRenderTime() + 1.0 / maxIdleFps - now));
+
+        // Glyphs requested while the atlas was rate limited are drawn once their rebuild is due
+        if (window->isInitialized() && window->getFontAtlas())
+            timeout = std::min(timeout, std::max(untilReady, window->getFontAtlas()->getTimeUntilRebuild()));
+    }
+
+    // Time spent pumping (and waiting for) events counts towards each window's next frame
+    const double waitStart = glfwGetTime();
+    waitEvents(timeout);
+    const double eventsMs = (glfwGetTime() - waitStart) * 1000.0;
+    for (auto& window : appWindows)
+        window->getProfiler().addCpuTime(ProfileScope::Events, eventsMs);
+}
+
+void Application::waitEvents(double timeout)
+{
+    if (timeout <= 0.0) {
+        glfwPollEvents();
+    }
+    else if (timeout == DBL_MAX) {
+        glfwWaitEvents();
+    }
+    else if (timeout > EventWaitPrecision) {
+        // GLFW's timeout is only about millisecond accurate, the loop comes back for the remainder
+        glfwWaitEventsTimeout(timeout - EventWaitPrecision);
+    }
+    else {
+        // Close to the deadline, sleep precisely instead
+        FrameLimiter::SleepUntil(FrameLimiter::Clock::now() + std::chrono::duration_cast<FrameLimiter::Clock::duration>(std::chrono::duration<double>(timeout)));
+        glfwPollEvents();
+    }
+}
+
+bool Application::shouldRenderWindow(const Window& window) const
+{
+    if (runMode == RunMode::Continuous || window.hasPendingRedraw())
+        return true;
+
+    // Idle redraw so timers and data refreshes still show up
+    if (maxIdleFps <= 0.f)
+        return false;
+    return glfwGetTime() - window.getLastRenderTime() >= 1.0 / maxIdleFps;
+}
+
+void Application::post(std::function<void()> func)
+{
+    // Only the first task since the last drain has to wake the main loop
+    if (taskQueue.push(std::move(func)))
+        glfwPostEmptyEvent();
+}
+
+void Application::postFrame(uint64_t key, std::function<void()> func)
+{
+    if (taskQueue.push(key, std::move(func)))
+        glfwPostEmptyEvent();
+}
+
+void Application::setContextMode(ContextMode mode)
+{
+#ifndef IMGUI_HAS_VIEWPORT
+    if (mode == ContextMode::Shared) {
+        fmt::print("Prism: ImGui was built without viewports, every window keeps its own context\n");
+        return;
+    }
+#endif
+    if (mode == ContextMode::Shared && rendererSettings.headless) {
+        fmt::print("Prism: Headless windows have no viewports, every window keeps its own context\n");
+        return;
     }
+    contextMode = mode;
 }
 
 void Application::stop()
@@ -63,29 +203,59 @@ void Application::cullClosedWindowsExitOnMainDeath()
                 break;
             }
 
-            // Remove the window
+            // Remove the window, pooled windows are only hidden
+            recycleWindow(appWindows[i]);
             appWindows.erase(appWindows.begin() + (int64_t)i);
         }
     }
 }
 
+void Application::recycleWindow(const std::shared_ptr<Window>& window)
+{
+    auto it = pooledWindowTypes.find(window.get());
+    if (it == pooledWindowTypes.end())
+        return;
+    auto& pool = windowPool[it->second];
+    pooledWindowTypes.erase(it);
+    if (pool.size() >= windowPoolSize)
+        return;
+
+    window->release();
+    pool.push_back(window);
+}
+
+void Application::clearWindowPool()
+{
+    windowPool.clear();
+}
+
 void Application::init()
 {
-    // Initialize GLFW
+    // Initialize GLFW. Headless apps use the null platform, whose windows need no display server and never get input.
     glfwSetErrorCallback(Window::GlfwErrorCallback);
+#if GLFW_VERSION_MAJOR > 3 || (GLFW_VERSION_MAJOR == 3 && GLFW_VERSION_MINOR >= 4)
+    if (rendererSettings.headless)
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
     if (!glfwInit()) {
         std::cerr << "GLFW: Could not initalize!\n";
         return;
     }
 
-    // Make sure Vulkan is supported
-    if (!glfwVulkanSupported()) {
+    // Make sure Vulkan is supported, headless rendering doesn't go through GLFW's loader
+    if (!rendererSettings.headless && !glfwVulkanSupported()) {
         std::cerr << "GLFW: Vulkan unsupported!\n";
         return;
     }
 
+    // Route ImGui's allocations through a pool before anything creates a context or the font atlas.
+    // ImGui's allocator is global rather than per context, so one pool serves every window.
+    imguiAllocator = std::make_unique<PoolAllocator>();
+    ImGui::GetAllocatorFunctions(&previousImGuiAlloc.allocFunc, &previousImGuiAlloc.freeFunc, &previousImGuiAlloc.userData);
+    ImGui::SetAllocatorFunctions(PoolAllocator::ImGuiAlloc, PoolAllocator::ImGuiFree, imguiAllocator.get());
+
     // Create the renderer
-    renderer = std::make_shared<Renderer>();
+    renderer = std::make_shared<Renderer>(rendererSettings);
 }
 
 Application& Application::Get()
@@ -0,0 +1,236 @@
+#include "prism/render_target.h"
+#include "prism/renderer.h"
+#include "prism/deletion_queue.h"
+#include "prism/prism.h"
+#include <algorithm>
+
+namespace Prism {
+
+RenderTarget::RenderTarget(uint32_t width, uint32_t height, RenderTargetSettings settings) :
+    renderer(Application::Get().getRenderer()),
+    width(std::max(width, 1u)),
+    height(std::max(height, 1u)),
+    settings(settings)
+{
+    VkResult err;
+
+    createRenderPass();
+
+    // Create the sampler, it doesn't depend on the size
+    VkSamplerCreateInfo samplerInfo = {};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = settings.filter;
+    samplerInfo.minFilter = settings.filter;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.minLod = -1000;
+    samplerInfo.maxLod = 1000;
+    samplerInfo.maxAnisotropy = 1.0f;
+    err = vkCreateSampler(renderer->getDevice(), &samplerInfo, renderer->getAllocator(), &sampler);
+    Renderer::CheckVkResult(err);
+
+    createAttachments();
+}
+
+RenderTarget::~RenderTarget()
+{
+    // Frames drawing into or sampling the target may still be in flight
+    destroyAttachments();
+    DeletionQueue& deletionQueue = renderer->getDeletionQueue();
+    deletionQueue.destroySampler(sampler);
+    deletionQueue.destroyRenderPass(renderPass);
+    sampler = VK_NULL_HANDLE;
+    renderPass = VK_NULL_HANDLE;
+}
+
+void RenderTarget::resize(uint32_t newWidth, uint32_t newHeight)
+{
+    newWidth = std::max(newWidth, 1u);
+    newHeight = std::max(newHeight, 1u);
+    if (newWidth == width && newHeight == height)
+        return;
+
+    // The old attachments go to the deletion queue, so there's no need to wait for the device
+    destroyAttachments();
+    width = newWidth;
+    height = newHeight;
+    createAttachments();
+}
+
+void RenderTarget::begin(VkCommandBuffer commandBuffer, const ImVec4& clearColor, float clearDepth) const
+{
+    VkClearValue clearValues[2] = {};
+    clearValues[0].color.float32[0] = clearColor.x;
+    clearValues[0].color.float32[1] = clearColor.y;
+    clearValues[0].color.float32[2] = clearColor.z;
+    clearValues[0].color.float32[3] = clearColor.w;
+    clearValues[1].depthStencil.depth = clearDepth;
+
+    VkRenderPassBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    beginInfo.renderPass = renderPass;
+    beginInfo.framebuffer = framebuffer;
+    beginInfo.renderArea.extent = getExtent();
+    beginInfo.clearValueCount = hasDepth() ? 2 : 1;
+    beginInfo.pClearValues = clearValues;
+    vkCmdBeginRenderPass(commandBuffer, &beginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+    VkViewport viewport = {};
+    viewport.width = (float)width;
+    viewport.height = (float)height;
+    viewport.maxDepth = 1.f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor = {};
+    scissor.extent = getExtent();
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
+
+void RenderTarget::end(VkCommandBuffer commandBuffer) const
+{
+    vkCmdEndRenderPass(commandBuffer);
+}
+
+void RenderTarget::createRenderPass()
+{
+    // The color image is cleared every frame and left ready for sampling
+    VkAttachmentDescription attachments[2] = {};
+    attachments[0].format = settings.colorFormat;
+    attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+    attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    attachments[0].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    // Depth only lives for the duration of the pass
+    attachments[1].format = settings.depthFormat;
+    attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+    attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference colorRef = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+    VkAttachmentReference depthRef = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+    VkSubpassDescription subpass = {};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &colorRef;
+    subpass.pDepthStencilAttachment = hasDepth() ? &depthRef : nullptr;
+
+    // In: the previous frame's UI pass may still be sampling the image, and the previous frame's depth writes
+    // have to land before the shared depth image is cleared again.
+    // Out: make the color writes visible to the UI pass sampling the image afterwards.
+    VkSubpassDependency dependencies[2] = {};
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependencies[0].srcAccessMask = hasDepth() ? VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT : 0;
+    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    VkRenderPassCreateInfo renderPassInfo = {};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = hasDepth() ? 2 : 1;
+    renderPassInfo.pAttachments = attachments;
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+    renderPassInfo.dependencyCount = 2;
+    renderPassInfo.pDependencies = dependencies;
+    VkResult err = vkCreateRenderPass(renderer->getDevice(), &renderPassInfo, renderer->getAllocator(), &renderPass);
+    Renderer::CheckVkResult(err);
+}
+
+void RenderTarget::createAttachments()
+{
+    createImage(settings.colorFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                VK_IMAGE_ASPECT_COLOR_BIT, colorImage, colorAllocation, colorView);
+    if (hasDepth())
+        createImage(settings.depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+                    VK_IMAGE_ASPECT_DEPTH_BIT, depthImage, depthAllocation, depthView);
+
+    VkImageView views[2] = { colorView, depthView };
+    VkFramebufferCreateInfo framebufferInfo = {};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = renderPass;
+    framebufferInfo.attachmentCount = hasDepth() ? 2 : 1;
+    framebufferInfo.pAttachments = views;
+    framebufferInfo.width = width;
+    framebufferInfo.height = height;
+    framebufferInfo.layers = 1;
+    VkResult err = vkCreateFramebuffer(renderer->getDevice(), &framebufferInfo, renderer->getAllocator(), &framebuffer);
+    Renderer::CheckVkResult(err);
+
+    descriptorSet = renderer->allocateTextureDescriptor(sampler, colorView);
+}
+
+void RenderTarget::destroyAttachments()
+{
+    DeletionQueue& deletionQueue = renderer->getDeletionQueue();
+    deletionQueue.freeDescriptorSet(descriptorSet);
+    deletionQueue.destroyFramebuffer(framebuffer);
+    deletionQueue.destroyImageView(colorView);
+    deletionQueue.destroyImage(colorImage);
+    deletionQueue.freeMemory(colorAllocation);
+    deletionQueue.destroyImageView(depthView);
+    deletionQueue.destroyImage(depthImage);
+    deletionQueue.freeMemory(depthAllocation);
+    descriptorSet = VK_NULL_HANDLE;
+    framebuffer = VK_NULL_HANDLE;
+    colorView = VK_NULL_HANDLE;
+    colorImage = VK_NULL_HANDLE;
+    depthView = VK_NULL_HANDLE;
+    depthImage = VK_NULL_HANDLE;
+}
+
+void RenderTarget::createImage(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect,
+                               VkImage& image, MemoryAllocation& allocation, VkImageView& view)
+{
+    VkResult err;
+    VkDevice device = renderer->getDevice();
+    VkAllocationCallbacks* allocator = renderer->getAllocator();
+
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = format;
+    imageInfo.extent.width = width;
+    imageInfo.extent.height = height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = usage;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    err = vkCreateImage(device, &imageInfo, allocator, &image);
+    Renderer::CheckVkResult(err);
+
+    allocation = renderer->getMemoryAllocator().allocateImage(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::RenderTarget);
+
+    VkImageViewCreateInfo viewInfo = {};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = format;
+    viewInfo.subresourceRange.aspectMask = aspect;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.layerCount = 1;
+    err = vkCreateImageView(device, &viewInfo, allocator, &view);
+    Renderer::CheckVkResult(err);
+}
+
+} // namespace Prism
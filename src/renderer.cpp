@@ -1,7 +1,20 @@
 #include "prism/renderer.h"
 #include "prism/window.h"
+#include "prism/font_atlas.h"
+#include "prism/upload_queue.h"
+#include "prism/memory_allocator.h"
+#include "prism/deletion_queue.h"
+#include "prism/descriptor_allocator.h"
+#include "prism/texture_table.h"
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
 #include <assert.h>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <fstream>
 #include <vector>
 
 // Enable debug reporting in debug builds
@@ -13,13 +26,53 @@
 
 namespace Prism {
 
-Renderer::Renderer()
+// Header prepended to the on-disk pipeline cache, the driver blob is only used if everything matches
+struct PipelineCacheFileHeader
+{
+    uint32_t magic;                             ///< Always PipelineCacheMagic.
+    uint32_t version;                           ///< Always PipelineCacheVersion.
+    uint32_t vendorID;                          ///< VkPhysicalDeviceProperties::vendorID of the writer.
+    uint32_t deviceID;                          ///< VkPhysicalDeviceProperties::deviceID of the writer.
+    uint32_t driverVersion;                     ///< VkPhysicalDeviceProperties::driverVersion of the writer.
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];    ///< VkPhysicalDeviceProperties::pipelineCacheUUID of the writer.
+    uint64_t dataSize;                          ///< Size of the driver blob following the header.
+};
+
+static constexpr uint32_t PipelineCacheMagic = 0x43505250; // "PRPC"
+static constexpr uint32_t PipelineCacheVersion = 1;
+
+// Fill a cache header for the given device
+static PipelineCacheFileHeader MakePipelineCacheHeader(VkPhysicalDevice physicalDevice, uint64_t dataSize)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    PipelineCacheFileHeader header = {};
+    header.magic = PipelineCacheMagic;
+    header.version = PipelineCacheVersion;
+    header.vendorID = properties.vendorID;
+    header.deviceID = properties.deviceID;
+    header.driverVersion = properties.driverVersion;
+    memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+    header.dataSize = dataSize;
+    return header;
+}
+
+Renderer::Renderer(RendererSettings settings)
+    : settings(std::move(settings))
 {
     createInstance();
     selectPhysicalDevice();
     chooseQueueFamilyIndex();
     createDevice();
-    createDescriptorPool();
+    createTextureSetLayout();
+    createTextureDescriptors();
+    createTextureTable();
+    createImmediatePool();
+    createPipelineCache();
+    createMemoryAllocator();
+    createUploadQueue();
+    createDeletionQueue();
 }
 
 Renderer::~Renderer()
@@ -32,15 +85,29 @@ void Renderer::shutdown()
     // Wait for the device to finish all operations
     if (device != VK_NULL_HANDLE)
         vkDeviceWaitIdle(device);
+
+    // Destroy everything still deferred, then the upload queue and its staging ring, then the memory pools
+    deletionQueue.reset();
+    textureTable.reset();
+    textureDescriptors.reset();
+    uploadQueue.reset();
+    memoryAllocator.reset();
         
-    // Destroy the descriptor pool
-    if (descriptorPool != VK_NULL_HANDLE) {
-        vkDestroyDescriptorPool(device, descriptorPool, allocator);
-        descriptorPool = VK_NULL_HANDLE;
+    // Destroy the immediate command pool
+    if (immediatePool != VK_NULL_HANDLE) {
+        vkDestroyCommandPool(device, immediatePool, allocator);
+        immediatePool = VK_NULL_HANDLE;
+    }
+
+    // Destroy the texture descriptor set layout
+    if (textureSetLayout != VK_NULL_HANDLE) {
+        vkDestroyDescriptorSetLayout(device, textureSetLayout, allocator);
+        textureSetLayout = VK_NULL_HANDLE;
     }
 
-    // Destroy the pipeline cache
+    // Persist and destroy the pipeline cache
     if (pipelineCache != VK_NULL_HANDLE) {
+        savePipelineCache();
         vkDestroyPipelineCache(device, pipelineCache, allocator);
         pipelineCache = VK_NULL_HANDLE;
     }
@@ -70,20 +137,35 @@ void Renderer::shutdown()
     // Reset other members
     physicalDevice = VK_NULL_HANDLE;
     queueFamilyIndex = UINT32_MAX;
+    transferQueueFamilyIndex = UINT32_MAX;
     queue = VK_NULL_HANDLE;
+    transferQueue = VK_NULL_HANDLE;
 }
 
 void Renderer::createInstance()
 {
     VkResult err;
 
-    // Get the required instance extensions from GLFW
+    // Get the required instance extensions from GLFW, headless rendering needs no surfaces
     uint32_t extensionsCount = 0;
-    const char** extensions = glfwGetRequiredInstanceExtensions(&extensionsCount);
+    const char** extensions = settings.headless ? nullptr : glfwGetRequiredInstanceExtensions(&extensionsCount);
+
+    // Ask for Vulkan 1.2 where the loader has it, it brings descriptor indexing for the texture table
+    uint32_t loaderVersion = VK_API_VERSION_1_0;
+    auto enumerateInstanceVersion = (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(VK_NULL_HANDLE, "vkEnumerateInstanceVersion");
+    if (enumerateInstanceVersion)
+        enumerateInstanceVersion(&loaderVersion);
+    apiVersion = loaderVersion >= VK_API_VERSION_1_2 ? VK_API_VERSION_1_2 : VK_API_VERSION_1_0;
+
+    VkApplicationInfo appInfo = {};
+    appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    appInfo.pEngineName = "Prism";
+    appInfo.apiVersion = apiVersion;
 
     // Prepare instance creation info
     VkInstanceCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    createInfo.pApplicationInfo = &appInfo;
     createInfo.enabledExtensionCount = extensionsCount;
     createInfo.ppEnabledExtensionNames = extensions;
 
@@ -95,7 +177,8 @@ void Renderer::createInstance()
     
     // Add debug report extension
     const char** extensionsExt = (const char**)malloc(sizeof(const char*) * (extensionsCount + 1));
-    memcpy(extensionsExt, extensions, extensionsCount * sizeof(const char*));
+    if (extensionsCount > 0)
+        memcpy(extensionsExt, extensions, extensionsCount * sizeof(const char*));
     extensionsExt[extensionsCount] = "VK_EXT_debug_report";
     createInfo.enabledExtensionCount = extensionsCount + 1;
     createInfo.ppEnabledExtensionNames = extensionsExt;
@@ -124,114 +207,667 @@ void Renderer::createInstance()
 #endif
 }
 
+// Check a GPU supports everything windows need, returning its graphics and present capable queue families.
+// Headless windows never present, so any graphics family does.
+static bool FindWindowQueueFamilies(VkInstance instance, VkPhysicalDevice gpu, bool headless, uint32_t& graphicsFamily, uint32_t& presentFamily)
+{
+    uint32_t queueCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(gpu, &queueCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueProps(queueCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(gpu, &queueCount, queueProps.data());
+
+    // Prefer a graphics family that presents too, so presenting needs no queue ownership transfers
+    graphicsFamily = UINT32_MAX;
+    presentFamily = UINT32_MAX;
+    for (uint32_t i = 0; i < queueCount; i++) {
+        const bool graphics = (queueProps[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+        const bool present = headless || glfwGetPhysicalDevicePresentationSupport(instance, gpu, i) == GLFW_TRUE;
+        if (graphics && present) {
+            graphicsFamily = presentFamily = i;
+            return true;
+        }
+        if (graphics && graphicsFamily == UINT32_MAX)
+            graphicsFamily = i;
+        if (present && presentFamily == UINT32_MAX)
+            presentFamily = i;
+    }
+    return graphicsFamily != UINT32_MAX && presentFamily != UINT32_MAX;
+}
+
+// Check a GPU has an extension
+static bool HasDeviceExtension(VkPhysicalDevice gpu, const char* name)
+{
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(gpu, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(gpu, nullptr, &extensionCount, extensions.data());
+    for (const VkExtensionProperties& extension : extensions)
+        if (strcmp(extension.extensionName, name) == 0)
+            return true;
+    return false;
+}
+
+// Check if a GPU is the one asked for, by its index or a case-insensitive part of its name
+static bool MatchesPreferredGpu(uint32_t index, const char* deviceName, const std::string& preferred)
+{
+    // An index too large to parse matches no GPU, rather than throwing
+    if (std::all_of(preferred.begin(), preferred.end(), [](char c) { return std::isdigit((unsigned char)c); })) {
+        uint32_t preferredIndex = 0;
+        const char* end = preferred.data() + preferred.size();
+        auto [ptr, ec] = std::from_chars(preferred.data(), end, preferredIndex);
+        return ec == std::errc() && ptr == end && preferredIndex == index;
+    }
+
+    auto lower = [](std::string str) {
+        std::transform(str.begin(), str.end(), str.begin(), [](char c) { return (char)std::tolower((unsigned char)c); });
+        return str;
+    };
+    return lower(deviceName).find(lower(preferred)) != std::string::npos;
+}
+
+int64_t Renderer::scorePhysicalDevice(VkPhysicalDevice gpu) const
+{
+    uint32_t graphicsFamily, presentFamily;
+    if (!settings.headless && !HasDeviceExtension(gpu, VK_KHR_SWAPCHAIN_EXTENSION_NAME))
+        return -1;
+    if (!FindWindowQueueFamilies(instance, gpu, settings.headless, graphicsFamily, presentFamily))
+        return -1;
+
+    // The device type decides, integrated GPUs share bandwidth with the CPU and software ones are a last resort
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(gpu, &properties);
+    int64_t tier = 0;
+    switch (properties.deviceType) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: tier = 4; break;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: tier = 3; break;
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: tier = 2; break;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU: tier = 1; break;
+    default: break;
+    }
+
+    // Break ties between GPUs of the same type on device local memory
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(gpu, &memoryProperties);
+    VkDeviceSize deviceLocal = 0;
+    for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+        if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+            deviceLocal += memoryProperties.memoryHeaps[i].size;
+
+    // Present on the graphics queue beats a separate present queue
+    const int64_t sharedPresent = graphicsFamily == presentFamily ? 1 : 0;
+    return (tier << 48) | (sharedPresent << 47) | (int64_t)std::min<VkDeviceSize>(deviceLocal >> 20, 0xFFFFFFFF);
+}
+
 void Renderer::selectPhysicalDevice()
 {
     VkResult err;
 
-    // Get the number of available physical devices
+    // Enumerate physical devices
     uint32_t gpuCount;
-    err = vkEnumeratePhysicalDevices(instance, &gpuCount, NULL);
+    err = vkEnumeratePhysicalDevices(instance, &gpuCount, nullptr);
     CheckVkResult(err);
-    assert(gpuCount > 0);
-
-    // Enumerate physical devices
-    VkPhysicalDevice* gpus = (VkPhysicalDevice*)malloc(sizeof(VkPhysicalDevice) * gpuCount);
-    err = vkEnumeratePhysicalDevices(instance, &gpuCount, gpus);
+    std::vector<VkPhysicalDevice> gpus(gpuCount);
+    err = vkEnumeratePhysicalDevices(instance, &gpuCount, gpus.data());
     CheckVkResult(err);
 
-    // Select discrete GPU if available, otherwise use the first available device
-    int useGpu = 0;
-    for (int i = 0; i < (int)gpuCount; i++) {
+    // The environment overrides the settings, so a GPU can be picked without rebuilding
+    std::string preferred = settings.preferredGpu;
+    if (const char* env = std::getenv("PRISM_GPU"); env && *env)
+        preferred = env;
+
+    // Pick the best scoring GPU, unless one that can render was asked for
+    int64_t bestScore = -1;
+    bool preferredFound = false;
+    for (uint32_t i = 0; i < gpuCount; i++) {
         VkPhysicalDeviceProperties properties;
         vkGetPhysicalDeviceProperties(gpus[i], &properties);
-        if (properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
-            useGpu = i;
-            break;
+        const int64_t score = scorePhysicalDevice(gpus[i]);
+        if (score < 0) {
+            fmt::print("Prism: Skipping GPU {} ({}), it can't render windows\n", i, properties.deviceName);
+            continue;
         }
+
+        const bool isPreferred = !preferred.empty() && MatchesPreferredGpu(i, properties.deviceName, preferred);
+        if (preferredFound && !isPreferred)
+            continue;
+        if ((isPreferred && !preferredFound) || score > bestScore) {
+            physicalDevice = gpus[i];
+            bestScore = score;
+            preferredFound = isPreferred;
+        }
+    }
+
+    if (physicalDevice == VK_NULL_HANDLE) {
+        fmt::print("Error: No GPU can render windows\n");
+        abort();
     }
+    if (!preferred.empty() && !preferredFound)
+        fmt::print("Prism: No usable GPU matches \"{}\", falling back to the best one\n", preferred);
 
-    physicalDevice = gpus[useGpu];
-    free(gpus);
+    vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
+    fmt::print("Prism: Using GPU {}\n", physicalDeviceProperties.deviceName);
 }
 
 void Renderer::chooseQueueFamilyIndex()
 {
-    // Get the number of queue families
+    // Selection already checked the device has both
+    const bool found = FindWindowQueueFamilies(instance, physicalDevice, settings.headless, queueFamilyIndex, presentQueueFamilyIndex);
+    assert(found);
+    (void)found;
+    if (presentQueueFamilyIndex != queueFamilyIndex)
+        fmt::print("Prism: Presenting on separate queue family {}\n", presentQueueFamilyIndex);
+
+    // Find a transfer-only queue family for uploads, these map to the GPU's copy engines
     uint32_t queueCount;
-    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, NULL);
-    assert(queueCount >= 1);
-
-    // Get queue family properties
-    VkQueueFamilyProperties* queueProps = (VkQueueFamilyProperties*)malloc(sizeof(VkQueueFamilyProperties) * queueCount);
-    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, queueProps);
-
-    // Find a queue family that supports graphics operations
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueProps(queueCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, queueProps.data());
     for (uint32_t i = 0; i < queueCount; i++) {
-        if (queueProps[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-            queueFamilyIndex = i;
+        if (i == presentQueueFamilyIndex)
+            continue;
+        if ((queueProps[i].queueFlags & VK_QUEUE_TRANSFER_BIT) && !(queueProps[i].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+            transferQueueFamilyIndex = i;
             break;
         }
     }
-
-    free(queueProps);
-    assert(queueFamilyIndex != UINT32_MAX);
 }
 
 void Renderer::createDevice()
 {
     VkResult err;
 
-    // Specify queue creation info
+    // Specify queue creation info, plus the present and transfer queues if they're separate
     float queuePriorities[] = { 1.0 };
-    VkDeviceQueueCreateInfo queueInfo = {};
-    queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    queueInfo.queueFamilyIndex = queueFamilyIndex;
-    queueInfo.queueCount = 1;
-    queueInfo.pQueuePriorities = queuePriorities;
-
-    // Specify device extensions
-    const char* deviceExtensions[] = { "VK_KHR_swapchain" };
+    VkDeviceQueueCreateInfo queueInfos[3] = {};
+    uint32_t queueInfoCount = 1;
+    queueInfos[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queueInfos[0].queueFamilyIndex = queueFamilyIndex;
+    queueInfos[0].queueCount = 1;
+    queueInfos[0].pQueuePriorities = queuePriorities;
+    if (presentQueueFamilyIndex != queueFamilyIndex) {
+        queueInfos[queueInfoCount] = queueInfos[0];
+        queueInfos[queueInfoCount++].queueFamilyIndex = presentQueueFamilyIndex;
+    }
+    if (transferQueueFamilyIndex != UINT32_MAX) {
+        queueInfos[queueInfoCount] = queueInfos[0];
+        queueInfos[queueInfoCount++].queueFamilyIndex = transferQueueFamilyIndex;
+    }
+
+    // Specify device extensions, headless devices don't present
+    std::vector<const char*> deviceExtensions;
+    if (!settings.headless)
+        deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+
+    // Budgets are queried through vkGetPhysicalDeviceMemoryProperties2, core since 1.1
+    memoryBudget = apiVersion >= VK_API_VERSION_1_1 && physicalDeviceProperties.apiVersion >= VK_API_VERSION_1_1 &&
+        HasDeviceExtension(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if (memoryBudget)
+        deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
     VkDeviceCreateInfo deviceInfo = {};
     deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    deviceInfo.queueCreateInfoCount = 1;
-    deviceInfo.pQueueCreateInfos = &queueInfo;
-    deviceInfo.enabledExtensionCount = sizeof(deviceExtensions) / sizeof(deviceExtensions[0]);
-    deviceInfo.ppEnabledExtensionNames = deviceExtensions;
+    deviceInfo.queueCreateInfoCount = queueInfoCount;
+    deviceInfo.pQueueCreateInfos = queueInfos;
+    deviceInfo.enabledExtensionCount = (uint32_t)deviceExtensions.size();
+    deviceInfo.ppEnabledExtensionNames = deviceExtensions.data();
+
+    // Enable what the texture table needs if the device has all of it, otherwise windows draw with the ImGui backend
+    VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures = {};
+    indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+    if (apiVersion >= VK_API_VERSION_1_2 && physicalDeviceProperties.apiVersion >= VK_API_VERSION_1_2) {
+        VkPhysicalDeviceFeatures2 features = {};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &indexingFeatures;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+        descriptorIndexing = indexingFeatures.shaderSampledImageArrayNonUniformIndexing && indexingFeatures.runtimeDescriptorArray &&
+            indexingFeatures.descriptorBindingPartiallyBound && indexingFeatures.descriptorBindingSampledImageUpdateAfterBind &&
+            indexingFeatures.descriptorBindingUpdateUnusedWhilePending;
+    }
+    VkPhysicalDeviceDescriptorIndexingFeatures enabledIndexing = {};
+    enabledIndexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+    enabledIndexing.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    enabledIndexing.runtimeDescriptorArray = VK_TRUE;
+    enabledIndexing.descriptorBindingPartiallyBound = VK_TRUE;
+    enabledIndexing.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    enabledIndexing.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+    if (descriptorIndexing)
+        deviceInfo.pNext = &enabledIndexing;
 
     // Create logical device
     err = vkCreateDevice(physicalDevice, &deviceInfo, allocator, &device);
     CheckVkResult(err);
 
-    // Get device queue
+    // Get device queues
     vkGetDeviceQueue(device, queueFamilyIndex, 0, &queue);
+    vkGetDeviceQueue(device, presentQueueFamilyIndex, 0, &presentQueue);
+    if (transferQueueFamilyIndex != UINT32_MAX)
+        vkGetDeviceQueue(device, transferQueueFamilyIndex, 0, &transferQueue);
 }
 
-void Renderer::createDescriptorPool()
-{
-    // Define pool sizes for various descriptor types
-    std::vector<VkDescriptorPoolSize> poolSizes = {
-        { VK_DESCRIPTOR_TYPE_SAMPLER, 1000 },
-        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1000 },
-        { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1000 },
-        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1000 },
-        { VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 1000 },
-        { VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 1000 },
-        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1000 },
-        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1000 },
-        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1000 },
-        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1000 },
-        { VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1000 }
-    };
+void Renderer::createTextureDescriptors()
+{
+    // Texture sets are freed one by one as textures are destroyed
+    textureDescriptors = std::make_unique<DescriptorAllocator>(
+        this, std::vector<DescriptorPoolRatio>{ { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.f } }, true);
+}
+
+void Renderer::createTextureTable()
+{
+    if (descriptorIndexing)
+        textureTable = std::make_unique<TextureTable>(this);
+    else
+        fmt::print("Prism: No descriptor indexing, textures are bound one by one\n");
+}
+
+void Renderer::createTextureSetLayout()
+{
+    VkDescriptorSetLayoutBinding binding = {};
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    binding.descriptorCount = 1;
+    binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &binding;
+    VkResult err = vkCreateDescriptorSetLayout(device, &layoutInfo, allocator, &textureSetLayout);
+    CheckVkResult(err);
+}
+
+void Renderer::createImmediatePool()
+{
+    VkCommandPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = queueFamilyIndex;
+    VkResult err = vkCreateCommandPool(device, &poolInfo, allocator, &immediatePool);
+    CheckVkResult(err);
+}
+
+void Renderer::createMemoryAllocator()
+{
+    memoryAllocator = std::make_unique<MemoryAllocator>(this);
+}
+
+void Renderer::createUploadQueue()
+{
+    uploadQueue = std::make_unique<UploadQueue>(this);
+}
+
+void Renderer::createDeletionQueue()
+{
+    deletionQueue = std::make_unique<DeletionQueue>(this);
+    pendingFrameSerials.reserve(64);
+}
+
+VkResult Renderer::submit(const VkSubmitInfo& submitInfo, VkFence fence)
+{
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return vkQueueSubmit(queue, 1, &submitInfo, fence);
+}
+
+VkResult Renderer::present(const VkPresentInfoKHR& presentInfo)
+{
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return vkQueuePresentKHR(presentQueue, &presentInfo);
+}
+
+VkResult Renderer::submitTransfer(const VkSubmitInfo& submitInfo, VkFence fence)
+{
+    if (!hasTransferQueue())
+        return submit(submitInfo, fence);
+
+    std::lock_guard<std::mutex> lock(transferQueueMutex);
+    return vkQueueSubmit(transferQueue, 1, &submitInfo, fence);
+}
+
+void Renderer::waitIdle()
+{
+    std::scoped_lock lock(queueMutex, transferQueueMutex);
+    vkDeviceWaitIdle(device);
+}
+
+VkDescriptorSet Renderer::allocateTextureDescriptor(VkSampler sampler, VkImageView imageView)
+{
+    VkDescriptorSet descriptorSet = textureDescriptors->allocate(textureSetLayout);
+
+    VkDescriptorImageInfo descImage = {};
+    descImage.sampler = sampler;
+    descImage.imageView = imageView;
+    descImage.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    VkWriteDescriptorSet writeDesc = {};
+    writeDesc.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writeDesc.dstSet = descriptorSet;
+    writeDesc.descriptorCount = 1;
+    writeDesc.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writeDesc.pImageInfo = &descImage;
+    vkUpdateDescriptorSets(device, 1, &writeDesc, 0, nullptr);
+
+    // Mirrored into the texture table, so batched draws sample it without binding the set
+    if (textureTable)
+        textureTable->add(descriptorSet, sampler, imageView);
+    return descriptorSet;
+}
+
+void Renderer::freeTextureDescriptor(VkDescriptorSet descriptorSet)
+{
+    if (textureTable)
+        textureTable->remove(descriptorSet);
+    textureDescriptors->free(descriptorSet);
+}
+
+MemoryHeapBudget Renderer::getMemoryBudget(uint32_t heapIndex) const
+{
+    std::vector<MemoryHeapBudget> budgets = getMemoryBudgets();
+    return heapIndex < budgets.size() ? budgets[heapIndex] : MemoryHeapBudget();
+}
+
+std::vector<MemoryHeapBudget> Renderer::getMemoryBudgets() const
+{
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {};
+    budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    VkPhysicalDeviceMemoryProperties2 properties = {};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    if (memoryBudget) {
+        properties.pNext = &budgetProperties;
+        vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &properties);
+    }
+    else {
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &properties.memoryProperties);
+    }
+
+    const VkPhysicalDeviceMemoryProperties& memoryProperties = properties.memoryProperties;
+    std::vector<MemoryHeapBudget> budgets(memoryProperties.memoryHeapCount);
+    for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+        MemoryHeapBudget& budget = budgets[i];
+        budget.size = memoryProperties.memoryHeaps[i].size;
+        budget.deviceLocal = memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+        if (memoryBudget) {
+            budget.usage = budgetProperties.heapUsage[i];
+            budget.budget = budgetProperties.heapBudget[i];
+        }
+        else {
+            // Other processes are invisible, so leave them some headroom
+            budget.usage = memoryAllocator ? memoryAllocator->getHeapBytes(i) : 0;
+            budget.budget = budget.size / 10 * 8;
+        }
+    }
+    return budgets;
+}
+
+uint32_t Renderer::addMemoryPressureCallback(MemoryPressureCallback callback)
+{
+    std::lock_guard<std::mutex> lock(pressureMutex);
+    const uint32_t id = nextPressureCallbackId++;
+    pressureCallbacks.emplace_back(id, std::move(callback));
+    return id;
+}
+
+void Renderer::removeMemoryPressureCallback(uint32_t id)
+{
+    std::lock_guard<std::mutex> lock(pressureMutex);
+    std::erase_if(pressureCallbacks, [id](const auto& entry) { return entry.first == id; });
+}
+
+void Renderer::notifyMemoryPressure(const MemoryPressure& pressure)
+{
+    // Callbacks freeing memory may allocate too, that pressure is the same pressure
+    static thread_local bool notifying = false;
+    if (notifying)
+        return;
+
+    std::vector<std::pair<uint32_t, MemoryPressureCallback>> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(pressureMutex);
+
+        // Every allocation past the threshold reports the same pressure, once a second is plenty unless one failed
+        const auto now = std::chrono::steady_clock::now();
+        if (pressure.heapIndex >= lastPressureTimes.size())
+            lastPressureTimes.resize(pressure.heapIndex + 1);
+        auto& lastPressure = lastPressureTimes[pressure.heapIndex];
+        if (!pressure.allocationFailed && lastPressure.time_since_epoch().count() != 0 && now - lastPressure < std::chrono::seconds(1))
+            return;
+        lastPressure = now;
+        callbacks = pressureCallbacks;
+    }
+    notifying = true;
+
+    fmt::print("Prism: Memory pressure on heap {}, {} of {} MB used\n", pressure.heapIndex,
+               pressure.heap.usage / (1024 * 1024), pressure.heap.budget / (1024 * 1024));
+    memoryAllocator->trim();
 
-    // Create descriptor pool
-    VkDescriptorPoolCreateInfo poolInfo = {};
-    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
-    poolInfo.maxSets = 1000 * (uint32_t)poolSizes.size();
-    poolInfo.poolSizeCount = (uint32_t)poolSizes.size();
-    poolInfo.pPoolSizes = poolSizes.data();
-    VkResult err = vkCreateDescriptorPool(device, &poolInfo, allocator, &descriptorPool);
+    // Run unlocked so callbacks can add and remove callbacks, skipping any an earlier one removed
+    for (auto& [id, callback] : callbacks)
+    {
+        {
+            std::lock_guard<std::mutex> lock(pressureMutex);
+            if (std::none_of(pressureCallbacks.begin(), pressureCallbacks.end(), [id](const auto& entry) { return entry.first == id; }))
+                continue;
+        }
+        callback(pressure);
+    }
+    notifying = false;
+}
+
+void Renderer::updateMemoryBudget()
+{
+    if (!memoryBudget)
+        return;
+
+    // The budget moves with other processes, but not so fast it needs querying every frame
+    const auto now = std::chrono::steady_clock::now();
+    if (now - lastBudgetCheck < std::chrono::seconds(1))
+        return;
+    lastBudgetCheck = now;
+
+    std::vector<MemoryHeapBudget> budgets = getMemoryBudgets();
+    for (uint32_t i = 0; i < (uint32_t)budgets.size(); i++) {
+        if (budgets[i].budget == 0 || (double)budgets[i].usage <= (double)budgets[i].budget * MemoryAllocator::PressureThreshold)
+            continue;
+        MemoryPressure pressure;
+        pressure.heapIndex = i;
+        pressure.heap = budgets[i];
+        notifyMemoryPressure(pressure);
+    }
+}
+
+uint64_t Renderer::beginFrameSerial()
+{
+    std::lock_guard<std::mutex> lock(frameSerialMutex);
+    pendingFrameSerials.push_back(++latestFrameSerial);
+    return latestFrameSerial;
+}
+
+void Renderer::completeFrameSerial(uint64_t serial)
+{
+    std::lock_guard<std::mutex> lock(frameSerialMutex);
+    auto it = std::find(pendingFrameSerials.begin(), pendingFrameSerials.end(), serial);
+    if (it == pendingFrameSerials.end())
+        return;
+    *it = pendingFrameSerials.back();
+    pendingFrameSerials.pop_back();
+}
+
+uint64_t Renderer::getCompletedFrameSerial()
+{
+    std::lock_guard<std::mutex> lock(frameSerialMutex);
+    if (pendingFrameSerials.empty())
+        return latestFrameSerial;
+    return *std::min_element(pendingFrameSerials.begin(), pendingFrameSerials.end()) - 1;
+}
+
+uint64_t Renderer::getLatestFrameSerial()
+{
+    std::lock_guard<std::mutex> lock(frameSerialMutex);
+    return latestFrameSerial;
+}
+
+void Renderer::submitImmediate(const std::function<void(VkCommandBuffer)>& record)
+{
+    VkResult err;
+
+    // Allocate a one-off command buffer
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = immediatePool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    err = vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
+    CheckVkResult(err);
+
+    // Record the commands
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    err = vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    CheckVkResult(err);
+    record(commandBuffer);
+    err = vkEndCommandBuffer(commandBuffer);
+    CheckVkResult(err);
+
+    // Submit and wait on a fence, so unrelated work on the queue isn't waited on
+    VkFence fence = VK_NULL_HANDLE;
+    VkFenceCreateInfo fenceInfo = {};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    err = vkCreateFence(device, &fenceInfo, allocator, &fence);
     CheckVkResult(err);
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    err = submit(submitInfo, fence);
+    CheckVkResult(err);
+    err = vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+    CheckVkResult(err);
+
+    vkDestroyFence(device, fence, allocator);
+    vkFreeCommandBuffers(device, immediatePool, 1, &commandBuffer);
+}
+
+uint32_t Renderer::findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties) const
+{
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+        if ((typeBits & (1u << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+            return i;
+
+    fmt::print("Vulkan error: No memory type matching properties {:#x}\n", (uint32_t)properties);
+    abort();
+}
+
+std::shared_ptr<FontAtlas> Renderer::getFontAtlas()
+{
+    std::shared_ptr<FontAtlas> atlas = fontAtlas.lock();
+    if (!atlas) {
+        atlas = std::make_shared<FontAtlas>(this);
+        fontAtlas = atlas;
+    }
+    return atlas;
+}
+
+void Renderer::createPipelineCache()
+{
+    // Try to seed the cache from disk
+    std::vector<char> initialData;
+    std::filesystem::path cachePath = getPipelineCachePath();
+    if (!cachePath.empty()) {
+        std::ifstream file(cachePath, std::ios::binary);
+        PipelineCacheFileHeader header = {};
+        if (file.read((char*)&header, sizeof(header))) {
+            // Only hand the blob to the driver if it was written by this exact device & driver
+            PipelineCacheFileHeader expected = MakePipelineCacheHeader(physicalDevice, header.dataSize);
+            if (memcmp(&header, &expected, sizeof(header)) == 0 && header.dataSize > 0) {
+                initialData.resize((size_t)header.dataSize);
+                if (!file.read(initialData.data(), (std::streamsize)initialData.size()))
+                    initialData.clear();
+            }
+        }
+    }
+
+    // Create the pipeline cache
+    VkPipelineCacheCreateInfo cacheInfo = {};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = initialData.size();
+    cacheInfo.pInitialData = initialData.empty() ? nullptr : initialData.data();
+    VkResult err = vkCreatePipelineCache(device, &cacheInfo, allocator, &pipelineCache);
+
+    // A rejected blob shouldn't be fatal, just start from scratch
+    if (err != VK_SUCCESS && !initialData.empty()) {
+        fmt::print("Vulkan: Discarding invalid pipeline cache {}\n", cachePath.string());
+        cacheInfo.initialDataSize = 0;
+        cacheInfo.pInitialData = nullptr;
+        err = vkCreatePipelineCache(device, &cacheInfo, allocator, &pipelineCache);
+    }
+    CheckVkResult(err);
+}
+
+void Renderer::savePipelineCache()
+{
+    std::filesystem::path cachePath = getPipelineCachePath();
+    if (cachePath.empty())
+        return;
+
+    // Fetch the cache blob from the driver
+    size_t dataSize = 0;
+    if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0)
+        return;
+    std::vector<char> data(dataSize);
+    if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, data.data()) != VK_SUCCESS)
+        return;
+
+    std::error_code ec;
+    std::filesystem::create_directories(cachePath.parent_path(), ec);
+    if (ec) return;
+
+    // Write to a unique temporary file and swap it in, other instances may be reading or writing too
+    std::filesystem::path tempPath = cachePath;
+    tempPath += fmt::format(".{}.tmp", std::chrono::steady_clock::now().time_since_epoch().count());
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        PipelineCacheFileHeader header = MakePipelineCacheHeader(physicalDevice, dataSize);
+        file.write((const char*)&header, sizeof(header));
+        file.write(data.data(), (std::streamsize)dataSize);
+        if (!file.good()) {
+            file.close();
+            std::filesystem::remove(tempPath, ec);
+            return;
+        }
+    }
+
+    std::filesystem::rename(tempPath, cachePath, ec);
+    if (ec) {
+        fmt::print("Vulkan: Failed to write pipeline cache {}: {}\n", cachePath.string(), ec.message());
+        std::filesystem::remove(tempPath, ec);
+    }
+}
+
+std::filesystem::path Renderer::getCacheDirectory() const
+{
+    if (!settings.diskCache)
+        return {};
+    if (!settings.cacheDirectory.empty())
+        return settings.cacheDirectory;
+
+    // Default to the system temp directory
+    std::error_code ec;
+    std::filesystem::path tempDirectory = std::filesystem::temp_directory_path(ec);
+    if (ec) return {};
+    return tempDirectory / "prism";
+}
+
+std::filesystem::path Renderer::getPipelineCachePath() const
+{
+    std::filesystem::path cacheDirectory = getCacheDirectory();
+    if (cacheDirectory.empty())
+        return {};
+
+    // One file per device, so machines with multiple GPUs don't keep evicting each other
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    return cacheDirectory / fmt::format("pipeline_cache_{:04x}_{:04x}.bin", properties.vendorID, properties.deviceID);
 }
 
 void Renderer::CheckVkResult(VkResult result)
@@ -241,18 +877,11 @@ void Renderer::CheckVkResult(VkResult result)
     if (result < 0) abort();                        // Abort on major errors (below 0)
 }
 
-void Renderer::setupWindow(Window* window,
-                           VkSurfaceKHR surface,
-                           int width,
-                           int height)
+VkSurfaceFormatKHR Renderer::selectSurfaceFormat(VkSurfaceKHR surface) const
 {
-    // Set the window surface
-    auto* imguiWindow = window->getImGuiWindow();
-    imguiWindow->Surface = surface;
-
     // Check for WSI support
     VkBool32 res;
-    vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, queueFamilyIndex, imguiWindow->Surface, &res);
+    vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, presentQueueFamilyIndex, surface, &res);
     if (res != VK_TRUE) {
         fmt::print("Error: WSI not supported on selected physical device\n");
         abort();
@@ -261,20 +890,14 @@ void Renderer::setupWindow(Window* window,
     // Select surface format
     const VkFormat requestSurfaceImageFormat[] = { VK_FORMAT_B8G8R8A8_UNORM, VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_B8G8R8_UNORM, VK_FORMAT_R8G8B8_UNORM };
     const VkColorSpaceKHR requestSurfaceColorSpace = VK_COLORSPACE_SRGB_NONLINEAR_KHR;
-    imguiWindow->SurfaceFormat = ImGui_ImplVulkanH_SelectSurfaceFormat(physicalDevice, imguiWindow->Surface, requestSurfaceImageFormat, (size_t)IM_ARRAYSIZE(requestSurfaceImageFormat), requestSurfaceColorSpace);
-
-    // Select Present Mode
-#ifdef IMGUI_UNLIMITED_FRAME_RATE
-    VkPresentModeKHR presentModes[] = { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_KHR };
-#else
-    VkPresentModeKHR presentModes[] = { VK_PRESENT_MODE_FIFO_KHR };
-#endif
-    imguiWindow->PresentMode = ImGui_ImplVulkanH_SelectPresentMode(physicalDevice, imguiWindow->Surface, &presentModes[0], IM_ARRAYSIZE(presentModes));
+    return ImGui_ImplVulkanH_SelectSurfaceFormat(physicalDevice, surface, requestSurfaceImageFormat, (size_t)IM_ARRAYSIZE(requestSurfaceImageFormat), requestSurfaceColorSpace);
+}
 
-    // Create SwapChain, RenderPass, Framebuffer, etc.
-    uint32_t minImageCount = window->getMinImageCount();
-    assert(minImageCount >= 2);
-    ImGui_ImplVulkanH_CreateOrResizeWindow(instance, physicalDevice, device, imguiWindow, queueFamilyIndex, allocator, width, height, minImageCount);
+VkPresentModeKHR Renderer::selectPresentMode(VkSurfaceKHR surface, VkPresentModeKHR requested) const
+{
+    // FIFO is always supported
+    VkPresentModeKHR presentModes[] = { requested, VK_PRESENT_MODE_FIFO_KHR };
+    return ImGui_ImplVulkanH_SelectPresentMode(physicalDevice, surface, &presentModes[0], IM_ARRAYSIZE(presentModes));
 }
 
 // Debug callback function for Vulkan validation layers
@@ -0,0 +1,17 @@
+#version 450 core
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Samples the texture table, the slot may change between triangles of one draw
+
+layout(set = 0, binding = 0) uniform sampler2D textures[];
+
+layout(location = 0) in vec4 inColor;
+layout(location = 1) in vec2 inUV;
+layout(location = 2) flat in uint inTexture;
+
+layout(location = 0) out vec4 fragColor;
+
+void main()
+{
+    fragColor = inColor * texture(textures[nonuniformEXT(inTexture)], inUV);
+}
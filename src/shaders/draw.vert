@@ -0,0 +1,26 @@
+#version 450 core
+
+// Batched ImGui vertices, each carrying the texture table slot its command samples
+
+layout(location = 0) in vec2 aPos;
+layout(location = 1) in vec2 aUV;
+layout(location = 2) in vec4 aColor;
+layout(location = 3) in uint aTexture;
+
+layout(push_constant) uniform PushConstants
+{
+    vec2 scale;
+    vec2 translate;
+} pc;
+
+layout(location = 0) out vec4 outColor;
+layout(location = 1) out vec2 outUV;
+layout(location = 2) flat out uint outTexture;
+
+void main()
+{
+    outColor = aColor;
+    outUV = aUV;
+    outTexture = aTexture;
+    gl_Position = vec4(aPos * pc.scale + pc.translate, 0.0, 1.0);
+}
@@ -0,0 +1,286 @@
+#include "prism/swapchain.h"
+#include "prism/renderer.h"
+#include "prism/prism.h"
+#include <algorithm>
+#include <vector>
+
+namespace Prism {
+
+Swapchain::Swapchain(VkSurfaceKHR surface, VkSurfaceFormatKHR surfaceFormat) :
+    renderer(Application::Get().getRenderer()),
+    surface(surface),
+    surfaceFormat(surfaceFormat)
+{
+    createRenderPass();
+}
+
+Swapchain::Swapchain(VkSurfaceFormatKHR surfaceFormat) :
+    renderer(Application::Get().getRenderer()),
+    surfaceFormat(surfaceFormat)
+{
+    createRenderPass();
+}
+
+Swapchain::~Swapchain()
+{
+    // The window waited for its frames, so everything can go right away
+    for (RetiredSwapchain& retired : retiredSwapchains)
+        destroySwapchain(retired.swapchain, retired.images);
+    retiredSwapchains.clear();
+    destroySwapchain(swapchain, images);
+    vkDestroyRenderPass(renderer->getDevice(), renderPass, renderer->getAllocator());
+    if (surface != VK_NULL_HANDLE)
+        vkDestroySurfaceKHR(renderer->getInstance(), surface, renderer->getAllocator());
+}
+
+bool Swapchain::recreate(uint32_t width, uint32_t height, VkPresentModeKHR presentMode, uint32_t minImageCount)
+{
+    VkResult err;
+    VkDevice device = renderer->getDevice();
+
+    // Without a surface the images are simply recreated at the requested size
+    if (isHeadless()) {
+        if (width == 0 || height == 0)
+            return false;
+        retireSwapchain();
+        extent = { width, height };
+        createImages(std::max(minImageCount, 1u));
+        return true;
+    }
+
+    // The surface dictates the size, unless it leaves it up to us
+    VkSurfaceCapabilitiesKHR capabilities;
+    err = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(renderer->getPhysicalDevice(), surface, &capabilities);
+    Renderer::CheckVkResult(err);
+    VkExtent2D newExtent = capabilities.currentExtent;
+    if (newExtent.width == 0xFFFFFFFF) {
+        newExtent.width = std::clamp(width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
+        newExtent.height = std::clamp(height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+    }
+    if (newExtent.width == 0 || newExtent.height == 0)
+        return false;
+
+    minImageCount = std::max(minImageCount, capabilities.minImageCount);
+    if (capabilities.maxImageCount != 0)
+        minImageCount = std::min(minImageCount, capabilities.maxImageCount);
+
+    // Handing over the old swapchain lets the driver reuse its resources, rather than waiting for the device
+    VkSwapchainCreateInfoKHR createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+    createInfo.surface = surface;
+    createInfo.minImageCount = minImageCount;
+    createInfo.imageFormat = surfaceFormat.format;
+    createInfo.imageColorSpace = surfaceFormat.colorSpace;
+    createInfo.imageExtent = newExtent;
+    createInfo.imageArrayLayers = 1;
+    createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    // Images are shared rather than transferred between queues when presenting on another family
+    const uint32_t queueFamilies[] = { renderer->getQueueFamilyIndex(), renderer->getPresentQueueFamilyIndex() };
+    if (renderer->hasSeparatePresentQueue()) {
+        createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+        createInfo.queueFamilyIndexCount = 2;
+        createInfo.pQueueFamilyIndices = queueFamilies;
+    }
+    createInfo.preTransform = (capabilities.supportedTransforms & VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR) ? VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR : capabilities.currentTransform;
+    createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+    createInfo.presentMode = presentMode;
+    createInfo.clipped = VK_TRUE;
+    createInfo.oldSwapchain = swapchain;
+    VkSwapchainKHR newSwapchain = VK_NULL_HANDLE;
+    err = vkCreateSwapchainKHR(device, &createInfo, renderer->getAllocator(), &newSwapchain);
+    Renderer::CheckVkResult(err);
+
+    retireSwapchain();
+    swapchain = newSwapchain;
+    extent = newExtent;
+    this->presentMode = presentMode;
+    createImages(0);
+    return true;
+}
+
+VkResult Swapchain::acquireNextImage(VkSemaphore semaphore, uint64_t timeout, uint32_t& imageIndex)
+{
+    if (!retiredSwapchains.empty())
+        collectRetiredSwapchains();
+    if (isHeadless()) {
+        imageIndex = nextHeadlessImage;
+        nextHeadlessImage = (nextHeadlessImage + 1) % (uint32_t)images.size();
+        return VK_SUCCESS;
+    }
+    return vkAcquireNextImageKHR(renderer->getDevice(), swapchain, timeout, semaphore, VK_NULL_HANDLE, &imageIndex);
+}
+
+void Swapchain::createRenderPass()
+{
+    // Cleared every frame and handed straight to the presentation engine, or left for reading back if headless
+    VkAttachmentDescription attachment = {};
+    attachment.format = surfaceFormat.format;
+    attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    attachment.finalLayout = isHeadless() ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    VkAttachmentReference colorRef = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+    VkSubpassDescription subpass = {};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &colorRef;
+
+    // Wait for the acquire semaphore, which the submit waits on at the color output stage
+    VkSubpassDependency dependency = {};
+    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependency.dstSubpass = 0;
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependency.srcAccessMask = 0;
+    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    VkRenderPassCreateInfo renderPassInfo = {};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = 1;
+    renderPassInfo.pAttachments = &attachment;
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+    renderPassInfo.dependencyCount = 1;
+    renderPassInfo.pDependencies = &dependency;
+    VkResult err = vkCreateRenderPass(renderer->getDevice(), &renderPassInfo, renderer->getAllocator(), &renderPass);
+    Renderer::CheckVkResult(err);
+}
+
+void Swapchain::createImages(uint32_t headlessImageCount)
+{
+    VkResult err;
+    VkDevice device = renderer->getDevice();
+    VkAllocationCallbacks* allocator = renderer->getAllocator();
+
+    uint32_t imageCount = headlessImageCount;
+    std::vector<VkImage> swapchainImages;
+    if (!isHeadless()) {
+        err = vkGetSwapchainImagesKHR(device, swapchain, &imageCount, nullptr);
+        Renderer::CheckVkResult(err);
+        swapchainImages.resize(imageCount);
+        err = vkGetSwapchainImagesKHR(device, swapchain, &imageCount, swapchainImages.data());
+        Renderer::CheckVkResult(err);
+    }
+
+    images.resize(imageCount);
+    nextHeadlessImage = 0;
+    for (uint32_t i = 0; i < imageCount; i++) {
+        SwapchainImage& swapchainImage = images[i];
+        if (isHeadless())
+            createHeadlessImage(swapchainImage);
+        else
+            swapchainImage.image = swapchainImages[i];
+
+        // The driver owns presentable images, estimate them at four bytes per pixel
+        if (!isHeadless()) {
+            swapchainImage.trackedBytes = (VkDeviceSize)extent.width * extent.height * 4;
+            renderer->getMemoryAllocator().addExternalBytes(MemoryCategory::Swapchain, swapchainImage.trackedBytes);
+        }
+
+        VkImageViewCreateInfo viewInfo = {};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = swapchainImage.image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = surfaceFormat.format;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.layerCount = 1;
+        err = vkCreateImageView(device, &viewInfo, allocator, &swapchainImage.view);
+        Renderer::CheckVkResult(err);
+
+        VkFramebufferCreateInfo framebufferInfo = {};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = renderPass;
+        framebufferInfo.attachmentCount = 1;
+        framebufferInfo.pAttachments = &swapchainImage.view;
+        framebufferInfo.width = extent.width;
+        framebufferInfo.height = extent.height;
+        framebufferInfo.layers = 1;
+        err = vkCreateFramebuffer(device, &framebufferInfo, allocator, &swapchainImage.framebuffer);
+        Renderer::CheckVkResult(err);
+
+        // Nothing waits on rendering to finish without a present
+        if (isHeadless())
+            continue;
+        VkSemaphoreCreateInfo semaphoreInfo = {};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        err = vkCreateSemaphore(device, &semaphoreInfo, allocator, &swapchainImage.renderCompleteSemaphore);
+        Renderer::CheckVkResult(err);
+    }
+}
+
+void Swapchain::createHeadlessImage(SwapchainImage& swapchainImage)
+{
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = surfaceFormat.format;
+    imageInfo.extent.width = extent.width;
+    imageInfo.extent.height = extent.height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkResult err = vkCreateImage(renderer->getDevice(), &imageInfo, renderer->getAllocator(), &swapchainImage.image);
+    Renderer::CheckVkResult(err);
+    swapchainImage.memory = renderer->getMemoryAllocator().allocateImage(swapchainImage.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Swapchain);
+}
+
+void Swapchain::retireSwapchain()
+{
+    // Frames up to the latest serial may still draw to the old images, and their presents may wait on the
+    // render complete semaphores after that. Once the new swapchain presented as many images, they're through.
+    if (swapchain != VK_NULL_HANDLE || !images.empty()) {
+        RetiredSwapchain retired;
+        retired.serial = renderer->getLatestFrameSerial();
+        retired.presentCount = isHeadless() ? 0 : presentCount + images.size();
+        retired.swapchain = swapchain;
+        retired.images = std::move(images);
+        retiredSwapchains.push_back(std::move(retired));
+        images.clear();
+        swapchain = VK_NULL_HANDLE;
+    }
+    collectRetiredSwapchains();
+}
+
+void Swapchain::collectRetiredSwapchains()
+{
+    const uint64_t completedSerial = renderer->getCompletedFrameSerial();
+    std::erase_if(retiredSwapchains, [&](RetiredSwapchain& retired) {
+        if (retired.serial > completedSerial || retired.presentCount > presentCount)
+            return false;
+        destroySwapchain(retired.swapchain, retired.images);
+        return true;
+    });
+}
+
+void Swapchain::destroySwapchain(VkSwapchainKHR handle, std::vector<SwapchainImage>& swapchainImages)
+{
+    VkDevice device = renderer->getDevice();
+    VkAllocationCallbacks* allocator = renderer->getAllocator();
+    for (SwapchainImage& swapchainImage : swapchainImages) {
+        vkDestroyFramebuffer(device, swapchainImage.framebuffer, allocator);
+        vkDestroyImageView(device, swapchainImage.view, allocator);
+        vkDestroySemaphore(device, swapchainImage.renderCompleteSemaphore, allocator);
+        if (swapchainImage.memory) {
+            vkDestroyImage(device, swapchainImage.image, allocator);
+            renderer->getMemoryAllocator().free(swapchainImage.memory);
+        }
+        renderer->getMemoryAllocator().removeExternalBytes(MemoryCategory::Swapchain, swapchainImage.trackedBytes);
+    }
+    swapchainImages.clear();
+    if (handle != VK_NULL_HANDLE)
+        vkDestroySwapchainKHR(device, handle, allocator);
+}
+
+} // namespace Prism
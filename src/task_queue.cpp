@@ -0,0 +1,70 @@
+#include "prism/task_queue.h"
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+namespace Prism {
+
+TaskQueue::~TaskQueue()
+{
+    Task* task = head.exchange(nullptr, std::memory_order_acquire);
+    while (task) {
+        Task* next = task->next;
+        delete task;
+        task = next;
+    }
+}
+
+bool TaskQueue::push(std::function<void()> func)
+{
+    Task* task = new Task();
+    task->func = std::move(func);
+    return pushTask(task);
+}
+
+bool TaskQueue::push(uint64_t key, std::function<void()> func)
+{
+    Task* task = new Task();
+    task->func = std::move(func);
+    task->key = key;
+    task->coalesced = true;
+    return pushTask(task);
+}
+
+bool TaskQueue::pushTask(Task* task)
+{
+    Task* previous = head.load(std::memory_order_relaxed);
+    do {
+        task->next = previous;
+    } while (!head.compare_exchange_weak(previous, task, std::memory_order_release, std::memory_order_relaxed));
+    return previous == nullptr;
+}
+
+size_t TaskQueue::drain()
+{
+    // Taking the whole stack at once leaves producers nothing to race with
+    Task* task = head.exchange(nullptr, std::memory_order_acquire);
+    if (!task)
+        return 0;
+
+    // The stack is newest first, so the first task seen under a key is the one that runs.
+    // Owning the nodes here frees them all, even if a task throws.
+    std::vector<std::unique_ptr<Task>> tasks;
+    std::unordered_set<uint64_t> coalescedKeys;
+    for (; task; task = task->next) {
+        tasks.emplace_back(task);
+        if (task->coalesced && !coalescedKeys.insert(task->key).second)
+            task->func = nullptr;
+    }
+
+    size_t run = 0;
+    for (auto it = tasks.rbegin(); it != tasks.rend(); ++it) {
+        if (!(*it)->func)
+            continue;
+        (*it)->func();
+        run++;
+    }
+    return run;
+}
+
+} // namespace Prism
@@ -0,0 +1,137 @@
+#include "prism/texture.h"
+#include "prism/renderer.h"
+#include "prism/upload_queue.h"
+#include "prism/deletion_queue.h"
+#include "prism/prism.h"
+
+namespace Prism {
+
+Texture::Texture(uint32_t width, uint32_t height, const void* pixels, TextureSettings settings) :
+    renderer(Application::Get().getRenderer()),
+    width(width),
+    height(height),
+    settings(settings)
+{
+    VkResult err;
+    VkDevice device = renderer->getDevice();
+    VkAllocationCallbacks* allocator = renderer->getAllocator();
+
+    const uint32_t pixelSize = GetFormatSize(settings.format);
+    if (pixelSize == 0) {
+        fmt::print("Prism: Unsupported texture format {}\n", (int)settings.format);
+        abort();
+    }
+
+    // Create the image, shared with the transfer queue family if uploads run on one
+    const uint32_t queueFamilies[] = { renderer->getQueueFamilyIndex(), renderer->getTransferQueueFamilyIndex() };
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = settings.format;
+    imageInfo.extent.width = width;
+    imageInfo.extent.height = height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    if (renderer->hasTransferQueue()) {
+        imageInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        imageInfo.queueFamilyIndexCount = 2;
+        imageInfo.pQueueFamilyIndices = queueFamilies;
+    }
+    else {
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    err = vkCreateImage(device, &imageInfo, allocator, &image);
+    Renderer::CheckVkResult(err);
+
+    imageAllocation = renderer->getMemoryAllocator().allocateImage(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Texture);
+
+    // Create the image view
+    VkImageViewCreateInfo viewInfo = {};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = settings.format;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.layerCount = 1;
+    err = vkCreateImageView(device, &viewInfo, allocator, &imageView);
+    Renderer::CheckVkResult(err);
+
+    // Create the sampler
+    VkSamplerCreateInfo samplerInfo = {};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = settings.filter;
+    samplerInfo.minFilter = settings.filter;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerInfo.addressModeU = settings.addressMode;
+    samplerInfo.addressModeV = settings.addressMode;
+    samplerInfo.addressModeW = settings.addressMode;
+    samplerInfo.minLod = -1000;
+    samplerInfo.maxLod = 1000;
+    samplerInfo.maxAnisotropy = 1.0f;
+    err = vkCreateSampler(device, &samplerInfo, allocator, &sampler);
+    Renderer::CheckVkResult(err);
+
+    // Allocate the descriptor set used as the ImGui texture id
+    descriptorSet = renderer->allocateTextureDescriptor(sampler, imageView);
+
+    // Kick off the upload, it completes in the background
+    const VkDeviceSize uploadSize = (VkDeviceSize)width * height * pixelSize;
+    uploadSerial = renderer->getUploadQueue().uploadImage(image, width, height, pixels, uploadSize);
+}
+
+Texture::~Texture()
+{
+    // The upload reads the image until it completes, frames drawing it are waited on by the deletion queue
+    renderer->getUploadQueue().wait(uploadSerial);
+
+    DeletionQueue& deletionQueue = renderer->getDeletionQueue();
+    deletionQueue.freeDescriptorSet(descriptorSet);
+    deletionQueue.destroySampler(sampler);
+    deletionQueue.destroyImageView(imageView);
+    deletionQueue.destroyImage(image);
+    deletionQueue.freeMemory(imageAllocation);
+    descriptorSet = VK_NULL_HANDLE;
+    sampler = VK_NULL_HANDLE;
+    imageView = VK_NULL_HANDLE;
+    image = VK_NULL_HANDLE;
+}
+
+bool Texture::isReady() const
+{
+    return renderer->getUploadQueue().isComplete(uploadSerial);
+}
+
+void Texture::wait() const
+{
+    renderer->getUploadQueue().wait(uploadSerial);
+}
+
+uint32_t Texture::GetFormatSize(VkFormat format)
+{
+    switch (format) {
+        case VK_FORMAT_R8_UNORM:
+            return 1;
+        case VK_FORMAT_R8G8_UNORM:
+            return 2;
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+        case VK_FORMAT_R32_SFLOAT:
+            return 4;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+            return 8;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+} // namespace Prism
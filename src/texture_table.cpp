@@ -0,0 +1,156 @@
+#include "prism/texture_table.h"
+#include "prism/renderer.h"
+#include <algorithm>
+
+namespace Prism {
+
+TextureTable::TextureTable(Renderer* renderer) :
+    renderer(renderer)
+{
+    VkResult err;
+    VkDevice device = renderer->getDevice();
+    VkAllocationCallbacks* allocator = renderer->getAllocator();
+    capacity = queryCapacity();
+
+    // Slots are written while frames sampling other slots are pending, and unwritten ones are never read
+    VkDescriptorSetLayoutBinding binding = {};
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    binding.descriptorCount = capacity;
+    binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    const VkDescriptorBindingFlags bindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+        VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo = {};
+    bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    bindingFlagsInfo.bindingCount = 1;
+    bindingFlagsInfo.pBindingFlags = &bindingFlags;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = &bindingFlagsInfo;
+    layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &binding;
+    err = vkCreateDescriptorSetLayout(device, &layoutInfo, allocator, &setLayout);
+    Renderer::CheckVkResult(err);
+
+    // The pool only ever holds the one set
+    VkDescriptorPoolSize poolSize = {};
+    poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSize.descriptorCount = capacity;
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    err = vkCreateDescriptorPool(device, &poolInfo, allocator, &descriptorPool);
+    Renderer::CheckVkResult(err);
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &setLayout;
+    err = vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet);
+    Renderer::CheckVkResult(err);
+
+    fmt::print("Prism: Bindless texture table with {} slots\n", capacity);
+}
+
+TextureTable::~TextureTable()
+{
+    VkDevice device = renderer->getDevice();
+    VkAllocationCallbacks* allocator = renderer->getAllocator();
+
+    // Destroying the pool frees the array
+    vkDestroyDescriptorPool(device, descriptorPool, allocator);
+    vkDestroyDescriptorSetLayout(device, setLayout, allocator);
+    descriptorPool = VK_NULL_HANDLE;
+    setLayout = VK_NULL_HANDLE;
+    descriptorSet = VK_NULL_HANDLE;
+}
+
+uint32_t TextureTable::add(VkDescriptorSet textureId, VkSampler sampler, VkImageView imageView)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (slots.count(textureId))
+        return slots[textureId];
+
+    // Textures past the capacity still draw, windows fall back to the ImGui backend for frames showing them
+    uint32_t slot;
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    else if (nextSlot < capacity) {
+        slot = nextSlot++;
+    }
+    else {
+        if (!full)
+            fmt::print("Prism: Texture table is full, {} slots\n", capacity);
+        full = true;
+        return InvalidSlot;
+    }
+
+    VkDescriptorImageInfo descImage = {};
+    descImage.sampler = sampler;
+    descImage.imageView = imageView;
+    descImage.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    VkWriteDescriptorSet writeDesc = {};
+    writeDesc.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writeDesc.dstSet = descriptorSet;
+    writeDesc.dstArrayElement = slot;
+    writeDesc.descriptorCount = 1;
+    writeDesc.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writeDesc.pImageInfo = &descImage;
+    vkUpdateDescriptorSets(renderer->getDevice(), 1, &writeDesc, 0, nullptr);
+
+    slots.emplace(textureId, slot);
+    return slot;
+}
+
+void TextureTable::remove(VkDescriptorSet textureId)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = slots.find(textureId);
+    if (it == slots.end())
+        return;
+
+    // The slot keeps its stale descriptor until reused, nothing samples it meanwhile
+    freeSlots.push_back(it->second);
+    slots.erase(it);
+    full = false;
+}
+
+uint32_t TextureTable::find(VkDescriptorSet textureId) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = slots.find(textureId);
+    return it != slots.end() ? it->second : InvalidSlot;
+}
+
+uint32_t TextureTable::getSize() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return (uint32_t)slots.size();
+}
+
+uint32_t TextureTable::queryCapacity() const
+{
+    VkPhysicalDeviceDescriptorIndexingProperties indexingProperties = {};
+    indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties = {};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &indexingProperties;
+    vkGetPhysicalDeviceProperties2(renderer->getPhysicalDevice(), &properties);
+
+    // Combined image samplers count against both the sampler and the sampled image limits
+    return std::min({ MaxCapacity,
+                      indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers,
+                      indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                      indexingProperties.maxDescriptorSetUpdateAfterBindSamplers,
+                      indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages });
+}
+
+} // namespace Prism
@@ -0,0 +1,273 @@
+#include "prism/upload_queue.h"
+#include "prism/renderer.h"
+#include <cstring>
+
+namespace Prism {
+
+// Staging offsets must be a multiple of the texel size and 4, this covers every format up to 128 bits
+static constexpr VkDeviceSize StagingAlignment = 16;
+
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+UploadQueue::UploadQueue(Renderer* renderer, VkDeviceSize ringSize) :
+    renderer(renderer),
+    ringSize(ringSize)
+{
+    VkResult err;
+    VkDevice device = renderer->getDevice();
+
+    // Command pool on the queue family uploads run on
+    VkCommandPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = renderer->getTransferQueueFamilyIndex();
+    err = vkCreateCommandPool(device, &poolInfo, renderer->getAllocator(), &commandPool);
+    Renderer::CheckVkResult(err);
+
+    // The staging ring stays mapped for the lifetime of the queue
+    createStagingBuffer(ringSize, ringBuffer, ringAllocation);
+    ringMapped = (uint8_t*)ringAllocation.mapped;
+}
+
+UploadQueue::~UploadQueue()
+{
+    VkDevice device = renderer->getDevice();
+    VkAllocationCallbacks* allocator = renderer->getAllocator();
+
+    // Let every upload finish, their staging data lives in the ring
+    std::lock_guard<std::mutex> lock(mutex);
+    while (!pending.empty())
+        retire(true);
+
+    for (VkFence fence : freeFences)
+        vkDestroyFence(device, fence, allocator);
+    freeFences.clear();
+    freeCommandBuffers.clear();
+    if (commandPool != VK_NULL_HANDLE) {
+        vkDestroyCommandPool(device, commandPool, allocator);
+        commandPool = VK_NULL_HANDLE;
+    }
+
+    if (ringBuffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device, ringBuffer, allocator);
+        ringBuffer = VK_NULL_HANDLE;
+    }
+    renderer->getMemoryAllocator().free(ringAllocation);
+    ringMapped = nullptr;
+}
+
+uint64_t UploadQueue::uploadImage(VkImage image, uint32_t width, uint32_t height, const void* pixels, VkDeviceSize size)
+{
+    return submitUpload(image, { 0, 0 }, { width, height }, pixels, size, false);
+}
+
+uint64_t UploadQueue::uploadImageRegion(VkImage image, VkOffset2D offset, VkExtent2D extent, const void* pixels, VkDeviceSize size)
+{
+    return submitUpload(image, offset, extent, pixels, size, true);
+}
+
+uint64_t UploadQueue::submitUpload(VkImage image, VkOffset2D offset, VkExtent2D extent, const void* pixels, VkDeviceSize size, bool preserve)
+{
+    VkResult err;
+    VkDevice device = renderer->getDevice();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    retire(false);
+
+    PendingUpload upload;
+    upload.serial = nextSerial++;
+
+    // Stage the pixels, in the ring if they fit or in a buffer of their own if they don't
+    VkBuffer srcBuffer = ringBuffer;
+    VkDeviceSize srcOffset = 0;
+    if (size > ringSize) {
+        createStagingBuffer(size, upload.stagingBuffer, upload.stagingAllocation);
+        memcpy(upload.stagingAllocation.mapped, pixels, (size_t)size);
+        srcBuffer = upload.stagingBuffer;
+        upload.ringEnd = ringHead;
+    }
+    else {
+        srcOffset = allocateRing(size);
+        memcpy(ringMapped + srcOffset, pixels, (size_t)size);
+        ringHead = srcOffset + size;
+        upload.ringEnd = ringHead;
+    }
+
+    // Reuse a retired command buffer and fence if there is one
+    if (!freeCommandBuffers.empty()) {
+        upload.commandBuffer = freeCommandBuffers.back();
+        freeCommandBuffers.pop_back();
+    }
+    else {
+        VkCommandBufferAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+        err = vkAllocateCommandBuffers(device, &allocInfo, &upload.commandBuffer);
+        Renderer::CheckVkResult(err);
+    }
+    if (!freeFences.empty()) {
+        upload.fence = freeFences.back();
+        freeFences.pop_back();
+    }
+    else {
+        VkFenceCreateInfo fenceInfo = {};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        err = vkCreateFence(device, &fenceInfo, renderer->getAllocator(), &upload.fence);
+        Renderer::CheckVkResult(err);
+    }
+
+    // Record the copy
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    err = vkBeginCommandBuffer(upload.commandBuffer, &beginInfo);
+    Renderer::CheckVkResult(err);
+
+    // Transfer queues can't reference shader stages, the fence makes the image visible to the graphics queue instead.
+    // Kept contents are read by earlier frames, which have to finish sampling before the copy overwrites them.
+    const bool dedicatedQueue = renderer->hasTransferQueue();
+    const VkPipelineStageFlags readStage = dedicatedQueue ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    VkImageMemoryBarrier copyBarrier = {};
+    copyBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    copyBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    copyBarrier.oldLayout = preserve ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+    copyBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    copyBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    copyBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    copyBarrier.image = image;
+    copyBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    copyBarrier.subresourceRange.levelCount = 1;
+    copyBarrier.subresourceRange.layerCount = 1;
+    const VkPipelineStageFlags copyWaitStage = preserve && !dedicatedQueue ? readStage : (VkPipelineStageFlags)VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    vkCmdPipelineBarrier(upload.commandBuffer, copyWaitStage, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &copyBarrier);
+
+    VkBufferImageCopy region = {};
+    region.bufferOffset = srcOffset;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset.x = offset.x;
+    region.imageOffset.y = offset.y;
+    region.imageExtent.width = extent.width;
+    region.imageExtent.height = extent.height;
+    region.imageExtent.depth = 1;
+    vkCmdCopyBufferToImage(upload.commandBuffer, srcBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    VkImageMemoryBarrier useBarrier = copyBarrier;
+    useBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    useBarrier.dstAccessMask = dedicatedQueue ? 0 : VK_ACCESS_SHADER_READ_BIT;
+    useBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    useBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    vkCmdPipelineBarrier(upload.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, readStage, 0, 0, nullptr, 0, nullptr, 1, &useBarrier);
+
+    err = vkEndCommandBuffer(upload.commandBuffer);
+    Renderer::CheckVkResult(err);
+
+    // Submit without waiting, the fence tells us when it's done
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &upload.commandBuffer;
+    err = renderer->submitTransfer(submitInfo, upload.fence);
+    Renderer::CheckVkResult(err);
+
+    pending.push_back(upload);
+    return upload.serial;
+}
+
+bool UploadQueue::isComplete(uint64_t serial)
+{
+    if (serial <= completedSerial)
+        return true;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    retire(false);
+    return serial <= completedSerial;
+}
+
+void UploadQueue::wait(uint64_t serial)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    while (serial > completedSerial && !pending.empty())
+        retire(true);
+}
+
+void UploadQueue::poll()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    retire(false);
+}
+
+void UploadQueue::retire(bool waitForOldest)
+{
+    VkDevice device = renderer->getDevice();
+
+    if (waitForOldest && !pending.empty()) {
+        VkResult err = vkWaitForFences(device, 1, &pending.front().fence, VK_TRUE, UINT64_MAX);
+        Renderer::CheckVkResult(err);
+    }
+
+    // Uploads complete in submission order, so stop at the first one still running
+    while (!pending.empty()) {
+        PendingUpload& upload = pending.front();
+        if (vkGetFenceStatus(device, upload.fence) != VK_SUCCESS)
+            break;
+
+        VkResult err = vkResetFences(device, 1, &upload.fence);
+        Renderer::CheckVkResult(err);
+        freeFences.push_back(upload.fence);
+        freeCommandBuffers.push_back(upload.commandBuffer);
+        if (upload.stagingBuffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, upload.stagingBuffer, renderer->getAllocator());
+            renderer->getMemoryAllocator().free(upload.stagingAllocation);
+        }
+
+        ringTail = upload.ringEnd;
+        completedSerial = upload.serial;
+        pending.pop_front();
+    }
+
+    // Nothing in flight, start from the beginning of the ring again
+    if (pending.empty())
+        ringHead = ringTail = 0;
+}
+
+VkDeviceSize UploadQueue::allocateRing(VkDeviceSize size)
+{
+    while (true) {
+        // Data in use spans [tail, head), wrapping around the end of the ring if head is behind tail
+        const VkDeviceSize offset = AlignUp(ringHead, StagingAlignment);
+        if (ringHead >= ringTail) {
+            if (offset + size <= ringSize)
+                return offset;
+            // Wrap around, but never let head catch up with tail or the ring would look empty
+            if (size < ringTail)
+                return 0;
+        }
+        else if (offset + size < ringTail) {
+            return offset;
+        }
+
+        // Full, wait for the oldest upload to free its space
+        retire(true);
+    }
+}
+
+void UploadQueue::createStagingBuffer(VkDeviceSize size, VkBuffer& buffer, MemoryAllocation& allocation) const
+{
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VkResult err = vkCreateBuffer(renderer->getDevice(), &bufferInfo, renderer->getAllocator(), &buffer);
+    Renderer::CheckVkResult(err);
+
+    allocation = renderer->getMemoryAllocator().allocateBuffer(buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Staging);
+}
+
+} // namespace Prism
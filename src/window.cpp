@@ -1,7 +1,14 @@
 #include "prism/window.h"
+#include "prism/font_atlas.h"
+#include "prism/deletion_queue.h"
+#include "prism/swapchain.h"
+#include "prism/draw_backend.h"
 #include "prism/colors.h"
 #include "prism/prism.h"
 #include <fmt/core.h>
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
 #include <iostream>
 #include <thread>
 #include <chrono>
@@ -19,18 +26,101 @@
 #include <GLFW/glfw3.h>
 #include <GLFW/glfw3native.h>
 
-#include "prism/embeds/roboto_regular.embed"
-#include "prism/embeds/roboto_italic.embed"
-#include "prism/embeds/roboto_bold.embed"
-
-#ifndef PRISM_EXCLUDE_FA
-#include "prism/embeds/font_awesome.embed"
-#include "prism/fa_embedings.h"
-#endif
-
 // I will hopefully someday remove this stuff
 #include "prism/imgui_rip.h"
-static void UpdateKeyModifiers(GLFWwindow* glfwWindow);
+static void UpdateKeyModifiers(ImGuiIO& io, int mods);
+static int KeyToModifier(int keycode);
+
+// The ImGui Vulkan backend creates and destroys its own font texture, writing the texture id into io.Fonts.
+// Point it at a 1x1 placeholder atlas for those calls, so the shared atlas is never touched.
+template<typename F>
+static void WithPlaceholderFontAtlas(F&& func)
+{
+    ImGuiIO& io = ImGui::GetIO();
+    ImFontAtlas* sharedAtlas = io.Fonts;
+
+    ImFontAtlas placeholder;
+    placeholder.TexWidth = placeholder.TexHeight = 1;
+    placeholder.TexPixelsRGBA32 = (unsigned int*)IM_ALLOC(sizeof(unsigned int));
+    *placeholder.TexPixelsRGBA32 = IM_COL32_WHITE;
+
+    io.Fonts = &placeholder;
+    func();
+    io.Fonts = sharedAtlas;
+}
+
+// Frames drawn after any input in reactive mode, ImGui needs a few to settle hover states etc.
+static constexpr int InputRedrawFrames = 3;
+
+// Render threads wait in slices of this (in ns), so they notice when they should stop
+static constexpr uint64_t RenderThreadWaitSlice = 100'000'000;
+
+// Upper bound of WindowSettings::framesInFlight
+static constexpr uint32_t MaxFramesInFlight = 3;
+
+// Skipped frames tick at this rate if the monitor doesn't report one
+static constexpr double FallbackRefreshRate = 60.0;
+
+// Sets in a window's ImGui pool, the backend allocates one for its font texture
+static constexpr uint32_t ImGuiDescriptorSets = 4;
+
+// Descriptors per set of the frame allocators, a general mix for custom passes
+static const std::vector<Prism::DescriptorPoolRatio> FrameDescriptorRatios = {
+    { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.f },
+    { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.f },
+    { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.f },
+    { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.f },
+    { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1.f },
+    { VK_DESCRIPTOR_TYPE_SAMPLER, 1.f },
+    { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.f },
+    { VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 0.5f },
+    { VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 0.5f }
+};
+
+// Hashes 8 bytes at a time with a multiply-xorshift, fast enough to run over every vertex each frame
+static uint64_t HashBytes(const void* data, size_t size, uint64_t hash)
+{
+    constexpr uint64_t Multiplier = 0x9E3779B97F4A7C15ull;
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (; size >= sizeof(uint64_t); bytes += sizeof(uint64_t), size -= sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, bytes, sizeof(word));
+        hash = (hash ^ word) * Multiplier;
+        hash ^= hash >> 32;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, bytes, size);
+    hash = (hash ^ tail ^ ((uint64_t)size << 56)) * Multiplier;
+    return hash ^ (hash >> 29);
+}
+
+// Hashes everything that decides what a frame looks like. Frames with draw callbacks can't be compared and hash to 0.
+static uint64_t HashDrawData(const ImDrawData* drawData)
+{
+    uint64_t hash = HashBytes(&drawData->DisplayPos, sizeof(ImVec2), 0);
+    hash = HashBytes(&drawData->DisplaySize, sizeof(ImVec2), hash);
+    hash = HashBytes(&drawData->FramebufferScale, sizeof(ImVec2), hash);
+    for (int n = 0; n < drawData->CmdListsCount; n++) {
+        const ImDrawList* drawList = drawData->CmdLists[n];
+        hash = HashBytes(drawList->VtxBuffer.Data, drawList->VtxBuffer.Size * sizeof(ImDrawVert), hash);
+        hash = HashBytes(drawList->IdxBuffer.Data, drawList->IdxBuffer.Size * sizeof(ImDrawIdx), hash);
+        for (const ImDrawCmd& cmd : drawList->CmdBuffer) {
+            if (cmd.UserCallback != nullptr)
+                return 0;
+            const uint32_t ranges[3] = { cmd.VtxOffset, cmd.IdxOffset, cmd.ElemCount };
+            hash = HashBytes(&cmd.ClipRect, sizeof(cmd.ClipRect), hash);
+            hash = HashBytes(&cmd.TextureId, sizeof(cmd.TextureId), hash);
+            hash = HashBytes(ranges, sizeof(ranges), hash);
+        }
+    }
+    return hash | 1;
+}
+
+// Set by Window::InitNextWindowAsync(), consumed by the next window constructed
+static bool initNextWindowAsync = false;
+
+// The window owning the shared ImGui context in ContextMode::Shared, nullptr if there is none yet
+static Prism::Window* sharedContextHost = nullptr;
 
 std::unordered_map<HWND, WNDPROC> Prism::Window::wndProcMap;
 
@@ -40,15 +130,34 @@ Window::Window(WindowSettings settings) :
     settings(settings)
 {
     VkResult err;
+    const bool async = initNextWindowAsync;
+    initNextWindowAsync = false;
+
+    // In shared mode every window after the host is a viewport of its context, ImGui creates the platform window
+    const bool sharedContext = Application::Get().getContextMode() == ContextMode::Shared;
+    if (sharedContext && sharedContextHost) {
+        viewportWindow = true;
+        viewportHost = sharedContextHost;
+        viewportHost->viewportWindows.push_back(this);
+        imguiContext = viewportHost->imguiContext;
+        fontAtlas = viewportHost->fontAtlas;
+        visible = settings.showOnCreate;
+        this->settings.threadedRendering = false;
+        return;
+    }
 
-    // Create ImGui window instance
-    imguiWindow = new ImGui_ImplVulkanH_Window();
+    // The host draws its viewports on the main thread, where the shared context is current
+    if (sharedContext) {
+        sharedContextHost = this;
+        this->settings.threadedRendering = false;
+    }
 
     // We want a contextless window since we're using Vulkan.
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 
-    // Enforce it being hidden or shown on creation.
-    glfwWindowHint(GLFW_VISIBLE, settings.showOnCreate);
+    // Enforce it being hidden or shown on creation. Windows initialized asynchronously show once their first frame is ready.
+    glfwWindowHint(GLFW_VISIBLE, settings.showOnCreate && !async);
+    visible = settings.showOnCreate && !async;
 
     // Get the monitor the parent window is on. If there is no parent, use the primary monitor.
     GLFWmonitor* monitor = nullptr;
@@ -57,21 +166,10 @@ Window::Window(WindowSettings settings) :
     else
         monitor = glfwGetWindowMonitor(settings.parent->getHandle());
 
-    // Get the monitor's video mode and position.
-    const GLFWvidmode* mode = glfwGetVideoMode(monitor);
-    int monitorX, monitorY;
-    glfwGetMonitorPos(monitor, &monitorX, &monitorY);
-
     // Create the window
     windowHandle = glfwCreateWindow(settings.width, settings.height, settings.title.c_str(), settings.fullscreen ? monitor : nullptr, nullptr);
     glfwSetWindowUserPointer(windowHandle, this);
-
-    // Set the window position
-    // I should probably add a method of falling back to default os window positioning.
-    // For now just spawn the window in the center of the screen.
-    int windowX = monitorX + (mode->width - settings.width) / 2;
-    int windowY = monitorY + (mode->height - settings.height) / 2;
-    glfwSetWindowPos(windowHandle, windowX, windowY);
+    centerOnMonitor();
 
     // Implement the window flags & os specific custom window settings.
     glfwSetWindowAttrib(windowHandle, GLFW_RESIZABLE, settings.resizable);
@@ -81,33 +179,104 @@ Window::Window(WindowSettings settings) :
     // Set the window user pointer to this window class.
     glfwSetWindowUserPointer(windowHandle, this);
 
-    // Setup the vulkan context for the window.
+    // Setup the vulkan context for the window, headless windows draw to offscreen RGBA images instead of a surface
     std::shared_ptr<Renderer> renderer = Application::Get().getRenderer();
-    VkSurfaceKHR surface;
-    err = glfwCreateWindowSurface(renderer->getInstance(), windowHandle, renderer->getAllocator(), &surface);
-    Renderer::CheckVkResult(err);
+    if (renderer->getSettings().headless) {
+        swapchain = std::make_unique<Swapchain>(VkSurfaceFormatKHR{ VK_FORMAT_R8G8B8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR });
+        this->settings.threadedRendering = false;
+    }
+    else {
+        VkSurfaceKHR surface;
+        err = glfwCreateWindowSurface(renderer->getInstance(), windowHandle, renderer->getAllocator(), &surface);
+        Renderer::CheckVkResult(err);
+        swapchain = std::make_unique<Swapchain>(surface, renderer->selectSurfaceFormat(surface));
+    }
 
-    // Create frame buffers
-    int w, h;
-    glfwGetFramebufferSize(windowHandle, &w, &h);
-    renderer->setupWindow(this, surface, w, h);
+    // GLFW may only be asked for the size here, on the main thread
+    int width, height;
+    glfwGetFramebufferSize(windowHandle, &width, &height);
 
-    // Allocate the command buffers
-    allocatedCommandBuffers.resize(minImageCount);
-    resourceFreeQueue.resize(minImageCount);
+    // Everything Vulkan can be created on a worker, ImGui's current context is global so it stays on the main thread
+    if (async) {
+        asyncInit = std::async(std::launch::async, [this, width, height] {
+            initGpuResources(width, height);
+            glfwPostEmptyEvent();
+        });
+        return;
+    }
+    initGpuResources(width, height);
+    initImGui();
+}
+
+void Window::InitNextWindowAsync()
+{
+    initNextWindowAsync = true;
+}
 
+bool Window::finishAsyncInit()
+{
+    if (imguiContext)
+        return true;
+    if (!asyncInit.valid() || asyncInit.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return false;
+    asyncInit.get();
+    initImGui();
+
+    // Show the window with its first frame rather than blank
+    if (!settings.threadedRendering)
+        step();
+    if (settings.showOnCreate)
+        setVisible(true);
+    return true;
+}
+
+void Window::initGpuResources(int width, int height)
+{
+    // Create the swapchain, a window without any area yet gets it on its first frame
+    swapchainNeedRebuild = true;
+    rebuildSwapchain(width, height);
+
+    // Create the frames in flight, independent of the swapchain images
+    createFramesInFlight();
+    updateFrameRate();
+
+    // The backend only allocates its font set, textures go through the renderer's allocator
+    std::shared_ptr<Renderer> renderer = Application::Get().getRenderer();
+    VkDescriptorPoolSize imguiPoolSize = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, ImGuiDescriptorSets };
+    VkDescriptorPoolCreateInfo imguiPoolInfo = {};
+    imguiPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    imguiPoolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+    imguiPoolInfo.maxSets = ImGuiDescriptorSets;
+    imguiPoolInfo.poolSizeCount = 1;
+    imguiPoolInfo.pPoolSizes = &imguiPoolSize;
+    VkResult err = vkCreateDescriptorPool(renderer->getDevice(), &imguiPoolInfo, renderer->getAllocator(), &imguiDescriptorPool);
+    Renderer::CheckVkResult(err);
+
+    // Frames the batched backend can't draw still go through the ImGui backend
+    if (settings.batchedDrawing && DrawBackend::IsSupported(*renderer))
+        drawBackend = std::make_unique<DrawBackend>(renderer.get(), swapchain->getRenderPass(), MaxFramesInFlight);
+}
+
+void Window::initImGui()
+{
     // Debug check version 
     IMGUI_CHECKVERSION();
 
     // Backup the current context, if one exists (since we're creating a new one and it will override the current one)
     ImGuiContext* backupImGuiContext = ImGui::GetCurrentContext();
 
-    // Setup a new ImGui context
-    imguiContext = ImGui::CreateContext();
+    // Setup a new ImGui context on top of the shared font atlas
+    std::shared_ptr<Renderer> renderer = Application::Get().getRenderer();
+    fontAtlas = renderer->getFontAtlas();
+    imguiContext = ImGui::CreateContext(fontAtlas->getAtlas());
     ImGui::SetCurrentContext(imguiContext);
     ImGuiIO& io = ImGui::GetIO();
     io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;   // Enable Keyboard navigation Controls
     io.IniFilename = nullptr;                               // Disable the ImGui .ini file by default. TODO: Add support for this later.
+#ifdef IMGUI_HAS_VIEWPORT
+    if (sharedContextHost == this)
+        io.ConfigFlags |= ImGuiConfigFlags_ViewportsEnable; // Later windows become viewports, the backends create their platform windows
+#endif
 
     // Setup our custom ImGui style
     setDefaultTheme();
@@ -121,77 +290,105 @@ Window::Window(WindowSettings settings) :
     initInfo.QueueFamily = renderer->getQueueFamilyIndex();
     initInfo.Queue = renderer->getQueue();
     initInfo.PipelineCache = renderer->getPipelineCache();
-    initInfo.DescriptorPool = renderer->getDescriptorPool();
+    initInfo.DescriptorPool = imguiDescriptorPool;
     initInfo.Subpass = 0;
-    initInfo.MinImageCount = minImageCount;
-    initInfo.ImageCount = imguiWindow->ImageCount;
+    // The backend cycles its vertex buffers per "image", which only has to outnumber the frames in flight.
+    // Fixing it here keeps it independent of the swapchain, so recreating that never reinitializes the backend.
+    initInfo.MinImageCount = getMinImageCount();
+    initInfo.ImageCount = std::max({ swapchain->getImageCount(), MaxFramesInFlight, initInfo.MinImageCount });
     initInfo.MSAASamples = VK_SAMPLE_COUNT_1_BIT;
     initInfo.Allocator = renderer->getAllocator();
     initInfo.CheckVkResultFn = Renderer::CheckVkResult;
-    ImGui_ImplVulkan_Init(&initInfo, imguiWindow->RenderPass);
+    ImGui_ImplVulkan_Init(&initInfo, swapchain->getRenderPass());
 
     // Setup the window callbacks
     // TODO: This really needs some work
     installGlfwCallbacks();
 
-    // Load default font merged with font awesome
-    ImFontConfig fontConfig;
-    fontConfig.FontDataOwnedByAtlas = false;
-
-    // Roboto font
-    ImFont* robotoFont = io.Fonts->AddFontFromMemoryTTF((void*)Fonts::robotoRegular, sizeof(Fonts::robotoRegular), 20.f, &fontConfig);
-    loadedFonts["default"] = robotoFont;
-    loadedFonts["bold"] = io.Fonts->AddFontFromMemoryTTF((void*)Fonts::robotoBold, sizeof(Fonts::robotoBold), 20.0f, &fontConfig);
-    loadedFonts["italic"] = io.Fonts->AddFontFromMemoryTTF((void*)Fonts::robotoItalic, sizeof(Fonts::robotoItalic), 20.0f, &fontConfig);
-
-    // Font awesome
-#ifndef PRISM_EXCLUDE_FA
-    static const ImWchar faRanges[] = { ICON_MIN_FA, ICON_MAX_FA, 0 };
-    fontConfig.MergeMode = true;         // Merge icon font with the default font
-    fontConfig.GlyphMinAdvanceX = 20.0f; // Ensure icons are rendered with a similar size as the font
-    fontConfig.PixelSnapH = true;        // Align icons on pixel boundaries
-    io.Fonts->AddFontFromMemoryCompressedTTF((void*)Fonts::fontAwesome, sizeof(Fonts::fontAwesome), 20.0f, &fontConfig, faRanges);
-#endif
-    io.FontDefault = robotoFont;
-    io.Fonts->Build();
+    // Let the backend create its font texture against a placeholder, the shared atlas brings its own
+    {
+        auto queueLock = renderer->lockQueue();
+        WithPlaceholderFontAtlas([] { ImGui_ImplVulkan_CreateFontsTexture(); });
+    }
 
-    // Create the font texture
-    ImGui_ImplVulkan_CreateFontsTexture();
+    // Build the shared atlas if this is the first window using it
+    fontAtlas->build();
+    loadedFonts = fontAtlas->getFonts();
+    io.FontDefault = fontAtlas->getFont("default");
+
+    // Viewport windows added while this one initialized asynchronously get the context now
+    for (Window* window : viewportWindows) {
+        window->imguiContext = imguiContext;
+        window->fontAtlas = fontAtlas;
+    }
 
-    // Restore the previous contexts
-    if (backupImGuiContext) ImGui::SetCurrentContext(backupImGuiContext);
+    // Restore the previous contexts. The shared context stays current, ImGui's callbacks on the viewports' windows expect it
+    if (backupImGuiContext && sharedContextHost != this) ImGui::SetCurrentContext(backupImGuiContext);
+
+    // Start acquiring on the render thread
+    if (settings.threadedRendering)
+        renderThread = std::thread(&Window::renderThreadLoop, this);
 }
 
 Window::~Window()
 {
+    // Viewport windows own nothing, ImGui destroys their platform window once they stop being drawn
+    if (viewportWindow) {
+        if (viewportHost)
+            std::erase(viewportHost->viewportWindows, this);
+        return;
+    }
+
+    // A worker still creating resources has to be done first
+    if (asyncInit.valid())
+        asyncInit.wait();
+
+    // Stop the render thread
+    if (renderThread.joinable()) {
+        setFrameState(FrameState::Stopping);
+        renderThread.join();
+    }
+
     // Wait for the device to finish all operations
     auto renderer = Application::Get().getRenderer();
-    vkDeviceWaitIdle(renderer->getDevice());
+    renderer->waitIdle();
+    destroyFramesInFlight();
+    drawBackend.reset();
+
+    // Viewport windows go with the shared context, the application culls them next
+    for (Window* window : viewportWindows) {
+        window->viewportHost = nullptr;
+        window->imguiContext = nullptr;
+        window->windowHandle = nullptr;
+        window->closeRequested = true;
+    }
+    viewportWindows.clear();
+    if (sharedContextHost == this)
+        sharedContextHost = nullptr;
 
     // Clean up ImGui
     if (imguiContext) {
         // Set current context
+        ImGuiContext* context = imguiContext;
         ImGuiContext* backupContext = ImGui::GetCurrentContext();
         ImGui::SetCurrentContext(imguiContext);
         imguiContext = nullptr;
 
         // Shutdown everything within the context
-        ImGui_ImplVulkan_Shutdown();
+        WithPlaceholderFontAtlas([] { ImGui_ImplVulkan_Shutdown(); });
         ImGui_ImplGlfw_Shutdown();
 
-        // Destroy the window context (before full context destruction)
-        ImGui_ImplVulkanH_DestroyWindow(
-            renderer->getInstance(),
-            renderer->getDevice(),
-            imguiWindow,
-            renderer->getAllocator()
-        );
-
         // Destroy the context
         ImGui::DestroyContext();
 
-        // Restore the previous context if it exists
-        if (backupContext) ImGui::SetCurrentContext(backupContext);
+        // Restore the previous context if it exists, unless it was this one
+        if (backupContext && backupContext != context) ImGui::SetCurrentContext(backupContext);
+    }
+
+    // Created before the ImGui context, it exists even if the window never finished initializing
+    if (imguiDescriptorPool) {
+        vkDestroyDescriptorPool(renderer->getDevice(), imguiDescriptorPool, renderer->getAllocator());
+        imguiDescriptorPool = VK_NULL_HANDLE;
     }
 
     // Remove the custom window procedures (just in case, don't want null pointers)
@@ -205,129 +402,560 @@ Window::~Window()
     }
     #endif
 
+    // The surface has to go before the native window
+    swapchain.reset();
+
     // Clean up GLFW resources
     if (windowHandle) {
         glfwDestroyWindow(windowHandle);
         windowHandle = nullptr;
     }
+}
 
-    // Clean up allocated command buffers
-    for (auto& cmdBuf : allocatedCommandBuffers) {
-        if (!cmdBuf.empty())
-            vkFreeCommandBuffers(
-                renderer->getDevice(),
-                imguiWindow->Frames[0].CommandPool,
-                (uint32_t)cmdBuf.size(),
-                cmdBuf.data()
-            );
-    }
+void Window::render()
+{
+    // Threaded windows need their next image first
+    if (!isFrameReady())
+        return;
+    renderFrame();
+}
 
-    // Clear the resource free queue
-    for (auto& queue : resourceFreeQueue) {
-        for (auto& func : queue)
-            func();
-        queue.clear();
-    }
+void Window::step(float deltaTime)
+{
+    if (settings.threadedRendering && !isFrameReady())
+        return;
 
-    delete imguiWindow;
+    // Render even if the last frame was skipped as unchanged
+    const float previousDeltaTime = fixedDeltaTime;
+    if (deltaTime > 0.f)
+        fixedDeltaTime = deltaTime;
+    skipWaitUntil = 0.0;
+    renderFrame();
+    fixedDeltaTime = previousDeltaTime;
 }
 
-void Window::render()
+void Window::renderFrame()
 {
-    // Check context is valid before rendering
-    if (!imguiContext)
+    // Check context is valid before rendering, viewport windows are drawn by their host
+    if (!imguiContext || rendering || viewportWindow)
         return;
+    rendering = true;
+
+    // Last frame's scratch memory is no longer referenced
+    frameArena.reset();
+
+    // Consume a requested frame, threaded windows are paced by their render thread
+    lastRenderTime = glfwGetTime();
+    if (redrawFrames > 0)
+        redrawFrames--;
+    if (!settings.threadedRendering)
+        frameLimiter.markFrame();
+    profiler.beginFrame();
 
     // Swap contexts
     ImGuiContext* backupContext = ImGui::GetCurrentContext();
     ImGui::SetCurrentContext(imguiContext);
     
     // Update the swapchain if needed
-    if (swapchainNeedRebuild)
+    if (frameState == FrameState::Rebuild)
+        swapchainNeedRebuild = true;
+    if (swapchainNeedRebuild) {
         rebuildSwapchain();
 
-    // Start ImGui Frame
+        // Threaded windows draw once the render thread acquired from the new swapchain
+        if (settings.threadedRendering) {
+            setFrameState(swapchainNeedRebuild ? FrameState::Rebuild : FrameState::Acquire);
+            requestRedraw();
+            if (backupContext) ImGui::SetCurrentContext(backupContext);
+            rendering = false;
+            return;
+        }
+    }
+
+    // Track the frame, resources deferred from here on wait for it to complete
+    auto renderer = Application::Get().getRenderer();
+    frameSerial = renderer->beginFrameSerial();
+
+    // Run the work posted from other threads, it may change what this frame shows or add fonts
+    taskQueue.drain();
+
+    // Pick up fonts added since the last frame
+    if (fontAtlas->isDirty()) {
+        fontAtlas->build();
+        loadedFonts = fontAtlas->getFonts();
+    }
+
+    // Feed the input queued since the last frame, then start the ImGui frame
+    processInputEvents();
     ImGui_ImplVulkan_NewFrame();
     ImGui_ImplGlfw_NewFrame();
-    ImGui::NewFrame();
 
-    // Get delta time from imgui
+    // Get delta time from imgui, unless it's fixed
     ImGuiIO& io = ImGui::GetIO();
+    if (fixedDeltaTime > 0.f)
+        io.DeltaTime = fixedDeltaTime;
+    ImGui::NewFrame();
     
     // Run update logic, then render ImGui
-    onUpdate(io.DeltaTime);
-    onRender(io.DeltaTime);
+    {
+        FrameProfiler::Scope scope(&profiler, ProfileScope::Update);
+        onUpdate(io.DeltaTime);
+    }
+    {
+        FrameProfiler::Scope scope(&profiler, ProfileScope::Render);
+        onRender(io.DeltaTime);
+    }
+    drawViewportWindows(io.DeltaTime);
+    profiler.drawOverlay();
 
     // Render
-    ImGui::Render();
+    {
+        FrameProfiler::Scope scope(&profiler, ProfileScope::ImGuiRender);
+        ImGui::Render();
+    }
     ImDrawData* mainDrawData = ImGui::GetDrawData();
+
+    // The atlas may have been rebuilt this frame, its upload ran alongside the frame so far
+    fontAtlas->waitForUpload();
+    const bool viewportsSubmitted = updatePlatformWindows();
     
     ImVec4 clearColor = ImVec4(0.f, 0.f, 0.f, 0.f);
     const bool windowShouldRender = mainDrawData->DisplaySize.x > 0.f && mainDrawData->DisplaySize.y > 0.f;
-    imguiWindow->ClearValue.color.float32[0] = clearColor.x * clearColor.w; // Red
-    imguiWindow->ClearValue.color.float32[1] = clearColor.y * clearColor.w; // Green
-    imguiWindow->ClearValue.color.float32[2] = clearColor.z * clearColor.w; // Blue
-    imguiWindow->ClearValue.color.float32[3] = clearColor.w;                // Alpha
+    clearValue.color.float32[0] = clearColor.x * clearColor.w; // Red
+    clearValue.color.float32[1] = clearColor.y * clearColor.w; // Green
+    clearValue.color.float32[2] = clearColor.z * clearColor.w; // Blue
+    clearValue.color.float32[3] = clearColor.w;                // Alpha
+
+    // Leave the last frame on screen if this one would look exactly the same
+    bool skipFrame = false;
+    if (windowShouldRender && settings.skipUnchangedFrames && !swapchainNeedRebuild) {
+        const uint64_t drawDataHash = HashDrawData(mainDrawData);
+        skipFrame = drawDataHash != 0 && drawDataHash == presentedDrawDataHash;
+        presentedDrawDataHash = drawDataHash;
+    }
+    if (skipFrame) {
+        // Keep ticking at the display's rate, without recording, submitting or presenting
+        const GLFWvidmode* mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+        const double refreshRate = mode && mode->refreshRate > 0 ? (double)mode->refreshRate : FallbackRefreshRate;
+        skipWaitUntil = glfwGetTime() + 1.0 / refreshRate;
+        skippedFrames++;
+    }
     
-    // Frame render
-    if (windowShouldRender)
+    // Frame render, threaded windows hand the recorded frame to their render thread
+    if (windowShouldRender && !skipFrame && settings.threadedRendering) {
+        recordFrame(mainDrawData);
+        setFrameState(FrameState::Recorded);
+    }
+    else if (windowShouldRender && !skipFrame)
         renderAndPresent(mainDrawData);
-    else
-        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+    // The viewports' draws were submitted regardless, a fence has to cover them even when this frame wasn't
+    if (frameSerial != 0 && viewportsSubmitted)
+        submitEmptyFrame();
+
+    // Frames that were never recorded won't be waited on
+    if (frameSerial != 0) {
+        renderer->completeFrameSerial(frameSerial);
+        frameSerial = 0;
+    }
 
     // Restore the previous context
     if (backupContext) ImGui::SetCurrentContext(backupContext);
+    rendering = false;
+}
+
+bool Window::canReuse(const WindowSettings& other) const
+{
+    // Headless windows never render threaded, whatever they were asked for
+    const bool threaded = other.threadedRendering && !isHeadless();
+    return other.fullscreen == settings.fullscreen &&
+        other.useCustomTitlebar == settings.useCustomTitlebar &&
+        threaded == settings.threadedRendering &&
+        other.parent == settings.parent;
+}
+
+void Window::release()
+{
+    // Hidden windows get no input, the frames already submitted just have to finish
+    setVisible(false);
+    if (viewportWindow) {
+        closeRequested = false;
+        return;
+    }
+    glfwSetWindowShouldClose(windowHandle, false);
+    waitForFrames();
+}
+
+void Window::reuse(const WindowSettings& newSettings)
+{
+    const WindowSettings previous = settings;
+    settings = newSettings;
+    settings.threadedRendering = previous.threadedRendering;
+
+    // Viewport windows take their title, size and position when they're next drawn
+    if (!viewportWindow) {
+        glfwSetWindowTitle(windowHandle, settings.title.c_str());
+        glfwSetWindowAttrib(windowHandle, GLFW_RESIZABLE, settings.resizable);
+        if (settings.width != previous.width || settings.height != previous.height)
+            glfwSetWindowSize(windowHandle, settings.width, settings.height);
+        centerOnMonitor();
+
+        // Only what the swapchain depends on rebuilds it, a new size arrives through the framebuffer callback
+        if (settings.presentMode != previous.presentMode ||
+            settings.swapchainImageCount != previous.swapchainImageCount ||
+            settings.framesInFlight != previous.framesInFlight)
+            swapchainNeedRebuild = true;
+        updateFrameRate();
+    }
+
+    // Let the subclass reset its state in its own context
+    ImGuiContext* backupContext = ImGui::GetCurrentContext();
+    ImGui::SetCurrentContext(imguiContext);
+    onReuse();
+    if (backupContext) ImGui::SetCurrentContext(backupContext);
+
+    // Whatever was presented last belongs to the previous use
+    invalidate();
+    requestRedraw(2);
+    if (settings.showOnCreate)
+        setVisible(true);
+}
+
+void Window::post(std::function<void()> func)
+{
+    // Only the first task since the last frame has to wake the main loop
+    if (taskQueue.push(std::move(func)))
+        glfwPostEmptyEvent();
+}
+
+void Window::postFrame(uint64_t key, std::function<void()> func)
+{
+    if (taskQueue.push(key, std::move(func)))
+        glfwPostEmptyEvent();
+}
+
+void Window::requestRedraw(int frames)
+{
+    redrawFrames = std::max(redrawFrames, frames);
+    if (viewportHost)
+        viewportHost->requestRedraw(frames);
+}
+
+bool Window::hasPendingRedraw() const
+{
+    if (!imguiContext)
+        return false;
+    if (redrawFrames > 0 || taskQueue.hasPending())
+        return true;
+
+    // A rebuild for requested glyphs came due, they show once a frame builds it
+    if (!viewportWindow && fontAtlas && fontAtlas->getTimeUntilRebuild() <= 0.0)
+        return true;
+
+    // Viewport windows render with their host, as does input ImGui's own callbacks queued on their platform windows
+    for (const Window* window : viewportWindows)
+        if (window->redrawFrames > 0 || window->taskQueue.hasPending())
+            return true;
+#ifdef IMGUI_HAS_VIEWPORT
+    if (!viewportWindows.empty() && imguiContext->InputEventsQueue.Size > 0)
+        return true;
+#endif
+    return false;
+}
+
+bool Window::isFrameReady() const
+{
+    // Windows still initializing have nothing to draw, finishing wakes the main loop. Viewport windows never render on their own.
+    if (!imguiContext || viewportWindow)
+        return false;
+    // Paused windows have nothing to draw, restoring or showing them wakes the main loop
+    if (isPaused())
+        return false;
+    if (glfwGetTime() < skipWaitUntil)
+        return false;
+    if (!settings.threadedRendering)
+        return frameLimiter.isDue();
+    FrameState state = frameState;
+    return state == FrameState::Ready || state == FrameState::Rebuild;
+}
+
+double Window::getTimeUntilFrameReady() const
+{
+    if (isFrameReady())
+        return 0.0;
+
+    if (!imguiContext || viewportWindow || isPaused())
+        return DBL_MAX;
+
+    // The wait after a skipped frame expires on its own, as does the frame rate cap of windows on the main thread
+    const double untilSkipWait = skipWaitUntil - glfwGetTime();
+    if (settings.threadedRendering) {
+        FrameState state = frameState;
+        return (state == FrameState::Ready || state == FrameState::Rebuild) ? std::max(untilSkipWait, 0.0) : DBL_MAX;
+    }
+    return std::max(untilSkipWait, std::chrono::duration<double>(frameLimiter.getDeadline() - FrameLimiter::Clock::now()).count());
+}
+
+uint32_t Window::getMinImageCount() const
+{
+    return getMinImageCount(swapchain->getPresentMode());
+}
+
+uint32_t Window::getMinImageCount(VkPresentModeKHR presentMode) const
+{
+    if (settings.swapchainImageCount != 0)
+        return std::max(settings.swapchainImageCount, 2u);
+    return (uint32_t)std::max(ImGui_ImplVulkanH_GetMinImageCountFromPresentMode(presentMode), 2);
+}
+
+void Window::setFrameState(FrameState state)
+{
+    {
+        std::lock_guard<std::mutex> lock(frameMutex);
+        frameState = state;
+    }
+    frameCondition.notify_all();
 }
 
 void Window::renderAndPresent(ImDrawData* drawData)
 {
     frameRender(drawData);
-    framePresent();
+    if (!swapchainNeedRebuild && !framePresent())
+        swapchainNeedRebuild = true;
+}
+
+void Window::renderThreadLoop()
+{
+    std::unique_lock<std::mutex> lock(frameMutex);
+    while (true) {
+        // Wait until there is something for us to do
+        frameCondition.wait(lock, [this] {
+            FrameState state = frameState;
+            return state == FrameState::Acquire || state == FrameState::Recorded || state == FrameState::Stopping;
+        });
+        FrameState state = frameState;
+        if (state == FrameState::Stopping)
+            return;
+        lock.unlock();
+
+        // Submit and present what the main thread recorded, then go straight on to the next image.
+        // The blocking waits all happen here, so other windows keep rendering meanwhile.
+        bool acquired = false;
+        if (state == FrameState::Recorded) {
+            submitFrame();
+            if (framePresent()) {
+                frameLimiter.wait();
+                acquired = acquireFrame();
+            }
+        }
+        else {
+            frameLimiter.wait();
+            acquired = acquireFrame();
+        }
+
+        // Hand the image to the main thread and wake it up
+        lock.lock();
+        if (frameState == FrameState::Stopping)
+            return;
+        frameState = acquired ? FrameState::Ready : FrameState::Rebuild;
+        glfwPostEmptyEvent();
+    }
 }
 
 bool Window::isShown() const
 {
+    if (viewportWindow)
+        return visible;
     return glfwGetWindowAttrib(windowHandle, GLFW_VISIBLE);
 }
 
 void Window::focus()
 {
+    // ImGui focuses the viewport along with its window
+    if (viewportWindow) {
+        focusRequested = true;
+        requestRedraw();
+        return;
+    }
     glfwFocusWindow(windowHandle);
 }
 
 void Window::minimize()
 {
-    glfwIconifyWindow(windowHandle);
+    // Viewport windows have no platform window until they're first drawn
+    if (windowHandle)
+        glfwIconifyWindow(windowHandle);
 }
 
 bool Window::isFocused() const
 {
-    return glfwGetWindowAttrib(windowHandle, GLFW_FOCUSED);
+    return windowHandle && glfwGetWindowAttrib(windowHandle, GLFW_FOCUSED);
 }
 
 bool Window::isMinimized() const
 {
-    return glfwGetWindowAttrib(windowHandle, GLFW_ICONIFIED);
+    return windowHandle && glfwGetWindowAttrib(windowHandle, GLFW_ICONIFIED);
 }
 
 void Window::maximize()
 {
-    glfwMaximizeWindow(windowHandle);
+    if (windowHandle)
+        glfwMaximizeWindow(windowHandle);
 }
 
 bool Window::isMaximized() const
 {
-    return glfwGetWindowAttrib(windowHandle, GLFW_MAXIMIZED);
+    return windowHandle && glfwGetWindowAttrib(windowHandle, GLFW_MAXIMIZED);
+}
+
+void Window::setPresentMode(VkPresentModeKHR mode)
+{
+    settings.presentMode = mode;
+    swapchainNeedRebuild = true;
+    requestRedraw();
+}
+
+void Window::invalidate()
+{
+    presentedDrawDataHash = 0;
+    skipWaitUntil = 0.0;
+    requestRedraw();
+}
+
+void Window::setSkipUnchangedFrames(bool skip)
+{
+    settings.skipUnchangedFrames = skip;
+    invalidate();
+}
+
+void Window::setFrameRateCap(float fps)
+{
+    settings.frameRateCap = fps;
+    updateFrameRate();
+}
+
+void Window::setUnfocusedFrameRateCap(float fps)
+{
+    settings.unfocusedFrameRateCap = fps;
+    updateFrameRate();
+}
+
+void Window::updateFrameRate()
+{
+    // Unfocused windows take the lower of both caps, either may be uncapped
+    float fps = settings.frameRateCap;
+    if (!focused && settings.unfocusedFrameRateCap > 0.f)
+        fps = fps > 0.f ? std::min(fps, settings.unfocusedFrameRateCap) : settings.unfocusedFrameRateCap;
+    frameLimiter.setFrameRate(fps);
+}
+
+bool Window::isPaused() const
+{
+    if (isHeadless())
+        return false;
+    return iconified || (settings.pauseWhenHidden && !visible);
+}
+
+void Window::setSwapchainImageCount(uint32_t count)
+{
+    settings.swapchainImageCount = count;
+    swapchainNeedRebuild = true;
+    requestRedraw();
+}
+
+void Window::setFramesInFlight(uint32_t count)
+{
+    settings.framesInFlight = count;
+    swapchainNeedRebuild = true;
+    requestRedraw();
+}
+
+bool Window::isHeadless() const
+{
+    return swapchain && swapchain->isHeadless();
+}
+
+bool Window::readPixels(std::vector<uint8_t>& pixels, uint32_t& width, uint32_t& height)
+{
+    if (!isHeadless() || readableImage == UINT32_MAX)
+        return false;
+
+    VkResult err;
+    auto renderer = Application::Get().getRenderer();
+    VkDevice device = renderer->getDevice();
+    const VkExtent2D extent = swapchain->getExtent();
+    const VkDeviceSize size = (VkDeviceSize)extent.width * extent.height * 4;
+
+    // The frame has to be finished before its image can be copied
+    waitForFrames();
+
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    err = vkCreateBuffer(device, &bufferInfo, renderer->getAllocator(), &buffer);
+    Renderer::CheckVkResult(err);
+    MemoryAllocation allocation = renderer->getMemoryAllocator().allocateBuffer(buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Staging);
+
+    // The render pass left the image ready to copy from, the barrier only makes its writes visible
+    VkImage image = swapchain->getImage(readableImage).image;
+    renderer->submitImmediate([&](VkCommandBuffer commandBuffer) {
+        VkImageMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.layerCount = 1;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkBufferImageCopy region = {};
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = { extent.width, extent.height, 1 };
+        vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer, 1, &region);
+    });
+
+    const uint8_t* mapped = (const uint8_t*)allocation.mapped;
+    pixels.assign(mapped, mapped + size);
+    width = extent.width;
+    height = extent.height;
+
+    // The copy completed, nothing else uses the buffer
+    vkDestroyBuffer(device, buffer, renderer->getAllocator());
+    renderer->getMemoryAllocator().free(allocation);
+    return true;
+}
+
+uint32_t Window::getFramesInFlight() const
+{
+    return std::clamp<uint32_t>(settings.framesInFlight, 1, MaxFramesInFlight);
 }
 
 bool Window::shouldClose() const
 {
+    if (viewportWindow)
+        return closeRequested;
     return glfwWindowShouldClose(windowHandle);
 }
 
-void Window::setVisible(bool visible)
+void Window::setVisible(bool show)
 {
-    if (visible)
+    // Viewport windows are drawn or not, ImGui shows and hides their platform window
+    visible = show;
+    if (viewportWindow) {
+        requestRedraw();
+        return;
+    }
+    if (show)
         glfwShowWindow(windowHandle);
     else
         glfwHideWindow(windowHandle);
@@ -335,6 +963,10 @@ void Window::setVisible(bool visible)
 
 void Window::close()
 {
+    if (viewportWindow) {
+        closeRequested = true;
+        return;
+    }
     glfwSetWindowShouldClose(windowHandle, true);
 }
 
@@ -427,6 +1059,9 @@ void Window::setDefaultTheme()
 void Window::installGlfwCallbacks()
 {
     glfwSetWindowFocusCallback(windowHandle, WindowFocusCallback);
+    glfwSetWindowIconifyCallback(windowHandle, WindowIconifyCallback);
+    glfwSetWindowRefreshCallback(windowHandle, WindowRefreshCallback);
+    glfwSetFramebufferSizeCallback(windowHandle, FramebufferSizeCallback);
     glfwSetCursorEnterCallback(windowHandle, CursorEnterCallback);
     glfwSetCursorPosCallback(windowHandle, CursorPosCallback);
     glfwSetMouseButtonCallback(windowHandle, MouseButtonCallback);
@@ -434,6 +1069,175 @@ void Window::installGlfwCallbacks()
     glfwSetCharCallback(windowHandle, CharCallback);
     glfwSetKeyCallback(windowHandle, KeyCallback);
     glfwSetMonitorCallback(MonitorCallback);
+
+    // Events only report changes, start from the current state
+    focused = glfwGetWindowAttrib(windowHandle, GLFW_FOCUSED);
+    iconified = glfwGetWindowAttrib(windowHandle, GLFW_ICONIFIED);
+    updateFrameRate();
+}
+
+void Window::processInputEvents()
+{
+    ImGuiIO& io = ImGui::GetIO();
+    ImGui_ImplGlfw_Data* bd = (ImGui_ImplGlfw_Data*)io.BackendPlatformUserData;
+
+    inputQueue.drain([&](const InputEvent& event) {
+        switch (event.type) {
+        case InputEventType::Focus:
+            io.AddFocusEvent(event.focused);
+            break;
+        case InputEventType::CursorEnter:
+            if (event.entered) {
+                bd->MouseWindow = windowHandle;
+                io.AddMousePosEvent(bd->LastValidMousePos.x, bd->LastValidMousePos.y);
+            }
+            else if (bd->MouseWindow == windowHandle) {
+                bd->LastValidMousePos = io.MousePos;
+                bd->MouseWindow = nullptr;
+                io.AddMousePosEvent(-FLT_MAX, -FLT_MAX);
+            }
+            break;
+        case InputEventType::CursorPos:
+        {
+            // With viewports ImGui works in desktop coordinates
+            ImVec2 position((float)event.position.x, (float)event.position.y);
+#ifdef IMGUI_HAS_VIEWPORT
+            if (io.ConfigFlags & ImGuiConfigFlags_ViewportsEnable) {
+                int windowX, windowY;
+                glfwGetWindowPos(windowHandle, &windowX, &windowY);
+                position.x += (float)windowX;
+                position.y += (float)windowY;
+            }
+#endif
+            io.AddMousePosEvent(position.x, position.y);
+            bd->LastValidMousePos = position;
+            break;
+        }
+        case InputEventType::MouseButton:
+            UpdateKeyModifiers(io, event.mouseButton.mods);
+            if (event.mouseButton.button >= 0 && event.mouseButton.button < ImGuiMouseButton_COUNT)
+                io.AddMouseButtonEvent(event.mouseButton.button, event.mouseButton.action == GLFW_PRESS);
+            break;
+        case InputEventType::Scroll:
+            io.AddMouseWheelEvent((float)event.scroll.x, (float)event.scroll.y);
+            break;
+        case InputEventType::Key:
+        {
+            // X11 leaves the modifier being pressed or released out of its own mods, see glfw/glfw#1630
+            int mods = event.key.mods;
+            if (int keyMod = KeyToModifier(event.key.keycode))
+                mods = event.key.action == GLFW_PRESS ? (mods | keyMod) : (mods & ~keyMod);
+            UpdateKeyModifiers(io, mods);
+
+            if (event.key.keycode >= 0 && event.key.keycode < IM_ARRAYSIZE(bd->KeyOwnerWindows))
+                bd->KeyOwnerWindows[event.key.keycode] = (event.key.action == GLFW_PRESS) ? windowHandle : nullptr;
+
+            ImGuiKey imguiKey = KeyToImGuiKey(event.key.translatedKey);
+            io.AddKeyEvent(imguiKey, event.key.action == GLFW_PRESS);
+            io.SetKeyEventNativeData(imguiKey, event.key.translatedKey, event.key.scancode); // To support legacy indexing (<1.87 user code)
+            break;
+        }
+        case InputEventType::Char:
+            // Typed text may need glyphs the dynamic fonts don't have yet
+            fontAtlas->requestGlyph(event.codepoint);
+            io.AddInputCharacter(event.codepoint);
+            break;
+        }
+    });
+}
+
+void Window::drawViewportWindows(float deltaTime)
+{
+#ifdef IMGUI_HAS_VIEWPORT
+    // Indexed, windows may be added while drawing
+    const ImGuiViewport* mainViewport = ImGui::GetMainViewport();
+    const ImVec2 center(mainViewport->Pos.x + mainViewport->Size.x * 0.5f, mainViewport->Pos.y + mainViewport->Size.y * 0.5f);
+    for (size_t i = 0; i < viewportWindows.size(); i++) {
+        Window& window = *viewportWindows[i];
+        if (!window.visible || window.closeRequested)
+            continue;
+
+        // The same per frame bookkeeping as renderFrame(), the context is already current
+        window.frameArena.reset();
+        window.lastRenderTime = lastRenderTime;
+        if (window.redrawFrames > 0)
+            window.redrawFrames--;
+        window.taskQueue.drain();
+
+        // Always a platform window of its own, never merged into the host or docked
+        ImGuiWindowClass windowClass;
+        windowClass.ViewportFlagsOverrideSet = ImGuiViewportFlags_NoAutoMerge;
+        ImGui::SetNextWindowClass(&windowClass);
+        ImGui::SetNextWindowPos(center, ImGuiCond_Appearing, ImVec2(0.5f, 0.5f));
+        ImGui::SetNextWindowSize(ImVec2((float)window.settings.width, (float)window.settings.height), ImGuiCond_Appearing);
+        if (window.focusRequested) {
+            ImGui::SetNextWindowFocus();
+            window.focusRequested = false;
+        }
+
+        // The id after ### keeps titles free to repeat and change
+        ImGuiWindowFlags flags = ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoDocking;
+        if (!window.settings.resizable)
+            flags |= ImGuiWindowFlags_NoResize;
+        std::string_view name = frameString("{}###PrismWindow{}", window.settings.title, (void*)&window);
+        fontAtlas->requestGlyphs(window.settings.title);
+        bool open = true;
+        window.onUpdate(deltaTime);
+        if (ImGui::Begin(name.data(), &open, flags))
+            window.onRender(deltaTime);
+        window.viewportId = ImGui::GetWindowViewport()->ID;
+        ImGui::End();
+        if (!open)
+            window.close();
+    }
+#endif
+}
+
+bool Window::updatePlatformWindows()
+{
+#ifdef IMGUI_HAS_VIEWPORT
+    if (!(ImGui::GetIO().ConfigFlags & ImGuiConfigFlags_ViewportsEnable))
+        return false;
+
+    // The backends draw and present the viewports on the renderer's queue
+    ImGui::UpdatePlatformWindows();
+    {
+        auto queueLock = Application::Get().getRenderer()->lockQueue();
+        ImGui::RenderPlatformWindowsDefault();
+    }
+
+    // Viewport windows wrap the GLFW window ImGui created for them, while they're drawn
+    const ImGuiViewport* mainViewport = ImGui::GetMainViewport();
+    for (Window* window : viewportWindows) {
+        ImGuiViewport* viewport = window->visible ? ImGui::FindViewportByID(window->viewportId) : nullptr;
+        window->windowHandle = viewport && viewport != mainViewport ? (GLFWwindow*)viewport->PlatformHandle : nullptr;
+    }
+    return ImGui::GetPlatformIO().Viewports.Size > 1;
+#else
+    return false;
+#endif
+}
+
+void Window::centerOnMonitor()
+{
+    // Get the monitor the parent window is on. If there is no parent, use the primary monitor.
+    GLFWmonitor* monitor = nullptr;
+    if (settings.parent == nullptr)
+        monitor = glfwGetPrimaryMonitor();
+    else
+        monitor = glfwGetWindowMonitor(settings.parent->getHandle());
+
+    // Get the monitor's video mode and position.
+    const GLFWvidmode* mode = glfwGetVideoMode(monitor);
+    int monitorX, monitorY;
+    glfwGetMonitorPos(monitor, &monitorX, &monitorY);
+
+    // Set the window position
+    // I should probably add a method of falling back to default os window positioning.
+    // For now just spawn the window in the center of the screen.
+    int windowX = monitorX + (mode->width - settings.width) / 2;
+    int windowY = monitorY + (mode->height - settings.height) / 2;
+    glfwSetWindowPos(windowHandle, windowX, windowY);
 }
 
 void Window::rebuildSwapchain()
@@ -441,136 +1245,428 @@ void Window::rebuildSwapchain()
     // Get the new window size
     int width, height;
     glfwGetFramebufferSize(windowHandle, &width, &height);
+    rebuildSwapchain(width, height);
+}
+
+void Window::rebuildSwapchain(int width, int height)
+{
+    if (width <= 0 || height <= 0)
+        return;
 
-    // If valid size, rebuild the swapchain
-    if (width > 0 && height > 0) {
-        // Wait for the device to be idle
-        auto renderer = Application::Get().getRenderer();
-        vkDeviceWaitIdle(renderer->getDevice());
+    // Replace the swapchain, picking up size, present mode and image count changes. Frames still
+    // drawing to the old one simply finish, it's retired once they complete.
+    // Headless images are handed out round robin, so one per frame in flight keeps them from being drawn to while in use
+    auto renderer = Application::Get().getRenderer();
+    const bool headless = swapchain->isHeadless();
+    const VkPresentModeKHR presentMode = headless ? VK_PRESENT_MODE_FIFO_KHR : renderer->selectPresentMode(swapchain->getSurface(), settings.presentMode);
+    const uint32_t minImageCount = headless ? std::max(getMinImageCount(presentMode), getFramesInFlight()) : getMinImageCount(presentMode);
+    if (!swapchain->recreate((uint32_t)width, (uint32_t)height, presentMode, minImageCount))
+        return;
+    readableImage = UINT32_MAX;
+
+    // An image acquired from the old swapchain won't be drawn, its semaphore still has the signal pending.
+    // An empty batch waiting on it under the frame's fence consumes the signal, the slot's next acquire waits
+    // for that fence first and gets the semaphore back unsignaled. Headless acquires never signal it.
+    if (imageAcquired && !headless && !framesInFlight.empty()) {
+        FrameInFlight& frame = framesInFlight[frameInFlightIndex];
+        VkResult err;
+        {
+            std::lock_guard<std::mutex> lock(frameSerialMutex);
+            err = vkResetFences(renderer->getDevice(), 1, &frame.fence);
+            Renderer::CheckVkResult(err);
+        }
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pWaitSemaphores = &frame.imageAcquiredSemaphore;
+        submitInfo.pWaitDstStageMask = &waitStage;
+        err = renderer->submit(submitInfo, frame.fence);
+        Renderer::CheckVkResult(err);
+    }
+    imageAcquired = false;
 
-        // Rebuild the swapchain
-        ImGui_ImplVulkan_SetMinImageCount(minImageCount);
-        ImGui_ImplVulkanH_CreateOrResizeWindow(
-            renderer->getInstance(),
-            renderer->getPhysicalDevice(),
-            renderer->getDevice(),
-            imguiWindow,
-            renderer->getQueueFamilyIndex(),
-            renderer->getAllocator(),
-            width, height, minImageCount
-        );
+    // Only a new frame count recreates the frames in flight, which waits for this window's frames alone
+    if (!framesInFlight.empty() && framesInFlight.size() != getFramesInFlight()) {
+        waitForFrames();
+        destroyFramesInFlight();
+        createFramesInFlight();
+    }
+
+    // The new images have never been drawn to
+    presentedDrawDataHash = 0;
 
-        // Reallocate the command buffers
-        allocatedCommandBuffers.clear();
-        allocatedCommandBuffers.resize(imguiWindow->ImageCount);
+    // Reset the swapchain flag
+    swapchainNeedRebuild = false;
+}
 
-        // Reset the swapchain flag
-        swapchainNeedRebuild = false;
+void Window::waitForFrames()
+{
+    auto renderer = Application::Get().getRenderer();
+    for (FrameInFlight& frame : framesInFlight) {
+        VkResult err = vkWaitForFences(renderer->getDevice(), 1, &frame.fence, VK_TRUE, UINT64_MAX);
+        Renderer::CheckVkResult(err);
     }
+    completeFinishedFrames();
 }
 
-void Window::frameRender(ImDrawData* drawData)
+void Window::completeFinishedFrames()
+{
+    auto renderer = Application::Get().getRenderer();
+    std::lock_guard<std::mutex> lock(frameSerialMutex);
+    for (FrameInFlight& frame : framesInFlight) {
+        if (frame.serial == 0 || vkGetFenceStatus(renderer->getDevice(), frame.fence) != VK_SUCCESS)
+            continue;
+        renderer->completeFrameSerial(frame.serial);
+        frame.serial = 0;
+    }
+}
+
+void Window::createFramesInFlight()
 {
     VkResult err;
+    auto renderer = Application::Get().getRenderer();
+    VkDevice device = renderer->getDevice();
+    VkAllocationCallbacks* allocator = renderer->getAllocator();
+
+    framesInFlight.resize(getFramesInFlight());
+    frameInFlightIndex = 0;
+    for (FrameInFlight& frame : framesInFlight) {
+        VkCommandPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.queueFamilyIndex = renderer->getQueueFamilyIndex();
+        err = vkCreateCommandPool(device, &poolInfo, allocator, &frame.commandPool);
+        Renderer::CheckVkResult(err);
+
+        VkCommandBufferAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = frame.commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+        err = vkAllocateCommandBuffers(device, &allocInfo, &frame.commandBuffer);
+        Renderer::CheckVkResult(err);
+
+        // Created signaled, the first wait on each frame returns immediately
+        VkFenceCreateInfo fenceInfo = {};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+        err = vkCreateFence(device, &fenceInfo, allocator, &frame.fence);
+        Renderer::CheckVkResult(err);
+
+        VkSemaphoreCreateInfo semaphoreInfo = {};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        err = vkCreateSemaphore(device, &semaphoreInfo, allocator, &frame.imageAcquiredSemaphore);
+        Renderer::CheckVkResult(err);
+
+        // Pools are only created once a frame first allocates
+        frame.descriptors = std::make_unique<DescriptorAllocator>(renderer.get(), FrameDescriptorRatios, false, 16);
+    }
 
+    profiler.createQueryPool(renderer.get(), (uint32_t)framesInFlight.size());
+}
+
+void Window::destroyFramesInFlight()
+{
     auto renderer = Application::Get().getRenderer();
-    VkSemaphore imageAcquiredSemaphore = imguiWindow->FrameSemaphores[imguiWindow->SemaphoreIndex].ImageAcquiredSemaphore;
-    VkSemaphore renderCompleteSemaphore = imguiWindow->FrameSemaphores[imguiWindow->SemaphoreIndex].RenderCompleteSemaphore;
-    err = vkAcquireNextImageKHR(renderer->getDevice(), imguiWindow->Swapchain, UINT64_MAX, imageAcquiredSemaphore, VK_NULL_HANDLE, &imguiWindow->FrameIndex);
-    if (err == VK_ERROR_OUT_OF_DATE_KHR || err == VK_SUBOPTIMAL_KHR) {
-        swapchainNeedRebuild = true;
-		return;
-	}
-    Renderer::CheckVkResult(err);
+    VkDevice device = renderer->getDevice();
+    VkAllocationCallbacks* allocator = renderer->getAllocator();
+
+    // Destroying the pool frees every buffer allocated from it
+    for (FrameInFlight& frame : framesInFlight) {
+        if (frame.serial != 0)
+            renderer->completeFrameSerial(frame.serial);
+        if (frame.recordedSerial != 0)
+            renderer->completeFrameSerial(frame.recordedSerial);
+        vkDestroySemaphore(device, frame.imageAcquiredSemaphore, allocator);
+        vkDestroyFence(device, frame.fence, allocator);
+        vkDestroyCommandPool(device, frame.commandPool, allocator);
+        frame.descriptors.reset();
+    }
+    framesInFlight.clear();
+    profiler.destroyQueryPool();
+}
 
-    // Increase the frame index
-    // currentFrameIndex = (currentFrameIndex + 1) % imguiWindow->ImageCount;
+DeletionQueue& Window::getDeletionQueue() const
+{
+    return Application::Get().getRenderer()->getDeletionQueue();
+}
 
-    // Wait for the fence to be signaled, which indicates the previous frame using this image is done
-    ImGui_ImplVulkanH_Frame* fd = &imguiWindow->Frames[imguiWindow->FrameIndex];
-    err = vkWaitForFences(renderer->getDevice(), 1, &fd->Fence, VK_TRUE, UINT64_MAX);
-    Renderer::CheckVkResult(err);
+void Window::frameRender(ImDrawData* drawData)
+{
+    // Nothing to draw to until the swapchain could be rebuilt
+    if (swapchainNeedRebuild)
+        return;
+    if (!acquireFrame()) {
+        swapchainNeedRebuild = true;
+        return;
+    }
+    recordFrame(drawData);
+    submitFrame();
+}
+
+bool Window::acquireFrame()
+{
+    VkResult err;
 
-    // Reset the fence for use in the next frame
-    err = vkResetFences(renderer->getDevice(), 1, &fd->Fence);
+    auto renderer = Application::Get().getRenderer();
+    FrameInFlight& frame = framesInFlight[frameInFlightIndex];
+
+    // Wait until the GPU is done with the last frame recorded into this slot. With more than one
+    // frame in flight this is a frame or more old, so the CPU keeps building ahead of the GPU.
+    // Render threads wait in slices, so they can still be stopped while a hidden window never gets an image.
+    const uint64_t timeout = settings.threadedRendering ? RenderThreadWaitSlice : UINT64_MAX;
+    {
+        FrameProfiler::Scope scope(&profiler, ProfileScope::FenceWait);
+        do {
+            err = vkWaitForFences(renderer->getDevice(), 1, &frame.fence, VK_TRUE, timeout);
+        } while (err == VK_TIMEOUT && frameState != FrameState::Stopping);
+    }
+    if (err == VK_TIMEOUT)
+        return false;
     Renderer::CheckVkResult(err);
 
-    // Free resources in queue
-    for (auto& func : resourceFreeQueue[imguiWindow->FrameIndex]) {
-        func();
+    // The frame is done, so its timestamps are ready and its resources unused
+    profiler.collectGpuTimings(frameInFlightIndex);
+    {
+        std::lock_guard<std::mutex> lock(frameSerialMutex);
+        if (frame.serial != 0) {
+            renderer->completeFrameSerial(frame.serial);
+            frame.serial = 0;
+        }
     }
-    resourceFreeQueue[imguiWindow->FrameIndex].clear();
 
-    auto& cmdBuf = allocatedCommandBuffers[imguiWindow->FrameIndex];
-    if (!cmdBuf.empty()) {
-        vkFreeCommandBuffers(renderer->getDevice(), fd->CommandPool, (uint32_t)cmdBuf.size(), cmdBuf.data());
-        cmdBuf.clear();
+    // Acquire as late as possible, right before recording
+    {
+        FrameProfiler::Scope scope(&profiler, ProfileScope::Acquire);
+        do {
+            err = swapchain->acquireNextImage(frame.imageAcquiredSemaphore, timeout, imageIndex);
+        } while ((err == VK_TIMEOUT || err == VK_NOT_READY) && frameState != FrameState::Stopping);
     }
+    if (err == VK_ERROR_OUT_OF_DATE_KHR || err == VK_TIMEOUT || err == VK_NOT_READY)
+        return false;
+
+    // A suboptimal image is still acquired and its semaphore signaled, so draw it.
+    // Present reports suboptimal as well, which rebuilds the swapchain afterwards.
+    if (err != VK_SUBOPTIMAL_KHR)
+        Renderer::CheckVkResult(err);
+    imageAcquired = true;
+    return true;
+}
 
-    err = vkResetCommandPool(renderer->getDevice(), fd->CommandPool, 0);
+void Window::recordFrame(ImDrawData* drawData)
+{
+    VkResult err;
+
+    FrameProfiler::Scope scope(&profiler, ProfileScope::Record);
+    auto renderer = Application::Get().getRenderer();
+    FrameInFlight& frame = framesInFlight[frameInFlightIndex];
+    const SwapchainImage& image = swapchain->getImage(imageIndex);
+
+    // The frame becomes pending once submitted, until then its fence still reads as signaled
+    frame.recordedSerial = frameSerial;
+    frameSerial = 0;
+
+    // Resetting the pool resets every buffer allocated from it, they're handed out again from the start
+    err = vkResetCommandPool(renderer->getDevice(), frame.commandPool, 0);
     Renderer::CheckVkResult(err);
+    FrameCommandBuffers& commandBuffers = frame.extraCommandBuffers;
+    commandBuffers.primaryUsed = 0;
+    commandBuffers.secondaryUsed = 0;
+    frame.descriptors->reset();
 
     VkCommandBufferBeginInfo buffBeginInfo = {};
     buffBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     buffBeginInfo.flags |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    err = vkBeginCommandBuffer(fd->CommandBuffer, &buffBeginInfo);
+    err = vkBeginCommandBuffer(frame.commandBuffer, &buffBeginInfo);
     Renderer::CheckVkResult(err);
+
+    // Let the user record custom passes ahead of the UI
+    recordingFrame = true;
+    onRecord(frame.commandBuffer);
+    for (auto& [id, callback] : recordCallbacks)
+        callback(frame.commandBuffer);
+
+    // Viewport windows record into the host's frame, their passes complete before any viewport samples them
+    for (Window* window : viewportWindows) {
+        window->onRecord(frame.commandBuffer);
+        for (auto& [id, callback] : window->recordCallbacks)
+            callback(frame.commandBuffer);
+    }
+    recordingFrame = false;
     
+    // The swapchain image only provides the framebuffer
     VkRenderPassBeginInfo renderBeginInfo = {};
     renderBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderBeginInfo.renderPass = imguiWindow->RenderPass;
-    renderBeginInfo.framebuffer = fd->Framebuffer;
-    renderBeginInfo.renderArea.extent.width = imguiWindow->Width;
-    renderBeginInfo.renderArea.extent.height = imguiWindow->Height;
+    renderBeginInfo.renderPass = swapchain->getRenderPass();
+    renderBeginInfo.framebuffer = image.framebuffer;
+    renderBeginInfo.renderArea.extent = swapchain->getExtent();
     renderBeginInfo.clearValueCount = 1;
-    renderBeginInfo.pClearValues = &imguiWindow->ClearValue;
-    vkCmdBeginRenderPass(fd->CommandBuffer, &renderBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+    renderBeginInfo.pClearValues = &clearValue;
+    profiler.writeGpuBegin(frame.commandBuffer, frameInFlightIndex);
+    vkCmdBeginRenderPass(frame.commandBuffer, &renderBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+    // Render ImGui, batched unless the draw data needs the ImGui backend
+    if (!drawBackend || !drawBackend->render(drawData, frame.commandBuffer, frameInFlightIndex))
+        ImGui_ImplVulkan_RenderDrawData(drawData, frame.commandBuffer);
+
+    vkCmdEndRenderPass(frame.commandBuffer);
+    profiler.writeGpuEnd(frame.commandBuffer, frameInFlightIndex);
+    err = vkEndCommandBuffer(frame.commandBuffer);
+    Renderer::CheckVkResult(err);
+
+    // Extra primaries run first, the frame's own buffer last
+    commandBuffers.submitList.assign(commandBuffers.primary.begin(), commandBuffers.primary.begin() + commandBuffers.primaryUsed);
+    commandBuffers.submitList.push_back(frame.commandBuffer);
+}
+
+uint32_t Window::addRecordCallback(std::function<void(VkCommandBuffer)> callback)
+{
+    const uint32_t id = nextRecordCallbackId++;
+    recordCallbacks.emplace_back(id, std::move(callback));
+    return id;
+}
+
+void Window::removeRecordCallback(uint32_t id)
+{
+    std::erase_if(recordCallbacks, [id](const auto& entry) { return entry.first == id; });
+}
+
+VkCommandBuffer Window::getCommandBuffer(VkCommandBufferLevel level)
+{
+    if (viewportHost)
+        return viewportHost->getCommandBuffer(level);
+    if (!recordingFrame) {
+        fmt::print("Prism: getCommandBuffer() called outside of recording\n");
+        return VK_NULL_HANDLE;
+    }
+
+    // Hand out the next recycled buffer, allocating only when this frame needs more than any before it
+    FrameInFlight& frame = framesInFlight[frameInFlightIndex];
+    FrameCommandBuffers& commandBuffers = frame.extraCommandBuffers;
+    const bool primary = level == VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    std::vector<VkCommandBuffer>& buffers = primary ? commandBuffers.primary : commandBuffers.secondary;
+    uint32_t& used = primary ? commandBuffers.primaryUsed : commandBuffers.secondaryUsed;
+    if (used == buffers.size()) {
+        VkCommandBufferAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = frame.commandPool;
+        allocInfo.level = level;
+        allocInfo.commandBufferCount = 1;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkResult err = vkAllocateCommandBuffers(Application::Get().getRenderer()->getDevice(), &allocInfo, &commandBuffer);
+        Renderer::CheckVkResult(err);
+        buffers.push_back(commandBuffer);
+    }
+    return buffers[used++];
+}
+
+VkDescriptorSet Window::allocateFrameDescriptor(VkDescriptorSetLayout layout)
+{
+    if (viewportHost)
+        return viewportHost->allocateFrameDescriptor(layout);
+    if (!recordingFrame) {
+        fmt::print("Prism: allocateFrameDescriptor() called outside of recording\n");
+        return VK_NULL_HANDLE;
+    }
+    return framesInFlight[frameInFlightIndex].descriptors->allocate(layout);
+}
+
+void Window::submitFrame()
+{
+    FrameProfiler::Scope scope(&profiler, ProfileScope::Submit);
+    auto renderer = Application::Get().getRenderer();
+    FrameInFlight& frame = framesInFlight[frameInFlightIndex];
+
+    // Render complete semaphores stay per swapchain image, the present waiting on them isn't covered by the frame's fence
+    VkSemaphore renderCompleteSemaphore = swapchain->getImage(imageIndex).renderCompleteSemaphore;
 
-	// Render ImGui
-	ImGui_ImplVulkan_RenderDrawData(drawData, fd->CommandBuffer);
+    // Only reset once we know the frame will be submitted, an unsubmitted frame must stay signaled.
+    // The serial turns pending with the reset, so completeFinishedFrames() never sees it with the old signal.
+    VkResult err;
+    {
+        std::lock_guard<std::mutex> lock(frameSerialMutex);
+        err = vkResetFences(renderer->getDevice(), 1, &frame.fence);
+        Renderer::CheckVkResult(err);
+        frame.serial = frame.recordedSerial;
+        frame.recordedSerial = 0;
+    }
 
-	// Submit command buffer
-	vkCmdEndRenderPass(fd->CommandBuffer);
+    // Submit command buffers, headless images are neither acquired nor presented so there's nothing to wait on or signal
+    const bool headless = swapchain->isHeadless();
     VkSubmitInfo submitInfo = {};
     VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = &imageAcquiredSemaphore;
+    submitInfo.waitSemaphoreCount = headless ? 0 : 1;
+    submitInfo.pWaitSemaphores = &frame.imageAcquiredSemaphore;
     submitInfo.pWaitDstStageMask = &waitStage;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &fd->CommandBuffer;
-    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.commandBufferCount = (uint32_t)frame.extraCommandBuffers.submitList.size();
+    submitInfo.pCommandBuffers = frame.extraCommandBuffers.submitList.data();
+    submitInfo.signalSemaphoreCount = headless ? 0 : 1;
     submitInfo.pSignalSemaphores = &renderCompleteSemaphore;
 
-    err = vkEndCommandBuffer(fd->CommandBuffer);
+    err = renderer->submit(submitInfo, frame.fence);
     Renderer::CheckVkResult(err);
+    imageAcquired = false;
+    if (headless)
+        readableImage = imageIndex;
 
-    err = vkQueueSubmit(renderer->getQueue(), 1, &submitInfo, fd->Fence);
-		Renderer::CheckVkResult(err);
+    // Record the next frame into the next slot while the GPU works on this one
+    frameInFlightIndex = (frameInFlightIndex + 1) % (uint32_t)framesInFlight.size();
 }
 
-void Window::framePresent()
+void Window::submitEmptyFrame()
 {
-	if (swapchainNeedRebuild) return;
     auto renderer = Application::Get().getRenderer();
-	
-    VkSemaphore renderCompleteSemaphore = imguiWindow->FrameSemaphores[imguiWindow->SemaphoreIndex].RenderCompleteSemaphore;
-	VkPresentInfoKHR info = {};
-	info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-	info.waitSemaphoreCount = 1;
-	info.pWaitSemaphores = &renderCompleteSemaphore;
-	info.swapchainCount = 1;
-	info.pSwapchains = &imguiWindow->Swapchain;
-	info.pImageIndices = &imguiWindow->FrameIndex;
-	
-    VkResult err = vkQueuePresentKHR(renderer->getQueue(), &info);
-	if (err == VK_ERROR_OUT_OF_DATE_KHR || err == VK_SUBOPTIMAL_KHR) {
-        swapchainNeedRebuild = true;
-		return;
-	}
-	Renderer::CheckVkResult(err);
+    FrameInFlight& frame = framesInFlight[frameInFlightIndex];
+
+    // Take the slot like acquireFrame() does, just without an image to draw to
+    VkResult err = vkWaitForFences(renderer->getDevice(), 1, &frame.fence, VK_TRUE, UINT64_MAX);
+    Renderer::CheckVkResult(err);
+    profiler.collectGpuTimings(frameInFlightIndex);
+    {
+        std::lock_guard<std::mutex> lock(frameSerialMutex);
+        if (frame.serial != 0)
+            renderer->completeFrameSerial(frame.serial);
+        err = vkResetFences(renderer->getDevice(), 1, &frame.fence);
+        Renderer::CheckVkResult(err);
+        frame.serial = frameSerial;
+        frameSerial = 0;
+    }
+
+    // A fence signals only once everything submitted to the queue before it completed
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    err = renderer->submit(submitInfo, frame.fence);
+    Renderer::CheckVkResult(err);
+    frameInFlightIndex = (frameInFlightIndex + 1) % (uint32_t)framesInFlight.size();
+}
+
+bool Window::framePresent()
+{
+    // Headless frames stay in their image until read back
+    if (swapchain->isHeadless())
+        return true;
 
-	imguiWindow->SemaphoreIndex = (imguiWindow->SemaphoreIndex + 1) % imguiWindow->SemaphoreCount;
+    FrameProfiler::Scope scope(&profiler, ProfileScope::Present);
+    auto renderer = Application::Get().getRenderer();
+
+    VkSemaphore renderCompleteSemaphore = swapchain->getImage(imageIndex).renderCompleteSemaphore;
+    VkSwapchainKHR swapchainHandle = swapchain->getHandle();
+    VkPresentInfoKHR info = {};
+    info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    info.waitSemaphoreCount = 1;
+    info.pWaitSemaphores = &renderCompleteSemaphore;
+    info.swapchainCount = 1;
+    info.pSwapchains = &swapchainHandle;
+    info.pImageIndices = &imageIndex;
+
+    VkResult err = renderer->present(info);
+    if (err == VK_SUCCESS || err == VK_SUBOPTIMAL_KHR)
+        swapchain->presented();
+    if (err == VK_ERROR_OUT_OF_DATE_KHR || err == VK_SUBOPTIMAL_KHR)
+        return false;
+    Renderer::CheckVkResult(err);
+    return true;
 }
 
 void Window::setupForCustomTitlebar()
@@ -674,7 +1770,37 @@ LRESULT Window::CustomWindowProc(HWND hWnd,
 void Window::WindowFocusCallback(GLFWwindow* glfwWindow, int focused)
 {
     Window* window = (Window*)glfwGetWindowUserPointer(glfwWindow);
-    window->getImGuiContext()->IO.AddFocusEvent(focused != 0);
+    InputEvent event = { InputEventType::Focus };
+    event.focused = focused != 0;
+    window->inputQueue.push(event);
+    window->requestRedraw(InputRedrawFrames);
+
+    // Focus decides the frame rate cap
+    window->focused = focused != 0;
+    window->updateFrameRate();
+}
+
+void Window::WindowIconifyCallback(GLFWwindow* glfwWindow, int iconified)
+{
+    Window* window = (Window*)glfwGetWindowUserPointer(glfwWindow);
+    window->iconified = iconified != 0;
+    if (!window->iconified)
+        window->requestRedraw(InputRedrawFrames);
+}
+
+void Window::WindowRefreshCallback(GLFWwindow* glfwWindow)
+{
+    // Draw now, the main loop may be blocked in the OS's modal resize loop until the user lets go
+    Window* window = (Window*)glfwGetWindowUserPointer(glfwWindow);
+    window->requestRedraw();
+    window->render();
+}
+
+void Window::FramebufferSizeCallback(GLFWwindow* glfwWindow, int width, int height)
+{
+    Window* window = (Window*)glfwGetWindowUserPointer(glfwWindow);
+    window->swapchainNeedRebuild = true;
+    window->requestRedraw();
 }
 
 void Window::CursorEnterCallback(GLFWwindow* glfwWindow, int entered)
@@ -682,31 +1808,21 @@ void Window::CursorEnterCallback(GLFWwindow* glfwWindow, int entered)
     if (glfwGetInputMode(glfwWindow, GLFW_CURSOR) == GLFW_CURSOR_DISABLED)
         return;
     Window* window = (Window*)glfwGetWindowUserPointer(glfwWindow);
-    ImGuiIO& io = window->getImGuiContext()->IO;
-    ImGui_ImplGlfw_Data* bd = (ImGui_ImplGlfw_Data*)io.BackendPlatformUserData;
-
-    if (entered) {
-        bd->MouseWindow = glfwWindow;
-        io.AddMousePosEvent(bd->LastValidMousePos.x, bd->LastValidMousePos.y);
-    }
-    else if (!entered && bd->MouseWindow == glfwWindow) {
-        bd->LastValidMousePos = io.MousePos;
-        bd->MouseWindow = nullptr;
-        io.AddMousePosEvent(-FLT_MAX, -FLT_MAX);
-    }
+    InputEvent event = { InputEventType::CursorEnter };
+    event.entered = entered != 0;
+    window->inputQueue.push(event);
+    window->requestRedraw(InputRedrawFrames);
 }
 
 void Window::CursorPosCallback(GLFWwindow* glfwWindow, double x, double y)
 {
     if (glfwGetInputMode(glfwWindow, GLFW_CURSOR) == GLFW_CURSOR_DISABLED)
         return;
-
     Window* window = (Window*)glfwGetWindowUserPointer(glfwWindow);
-    ImGuiIO& io = window->getImGuiContext()->IO;
-    ImGui_ImplGlfw_Data* bd = (ImGui_ImplGlfw_Data*)io.BackendPlatformUserData;
-
-    io.AddMousePosEvent((float)x, (float)y);
-    bd->LastValidMousePos = ImVec2((float)x, (float)y);
+    InputEvent event = { InputEventType::CursorPos };
+    event.position = { x, y };
+    window->inputQueue.push(event);
+    window->requestRedraw(InputRedrawFrames);
 }
 
 void Window::MouseButtonCallback(GLFWwindow* glfwWindow,
@@ -715,23 +1831,21 @@ void Window::MouseButtonCallback(GLFWwindow* glfwWindow,
                                  int mods)
 {
     Window* window = (Window*)glfwGetWindowUserPointer(glfwWindow);
-    ImGuiIO& io = window->getImGuiContext()->IO;
-    ImGui_ImplGlfw_Data* bd = (ImGui_ImplGlfw_Data*)io.BackendPlatformUserData;
-
-    UpdateKeyModifiers(glfwWindow);
-
-    if (button >= 0 && button < ImGuiMouseButton_COUNT)
-        io.AddMouseButtonEvent(button, action == GLFW_PRESS);
+    InputEvent event = { InputEventType::MouseButton };
+    event.mouseButton = { button, action, mods };
+    window->inputQueue.push(event);
+    window->requestRedraw(InputRedrawFrames);
 }
 
 void Window::ScrollCallback(GLFWwindow* glfwWindow,
                             double xoffset,
                             double yoffset)
 {
-
     Window* window = (Window*)glfwGetWindowUserPointer(glfwWindow);
-    ImGuiIO& io = window->getImGuiContext()->IO;
-    io.AddMouseWheelEvent((float)xoffset, (float)yoffset);
+    InputEvent event = { InputEventType::Scroll };
+    event.scroll = { xoffset, yoffset };
+    window->inputQueue.push(event);
+    window->requestRedraw(InputRedrawFrames);
 }
 
 void Window::KeyCallback(GLFWwindow* glfwWindow,
@@ -740,36 +1854,32 @@ void Window::KeyCallback(GLFWwindow* glfwWindow,
                          int action,
                          int mods)
 {
-    Window* window = (Window*)glfwGetWindowUserPointer(glfwWindow);
-    ImGuiIO& io = window->getImGuiContext()->IO;
-    ImGui_ImplGlfw_Data* bd = (ImGui_ImplGlfw_Data*)io.BackendPlatformUserData;
-
     if (action != GLFW_PRESS && action != GLFW_RELEASE)
         return;
 
-    UpdateKeyModifiers(glfwWindow);
-
-    if (keycode >= 0 && keycode < IM_ARRAYSIZE(bd->KeyOwnerWindows))
-        bd->KeyOwnerWindows[keycode] = (action == GLFW_PRESS) ? glfwWindow : nullptr;
-
-    keycode = TranslateUntranslatedKey(keycode, scancode);
-
-    ImGuiKey imguiKey = KeyToImGuiKey(keycode);
-    io.AddKeyEvent(imguiKey, (action == GLFW_PRESS));
-    io.SetKeyEventNativeData(imguiKey, keycode, scancode); // To support legacy indexing (<1.87 user code)
+    // Translating asks GLFW for the key name, which has to happen on the main thread
+    Window* window = (Window*)glfwGetWindowUserPointer(glfwWindow);
+    InputEvent event = { InputEventType::Key };
+    event.key = { keycode, TranslateUntranslatedKey(keycode, scancode), scancode, action, mods };
+    window->inputQueue.push(event);
+    window->requestRedraw(InputRedrawFrames);
 }
 
 void Window::CharCallback(GLFWwindow* glfwWindow, unsigned int c)
 {
     Window* window = (Window*)glfwGetWindowUserPointer(glfwWindow);
-    ImGuiIO& io = window->getImGuiContext()->IO;
-    io.AddInputCharacter(c);
+    InputEvent event = { InputEventType::Char };
+    event.codepoint = c;
+    window->inputQueue.push(event);
+    window->requestRedraw(InputRedrawFrames);
 }
 
 void Window::MonitorCallback(GLFWmonitor* monitor, int event)
 {
     std::vector<std::shared_ptr<Window>> windows = Application::Get().getWindows();
     for (auto& window : windows) {
+        if (!window->getImGuiContext())
+            continue;
         ImGui_ImplGlfw_Data* bd = (ImGui_ImplGlfw_Data*)window->getImGuiContext()->IO.BackendPlatformUserData;
         bd->WantUpdateMonitors = true;
     }
@@ -777,15 +1887,25 @@ void Window::MonitorCallback(GLFWmonitor* monitor, int event)
 
 } // namespace Prism
 
-// from imgui_impl_glfw.cpp
-static void UpdateKeyModifiers(GLFWwindow* glfwWindow)
+// ImGui dedups unchanged key states, so updating every modifier per event is cheap
+static void UpdateKeyModifiers(ImGuiIO& io, int mods)
 {
-    Prism::Window* window = (Prism::Window*)glfwGetWindowUserPointer(glfwWindow);
-    ImGuiIO& io = window->getImGuiContext()->IO;
-    ImGui_ImplGlfw_Data* bd = (ImGui_ImplGlfw_Data*)io.BackendPlatformUserData;
+    io.AddKeyEvent(ImGuiMod_Ctrl,  (mods & GLFW_MOD_CONTROL) != 0);
+    io.AddKeyEvent(ImGuiMod_Shift, (mods & GLFW_MOD_SHIFT)   != 0);
+    io.AddKeyEvent(ImGuiMod_Alt,   (mods & GLFW_MOD_ALT)     != 0);
+    io.AddKeyEvent(ImGuiMod_Super, (mods & GLFW_MOD_SUPER)   != 0);
+}
 
-    io.AddKeyEvent(ImGuiMod_Ctrl,  (glfwGetKey(bd->Window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS) || (glfwGetKey(bd->Window, GLFW_KEY_RIGHT_CONTROL) == GLFW_PRESS));
-    io.AddKeyEvent(ImGuiMod_Shift, (glfwGetKey(bd->Window, GLFW_KEY_LEFT_SHIFT)   == GLFW_PRESS) || (glfwGetKey(bd->Window, GLFW_KEY_RIGHT_SHIFT)   == GLFW_PRESS));
-    io.AddKeyEvent(ImGuiMod_Alt,   (glfwGetKey(bd->Window, GLFW_KEY_LEFT_ALT)     == GLFW_PRESS) || (glfwGetKey(bd->Window, GLFW_KEY_RIGHT_ALT)     == GLFW_PRESS));
-    io.AddKeyEvent(ImGuiMod_Super, (glfwGetKey(bd->Window, GLFW_KEY_LEFT_SUPER)   == GLFW_PRESS) || (glfwGetKey(bd->Window, GLFW_KEY_RIGHT_SUPER)   == GLFW_PRESS));
-}
\ No newline at end of file
+// from imgui_impl_glfw.cpp
+static int KeyToModifier(int keycode)
+{
+    if (keycode == GLFW_KEY_LEFT_CONTROL || keycode == GLFW_KEY_RIGHT_CONTROL)
+        return GLFW_MOD_CONTROL;
+    if (keycode == GLFW_KEY_LEFT_SHIFT || keycode == GLFW_KEY_RIGHT_SHIFT)
+        return GLFW_MOD_SHIFT;
+    if (keycode == GLFW_KEY_LEFT_ALT || keycode == GLFW_KEY_RIGHT_ALT)
+        return GLFW_MOD_ALT;
+    if (keycode == GLFW_KEY_LEFT_SUPER || keycode == GLFW_KEY_RIGHT_SUPER)
+        return GLFW_MOD_SUPER;
+    return 0;
+}